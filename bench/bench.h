@@ -0,0 +1,42 @@
+/**
+ * @file
+ */
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+namespace bench {
+
+/** Heap allocations made so far, counted by our operator new */
+extern std::atomic<uint64_t> allocations;
+
+struct result {
+	double seconds;
+	uint64_t allocations;
+};
+
+/** Runs code the given number of times, after one untimed warm-up run */
+template<typename F>
+result measure(size_t iterations, F code) {
+	code();
+	auto allocs = allocations.load();
+	auto start = std::chrono::steady_clock::now();
+	for(size_t i = 0; i < iterations; ++i) {
+		code();
+	}
+	auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return result { elapsed, allocations.load() - allocs };
+}
+
+/** Prints throughput in GB/s and records/s, and allocations per record */
+void report(const std::string &name, size_t iterations, size_t bytes, size_t records, const result &r);
+
+/** Registers a benchmark group to run from main() */
+struct registration {
+	registration(const char *name, std::function<void()> code);
+};
+
+};
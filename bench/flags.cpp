@@ -0,0 +1,44 @@
+/**
+ * @file
+ * Rollout checks: reading the percentage and hashing per call, against the
+ * compiled decision table.
+ */
+#include "bench.h"
+
+#include <memory>
+#include <appcon/detail.h>
+#include <appcon/flags.h>
+
+namespace {
+
+void run() {
+	auto cfg = std::static_pointer_cast<appcon::config>(std::make_shared<appcon::detail::config>());
+	appcon::flags f { cfg };
+	auto flag = f.declare("rollout", 25.0f, "benchmark rollout");
+	const size_t contexts = 1000000;
+	const size_t iterations = 10;
+	volatile size_t sink = 0;
+	bench::report("key<float> and hash", iterations, 0, contexts, bench::measure(iterations, [&]() {
+		size_t on = 0;
+		for(uint64_t i = 0; i < contexts; ++i) {
+			auto percent = cfg->key("flags.rollout", 25.0f);
+			if(static_cast<float>(std::hash<uint64_t>()(i) % 10000) < percent * 100.0f) {
+				++on;
+			}
+		}
+		sink = on;
+	}));
+	bench::report("flags::enabled", iterations, 0, contexts, bench::measure(iterations, [&]() {
+		size_t on = 0;
+		for(uint64_t i = 0; i < contexts; ++i) {
+			if(f.enabled(flag, i)) {
+				++on;
+			}
+		}
+		sink = on;
+	}));
+}
+
+bench::registration flags { "flags", run };
+
+}
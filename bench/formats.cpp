@@ -0,0 +1,130 @@
+/**
+ * @file
+ * Compares the JSON and TOML parsers with the INI path, on the same records.
+ */
+#include "bench.h"
+
+#include <fstream>
+#include <sstream>
+#include <boost/program_options.hpp>
+#include <appcon/detail.h>
+#include <appcon/formats.h>
+
+namespace {
+
+const size_t sections = 100;
+const size_t keys_per_section = 20;
+const size_t records = sections * keys_per_section;
+
+/** Exposes the file parser, so loads can be timed without the fingerprint cache */
+class bench_config : public appcon::detail::config {
+public:
+	using appcon::detail::config::parse_file;
+};
+
+std::string key_name(size_t s, size_t k) {
+	return "section" + std::to_string(s) + ".key" + std::to_string(k);
+}
+
+std::string make_ini() {
+	std::ostringstream out;
+	for(size_t s = 0; s < sections; ++s) {
+		out << "[section" << s << "]\n";
+		for(size_t k = 0; k < keys_per_section; ++k) {
+			out << "key" << k << " = " << (s * 1000 + k) << "\n";
+		}
+	}
+	return out.str();
+}
+
+std::string make_json() {
+	std::ostringstream out;
+	out << "{\n";
+	for(size_t s = 0; s < sections; ++s) {
+		out << (s ? ",\n" : "") << "  \"section" << s << "\": {";
+		for(size_t k = 0; k < keys_per_section; ++k) {
+			out << (k ? ", " : " ") << "\"key" << k << "\": " << (s * 1000 + k);
+		}
+		out << " }";
+	}
+	out << "\n}\n";
+	return out.str();
+}
+
+std::string make_toml() {
+	std::ostringstream out;
+	for(size_t s = 0; s < sections; ++s) {
+		out << "[section" << s << "]\n";
+		for(size_t k = 0; k < keys_per_section; ++k) {
+			out << "key" << k << " = " << (s * 1000 + k) << "\n";
+		}
+	}
+	return out.str();
+}
+
+void write_file(const std::string &path, const std::string &text) {
+	std::ofstream out { path, std::ios::out | std::ios::binary | std::ios::trunc };
+	out << text;
+}
+
+void run() {
+	namespace po = boost::program_options;
+	auto ini = make_ini();
+	auto json = make_json();
+	auto toml = make_toml();
+	size_t seen = 0;
+	auto count = [&seen](boost::string_view, boost::string_view) { ++seen; };
+	const size_t iterations = 200;
+
+	po::options_description desc;
+	for(size_t s = 0; s < sections; ++s) {
+		for(size_t k = 0; k < keys_per_section; ++k) {
+			desc.add_options()(key_name(s, k).c_str(), po::value<uint32_t>());
+		}
+	}
+
+	/* Parsing alone: text in, key/value records out */
+	bench::report("parse ini (program_options)", iterations, ini.size(), records, bench::measure(iterations, [&]() {
+		std::istringstream in { ini };
+		po::variables_map vm;
+		po::store(po::parse_config_file(in, desc, true), vm);
+	}));
+	bench::report("parse ini (tokenizer)", iterations, ini.size(), records, bench::measure(iterations, [&]() {
+		appcon::detail::ini_tokenizer tok;
+		tok.feed(ini.data(), ini.size(), count);
+		tok.finish(count);
+	}));
+	bench::report("parse json", iterations, json.size(), records, bench::measure(iterations, [&]() {
+		appcon::detail::parse_json(json, count);
+	}));
+	bench::report("parse toml", iterations, toml.size(), records, bench::measure(iterations, [&]() {
+		appcon::detail::parse_toml(toml, count);
+	}));
+
+	/* Loading into a config: parsing, typed conversion and publishing */
+	bench_config cfg;
+	for(size_t s = 0; s < sections; ++s) {
+		for(size_t k = 0; k < keys_per_section; ++k) {
+			cfg(key_name(s, k), uint32_t { 0 }, "benchmark key");
+		}
+	}
+	write_file("bench-formats.ini", ini);
+	write_file("bench-formats.json", json);
+	write_file("bench-formats.toml", toml);
+	const size_t loads = 20;
+	for(auto ext : { "ini", "json", "toml" }) {
+		std::string path = std::string { "bench-formats." } + ext;
+		auto bytes = ext[0] == 'i' ? ini.size() : ext[0] == 'j' ? json.size() : toml.size();
+		std::vector<appcon::detail::config::pending_update> out;
+		std::vector<std::string> includes;
+		bench::report(std::string { "load " } + ext, loads, bytes, records, bench::measure(loads, [&]() {
+			out.clear();
+			includes.clear();
+			cfg.parse_file(path, out, includes);
+		}));
+	}
+}
+
+bench::registration formats { "formats", run };
+
+}
@@ -0,0 +1,66 @@
+#include "bench.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <utility>
+#include <vector>
+#include <boost/log/core.hpp>
+
+std::atomic<uint64_t> bench::allocations { 0 };
+
+void *operator new(size_t n) {
+	++bench::allocations;
+	if(auto p = std::malloc(n ? n : 1)) {
+		return p;
+	}
+	throw std::bad_alloc();
+}
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+
+namespace {
+
+std::vector<std::pair<const char *, std::function<void()>>> &groups() {
+	static std::vector<std::pair<const char *, std::function<void()>>> all;
+	return all;
+}
+
+}
+
+bench::registration::registration(const char *name, std::function<void()> code)
+{
+	groups().emplace_back(name, std::move(code));
+}
+
+void
+bench::report(const std::string &name, size_t iterations, size_t bytes, size_t records, const result &r)
+{
+	auto total_bytes = static_cast<double>(bytes) * static_cast<double>(iterations);
+	auto total_records = static_cast<double>(records) * static_cast<double>(iterations);
+	std::printf(
+		"%-32s %8.3f GB/s %12.0f records/s %8.2f allocs/record\n",
+		name.c_str(),
+		total_bytes / r.seconds / 1e9,
+		total_records / r.seconds,
+		static_cast<double>(r.allocations) / total_records
+	);
+}
+
+/** Runs every group, or only those named on the command line */
+int main(int argc, char *argv[])
+{
+	boost::log::core::get()->set_logging_enabled(false);
+	for(const auto &g : groups()) {
+		bool wanted = argc < 2;
+		for(int i = 1; i < argc; ++i) {
+			wanted = wanted || std::strcmp(argv[i], g.first) == 0;
+		}
+		if(wanted) {
+			std::printf("== %s\n", g.first);
+			g.second();
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,49 @@
+/**
+ * @file
+ * Numeric conversion against boost::lexical_cast, which program_options uses.
+ */
+#include "bench.h"
+
+#include <random>
+#include <vector>
+#include <boost/lexical_cast.hpp>
+#include <appcon/numeric.h>
+
+namespace {
+
+template<typename T>
+void compare(const char *name, const std::vector<std::string> &values) {
+	size_t bytes = 0;
+	for(const auto &v : values) {
+		bytes += v.size();
+	}
+	const size_t iterations = 50;
+	volatile T sink = 0;
+	bench::report(std::string { name } + " lexical_cast", iterations, bytes, values.size(), bench::measure(iterations, [&]() {
+		for(const auto &v : values) {
+			sink = boost::lexical_cast<T>(v);
+		}
+	}));
+	bench::report(std::string { name } + " parse_number", iterations, bytes, values.size(), bench::measure(iterations, [&]() {
+		for(const auto &v : values) {
+			sink = appcon::detail::parse_number<T>(v);
+		}
+	}));
+}
+
+void run() {
+	std::mt19937_64 rng { 42 };
+	std::vector<std::string> u32, i64, f32;
+	for(int i = 0; i < 20000; ++i) {
+		u32.push_back(std::to_string(static_cast<uint32_t>(rng() >> (rng() % 32))));
+		i64.push_back(std::to_string(static_cast<int64_t>(rng()) >> (rng() % 64)));
+		f32.push_back(std::to_string(static_cast<int>(rng() % 100000)) + "." + std::to_string(rng() % 1000));
+	}
+	compare<uint32_t>("uint32_t", u32);
+	compare<int64_t>("int64_t", i64);
+	compare<float>("float", f32);
+}
+
+bench::registration numeric { "numeric", run };
+
+}
@@ -0,0 +1,81 @@
+/**
+ * @file
+ * Reads spread over many keys, through snapshots and realtime handles, and
+ * snapshot reads on several threads while another thread writes.
+ */
+#include "bench.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <appcon/detail.h>
+
+namespace {
+
+void run() {
+	auto cfg = std::make_shared<appcon::detail::config>();
+	const size_t keys = 100000;
+	std::vector<std::string> names;
+	for(size_t i = 0; i < keys; ++i) {
+		names.push_back("key" + std::to_string(i));
+		(*cfg)(names.back(), static_cast<uint32_t>(i), "benchmark key");
+	}
+	std::shuffle(names.begin(), names.end(), std::mt19937_64 { 42 });
+	std::vector<appcon::rt_key> handles;
+	for(const auto &n : names) {
+		handles.push_back(cfg->realtime(n));
+	}
+	const size_t iterations = 10;
+	volatile uint64_t sink = 0;
+	bench::report("snapshot key<uint32_t>", iterations, 0, keys, bench::measure(iterations, [&]() {
+		auto s = cfg->snapshot();
+		uint64_t total = 0;
+		for(const auto &n : names) {
+			total += s->key(n, uint32_t { 0 });
+		}
+		sink = total;
+	}));
+	bench::report("rt_key::get", iterations, 0, keys, bench::measure(iterations, [&]() {
+		uint64_t total = 0;
+		for(const auto &h : handles) {
+			total += h.get(uint32_t { 0 });
+		}
+		sink = total;
+	}));
+
+	/* Readers take a snapshot per read while a writer keeps publishing */
+	const size_t readers = 4;
+	const size_t reads = 200000;
+	bench::report("contended snapshot reads", 1, 0, readers * reads, bench::measure(1, [&]() {
+		std::atomic<bool> done { false };
+		std::thread writer([&]() {
+			uint32_t v = 0;
+			while(!done.load(std::memory_order_relaxed)) {
+				cfg->set("key0", v++, "bench");
+			}
+		});
+		std::vector<std::thread> threads;
+		for(size_t t = 0; t < readers; ++t) {
+			threads.emplace_back([&, t]() {
+				uint64_t total = 0;
+				for(size_t i = 0; i < reads; ++i) {
+					total += cfg->snapshot()->key(names[(i * readers + t) % keys], uint32_t { 0 });
+				}
+				sink = total;
+			});
+		}
+		for(auto &t : threads) {
+			t.join();
+		}
+		done = true;
+		writer.join();
+	}));
+}
+
+bench::registration reads { "reads", run };
+
+}
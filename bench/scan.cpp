@@ -0,0 +1,60 @@
+/**
+ * @file
+ * Scanning and tokenizing a large generated INI file with each instruction set.
+ */
+#include "bench.h"
+
+#include <sstream>
+#include <appcon/ini_tokenizer.h>
+
+namespace {
+
+void run() {
+	std::ostringstream out;
+	for(size_t s = 0; out.tellp() < 8 * 1024 * 1024; ++s) {
+		out << "[generated_section_" << s << "]\n";
+		out << "# settings for section " << s << ", written by the generator\n";
+		for(size_t k = 0; k < 16; ++k) {
+			out << "some_fairly_long_key_name_" << k << " = value number " << (s * 100 + k) << " # trailing note\n";
+		}
+	}
+	auto text = out.str();
+	size_t lines = 0;
+	for(auto c : text) {
+		lines += c == '\n';
+	}
+	const size_t iterations = 20;
+	using appcon::detail::simd_level;
+	const std::pair<const char *, simd_level> levels[] = {
+		{ "scalar", simd_level::scalar },
+		{ "sse2", simd_level::sse2 },
+		{ "avx2", simd_level::avx2 },
+	};
+	for(const auto &l : levels) {
+		auto scan = appcon::detail::line_scanner_for(l.second);
+		if(!scan) {
+			continue;
+		}
+		size_t found = 0;
+		bench::report(std::string { "scan lines " } + l.first, iterations, text.size(), lines, bench::measure(iterations, [&]() {
+			auto p = text.data();
+			auto end = p + text.size();
+			while(p < end) {
+				auto m = scan(p, end);
+				found += m.equals != m.eol;
+				p = m.eol + 1;
+			}
+		}));
+		size_t records = 0;
+		auto count = [&records](boost::string_view, boost::string_view) { ++records; };
+		bench::report(std::string { "tokenize " } + l.first, iterations, text.size(), lines, bench::measure(iterations, [&]() {
+			appcon::detail::ini_tokenizer tok { text.size(), scan };
+			tok.feed(text.data(), text.size(), count);
+			tok.finish(count);
+		}));
+	}
+}
+
+bench::registration scan { "scan", run };
+
+}
@@ -0,0 +1,41 @@
+/**
+ * @file
+ * Scheduling and cancelling timers with many already pending.
+ */
+#include "bench.h"
+
+#include <random>
+#include <vector>
+#include <appcon/timer_wheel.h>
+
+namespace {
+
+void run() {
+	using clock = appcon::detail::timer_wheel::clock;
+	appcon::detail::timer_wheel wheel;
+	std::mt19937_64 rng { 42 };
+	/* Long-running overrides sitting in the wheel while we work */
+	auto now = clock::now();
+	for(int i = 0; i < 100000; ++i) {
+		wheel.schedule(now + std::chrono::seconds(60 + rng() % 36000), []() { });
+	}
+	std::vector<std::chrono::milliseconds> offsets;
+	for(int i = 0; i < 10000; ++i) {
+		offsets.emplace_back(1000 + rng() % 3600000);
+	}
+	std::vector<uint64_t> ids(offsets.size());
+	const size_t iterations = 20;
+	bench::report("schedule and cancel", iterations, 0, offsets.size(), bench::measure(iterations, [&]() {
+		auto start = clock::now();
+		for(size_t i = 0; i < offsets.size(); ++i) {
+			ids[i] = wheel.schedule(start + offsets[i], []() { });
+		}
+		for(auto id : ids) {
+			wheel.cancel(id);
+		}
+	}));
+}
+
+bench::registration timers { "timers", run };
+
+}
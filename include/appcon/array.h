@@ -0,0 +1,90 @@
+/**
+ * @file
+ */
+#pragma once
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <boost/utility/string_view.hpp>
+#include <appcon/numeric.h>
+#include <appcon/value_type.h>
+
+namespace appcon {
+namespace detail {
+
+/** Formats a number so that it reads back as the same value */
+template<typename T>
+std::string format_element(T v) { return std::to_string(v + 0); }
+inline std::string format_element(float v) {
+	char buf[32];
+	std::snprintf(buf, sizeof(buf), "%.9g", static_cast<double>(v));
+	return buf;
+}
+inline std::string format_element(double v) {
+	char buf[32];
+	std::snprintf(buf, sizeof(buf), "%.17g", v);
+	return buf;
+}
+
+/** Joins values into list syntax */
+template<typename T>
+std::string format_array(const std::vector<T> &values) {
+	std::string out;
+	for(const auto &v : values) {
+		if(!out.empty()) {
+			out += ',';
+		}
+		out += format_element(v);
+	}
+	return out;
+}
+
+/**
+ * Lists of numbers, written as "1,2,3". Blanks around each value and a
+ * surrounding pair of brackets are allowed, so "[1, 2, 3]" is the same list.
+ * The values are held in a single std::vector, so readers get them as one
+ * contiguous block.
+ */
+template<typename T>
+class array_type : public value_type {
+public:
+	array_type():name_{ type_name_for() } { }
+
+	/** Name these are registered under, such as "uint16_t[]" */
+	static std::string type_name_for() { return std::string { type_name(T { }) } + "[]"; }
+
+	virtual const std::string &name() const override { return name_; }
+
+	virtual pinned<parsed_value> parse(boost::string_view text) const override {
+		auto s = trim_number(text);
+		if(!s.empty() && s.front() == '[') {
+			if(s.back() != ']') {
+				throw std::invalid_argument("\"" + text.to_string() + "\" has no closing ]");
+			}
+			s = trim_number(s.substr(1, s.size() - 2));
+		}
+		std::vector<T> values;
+		while(!s.empty()) {
+			auto comma = s.find(',');
+			values.push_back(parse_number<T>(s.substr(0, comma)));
+			if(comma == boost::string_view::npos) {
+				break;
+			}
+			s.remove_prefix(comma + 1);
+			if(trim_number(s).empty()) {
+				throw std::invalid_argument("\"" + text.to_string() + "\" ends with a comma");
+			}
+		}
+		return pinned<parsed_value>::adopt(new parsed<std::vector<T>>(std::move(values)));
+	}
+
+	virtual std::string format(const parsed_value &v) const override {
+		return format_array(static_cast<const parsed<std::vector<T>> &>(v).get());
+	}
+
+private:
+	std::string name_;
+};
+
+};
+};
@@ -0,0 +1,173 @@
+/**
+ * @file
+ */
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <new>
+#include <string>
+#include <vector>
+#include <boost/container/pmr/global_resource.hpp>
+#include <boost/container/pmr/memory_resource.hpp>
+#include <boost/container/pmr/string.hpp>
+#include <appcon/pinned.h>
+
+namespace appcon {
+
+/**
+ * A single entry in the change log. Its strings come from the config's
+ * memory resource, if it was given one.
+ */
+struct change {
+	/** Dense id for the key, stable for the lifetime of the config */
+	uint32_t key_id;
+	boost::container::pmr::string key;
+	/** Previous value, or an empty string if the key had none */
+	boost::container::pmr::string old_value;
+	boost::container::pmr::string new_value;
+	/** Where the new value came from */
+	boost::container::pmr::string source;
+	/** Generation the change was published in */
+	uint64_t generation;
+};
+
+/** Position in the change log, see config::read_changes() */
+struct change_cursor {
+	change_cursor():generation{ 0 }, overflow{ false } { }
+	explicit change_cursor(uint64_t g):generation{ g }, overflow{ false } { }
+	/** Everything up to and including this generation has been seen */
+	uint64_t generation;
+	/** Set when changes after generation were dropped before they were read */
+	bool overflow;
+};
+
+namespace detail {
+
+/**
+ * Bounded ring of published changes. A single writer (holding the config
+ * mutex) appends, and any number of readers scan without locking. Each
+ * slot carries its sequence number, so a reader can tell when the writer
+ * has lapped it. Records come from the given memory resource, or the
+ * global heap if there is none; the last reader to drop one hands it back,
+ * so the resource must be thread-safe.
+ */
+class change_ring {
+public:
+	using memory_resource = boost::container::pmr::memory_resource;
+
+	struct record : public shared_block {
+		record(uint64_t s, appcon::change c, memory_resource *mr):seq{ s }, entry(std::move(c)), mr_{ mr } { }
+		uint64_t seq;
+		appcon::change entry;
+
+	protected:
+		virtual void dispose() const override {
+			auto mr = mr_;
+			auto p = const_cast<record *>(this);
+			p->~record();
+			mr->deallocate(p, sizeof(record), alignof(record));
+		}
+
+	private:
+		memory_resource *mr_;
+	};
+
+	/**
+	 * Changes up to and including the given generation are treated as
+	 * already dropped, since they happened before the log existed.
+	 */
+	change_ring(size_t capacity, uint64_t generation, memory_resource *mr = nullptr)
+	 :slots_(capacity),
+	  generations_(capacity, 0),
+	  head_{ 0 },
+	  dropped_{ generation },
+	  mr_{ mr ? mr : boost::container::pmr::new_delete_resource() }
+	{
+	}
+
+	size_t capacity() const { return slots_.size(); }
+
+	/** Adds a change, overwriting the oldest one if we are full. Single writer only. */
+	void append(appcon::change c) {
+		auto seq = head_.load(std::memory_order_relaxed);
+		auto i = static_cast<size_t>(seq % slots_.size());
+		if(seq >= slots_.size()) {
+			/* Readers check this before trusting the oldest record we still have */
+			dropped_.store(generations_[i], std::memory_order_release);
+		}
+		generations_[i] = c.generation;
+		slots_[i].store(pinned<record>::adopt(make_record(seq, std::move(c))));
+		head_.store(seq + 1, std::memory_order_release);
+	}
+
+	/**
+	 * Calls code for each change after the cursor, up to and including
+	 * generation upto, and moves the cursor on. If changes the cursor needs
+	 * have already been dropped, sets overflow and delivers nothing.
+	 * @returns the number of changes delivered
+	 */
+	template<typename F>
+	size_t read(change_cursor &cursor, uint64_t upto, F code) const {
+		auto head = head_.load(std::memory_order_acquire);
+		auto cap = static_cast<uint64_t>(slots_.size());
+		auto lo = head > cap ? head - cap : 0;
+		auto hi = head;
+		/* Binary search for the first record after the cursor; overwritten slots count as too old */
+		while(lo < hi) {
+			auto mid = lo + (hi - lo) / 2;
+			auto r = slots_[static_cast<size_t>(mid % cap)].load();
+			if(!r || r->seq != mid || r->entry.generation <= cursor.generation) {
+				lo = mid + 1;
+			} else {
+				hi = mid;
+			}
+		}
+		if(dropped_.load(std::memory_order_acquire) > cursor.generation) {
+			cursor.overflow = true;
+			return 0;
+		}
+
+		std::vector<pinned<record>> found;
+		for(auto seq = lo; seq < head; ++seq) {
+			auto r = slots_[static_cast<size_t>(seq % cap)].load();
+			if(!r || r->seq != seq) {
+				cursor.overflow = true;
+				return 0;
+			}
+			if(r->entry.generation > upto) {
+				break;
+			}
+			found.push_back(std::move(r));
+		}
+		for(const auto &r : found) {
+			code(r->entry);
+		}
+		if(upto > cursor.generation) {
+			cursor.generation = upto;
+		}
+		return found.size();
+	}
+
+private:
+	record *make_record(uint64_t seq, appcon::change c) {
+		auto mem = mr_->allocate(sizeof(record), alignof(record));
+		try {
+			return new (mem) record(seq, std::move(c), mr_);
+		} catch(...) {
+			mr_->deallocate(mem, sizeof(record), alignof(record));
+			throw;
+		}
+	}
+
+	std::vector<atomic_pinned<record>> slots_;
+	/** Generation of the record in each slot, for the writer's use */
+	std::vector<uint64_t> generations_;
+	/** Sequence number for the next record */
+	std::atomic<uint64_t> head_;
+	/** Generation of the most recent record to be overwritten */
+	std::atomic<uint64_t> dropped_;
+	memory_resource *mr_;
+};
+
+};
+};
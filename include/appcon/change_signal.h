@@ -0,0 +1,39 @@
+/**
+ * @file
+ */
+#pragma once
+#include <atomic>
+#include <mutex>
+
+namespace appcon {
+namespace detail {
+
+/**
+ * A file descriptor that becomes readable when something changes, for use
+ * with poll or epoll. Uses an eventfd on Linux and a non-blocking pipe
+ * elsewhere. Nothing is opened until someone asks for the descriptor, so
+ * notify() costs a single atomic load when nobody is listening.
+ */
+class change_signal {
+public:
+	change_signal();
+	change_signal(const change_signal &) = delete;
+	change_signal &operator=(const change_signal &) = delete;
+	~change_signal();
+
+	/**
+	 * Returns the readable end, opening it on first use.
+	 * @throws std::system_error if the descriptor cannot be created
+	 */
+	int fd();
+	/** Makes the descriptor readable, if anyone has asked for it */
+	void notify() noexcept;
+
+private:
+	std::mutex mutex_;
+	int read_fd_;
+	std::atomic<int> write_fd_;
+};
+
+};
+};
@@ -4,6 +4,19 @@
 #pragma once
 #include <string>
 #include <memory>
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <future>
+#include <type_traits>
+#include <typeinfo>
+#include <cstdint>
+#include <vector>
+#include <appcon/array.h>
+#include <appcon/change_log.h>
+#include <appcon/realtime.h>
+#include <appcon/signal_reload.h>
+#include <appcon/view.h>
 
 namespace appcon {
 
@@ -36,12 +49,87 @@ public:
 	virtual config &operator()(std::string k, int32_t def, std::string desc) = 0;
 	virtual config &operator()(std::string k, int64_t def, std::string desc) = 0;
 
+	/**
+	 * Makes a type available to define(). Register types before declaring
+	 * keys that use them; registering a name twice replaces the first.
+	 */
+	virtual config &register_type(std::shared_ptr<const value_type> type) = 0;
+	/** Registers a type from functions converting it from and to text */
+	template<typename T>
+	config &register_type(
+		const std::string &name,
+		std::function<T(boost::string_view)> parse,
+		std::function<std::string(const T &)> format
+	) {
+		return register_type(std::make_shared<basic_value_type<T>>(name, std::move(parse), std::move(format)));
+	}
+	/**
+	 * Record a new config entry of a registered type, with its default as text.
+	 * Values are parsed once when they change, and the result is shared by
+	 * every reader through typed(). key() and watchers see the canonical text.
+	 * @throws std::invalid_argument if the type is unknown or the default is not valid
+	 */
+	virtual config &define(std::string k, const std::string &type, const std::string &def, std::string desc) = 0;
+	/**
+	 * Computes an already-declared key from others. code runs when one of the
+	 * inputs changes, not on reads, and returns the value as text, which is
+	 * converted to the key's type. Keys derived from this one follow on in
+	 * the same generation. String values may also refer to other keys as
+	 * ${name}, which makes them derived in the same way.
+	 * @throws std::invalid_argument if k is unknown, or would depend on itself
+	 */
+	virtual config &derive(const std::string &k, std::vector<std::string> inputs, std::function<std::string(const view &)> code) = 0;
+	/**
+	 * Record a new list of numbers. It is set from text as "1,2,3" or
+	 * "[1, 2, 3]", or from a JSON or TOML array, and read through
+	 * view::array<T>() on a snapshot.
+	 */
+	template<typename T>
+	config &operator()(std::string k, const std::vector<T> &def, std::string desc) {
+		return define(std::move(k), detail::array_type<T>::type_name_for(), detail::format_array(def), std::move(desc));
+	}
+
 	/** Indicates that we should also pull data from the environment, with the given prefix */
 	virtual config &from_environment(const std::string &prefix) = 0;
 	/** Provides commandline data - this will be stored in the config object */
 	virtual config &from_args(int argc, const char *argv[]) = 0;
 	/** config file */
 	virtual config &from_file(const std::string &path) = 0;
+	/**
+	 * Reads every file in a directory whose name matches a shell-style pattern
+	 * such as "*.conf", in name order, so later files override earlier ones.
+	 * Files are parsed in parallel, and reloads only parse files that have
+	 * changed since last time.
+	 */
+	virtual config &from_directory(const std::string &path, const std::string &pattern) = 0;
+	/**
+	 * Reads INI-style records from a pipe or socket on a background thread,
+	 * applying each one as soon as its line is complete, until the other end
+	 * closes it. Memory use does not grow with the stream. Streamed values are
+	 * not replayed by reload(), and the descriptor is left open for the caller
+	 * to close once this config has gone. Keys may still be declared while it
+	 * runs; records for them are ignored until they are.
+	 */
+	virtual config &from_stream(int fd) = 0;
+	/**
+	 * Keeps every key starting with prefix in an on-disk hash index at path,
+	 * rather than in memory, for key counts too large to hold resident. Pages
+	 * of the index are read on first use, with the given number of recently
+	 * used entries cached in front. Paged keys need not be declared: they hold
+	 * text, which key() converts to the type asked for, and set(), the loaders
+	 * and watchers work on them as usual. They are not part of snapshots or
+	 * the change log, and changing them does not advance the generation.
+	 * Text for a paged key that has been declared is checked against its type
+	 * as for any other key, but an undeclared one accepts any text: a key()
+	 * call that cannot convert it logs an error and returns the default.
+	 * The index is emptied and filled again from the sources, so values set()
+	 * before a restart are not kept, and it is locked for as long as this
+	 * config is alive. Call this once, during setup, before watching any
+	 * paged keys.
+	 * @throws std::system_error if the index cannot be opened, or is in use
+	 * @throws std::logic_error if this config already pages a prefix
+	 */
+	virtual config &paged(const std::string &prefix, const std::string &path, size_t cache_entries = 4096) = 0;
 	/**
 	 * When set, will throw an exception if we try to look up a value that's either not
 	 * been defined at all, or has a different default value from the one we have configured.
@@ -68,6 +156,186 @@ public:
 	virtual config &apply() = 0;
 	/** Alias for apply() */
 	virtual config &reload() = 0;
+	/**
+	 * Reloads on a background thread, so slow storage never stalls the caller.
+	 * Sources are read and parsed first, then everything is published as a single
+	 * generation. The future holds that generation, or the exception that stopped
+	 * the reload. If given, done is called on the background thread once the
+	 * reload finishes, with a null pointer on success. Reloads run in the order
+	 * they were requested.
+	 */
+	virtual std::future<uint64_t> reload_async(std::function<void(std::exception_ptr)> done = nullptr) = 0;
+	/**
+	 * When enabled, set() pushes the update onto a lock-free queue and returns
+	 * immediately. A single applier thread drains the queue in batches, keeps
+	 * only the last write to each key, and publishes each batch as one generation.
+	 * Values read through key() may lag behind set() until the batch is applied.
+	 */
+	virtual config &write_combining(bool) = 0;
+	/** Blocks until every update queued before this call has been applied */
+	virtual config &flush() = 0;
+	/** Incremented each time a change, or a batch of changes, is published */
+	virtual uint64_t generation() const = 0;
+	/**
+	 * Declares a group of keys that are read together. The group's values are
+	 * published as a single block after each change or reload, so readers never
+	 * see a mix of old and new values. Groups should be declared during setup,
+	 * before other threads start reading them.
+	 */
+	virtual config &group(const std::string &name, std::vector<std::string> keys) = 0;
+	/**
+	 * Returns a consistent view of the keys in the given group, or an empty
+	 * pointer if there is no such group. Does not lock.
+	 */
+	virtual pinned<view> group(const std::string &name) const = 0;
+	/**
+	 * Returns an immutable view of every value at the current generation.
+	 * Costs one atomic reference count increment, takes no locks, and the
+	 * values it returns stay the same however long the view is held.
+	 */
+	virtual pinned<view> snapshot() const = 0;
+	/**
+	 * Calls code(key, old, new) for each key whose value differs between two
+	 * snapshots, with values as strings and an empty string where a key has no
+	 * value. Unchanged parts of the key table are skipped, so the cost depends
+	 * on the number of changes rather than the number of keys.
+	 */
+	virtual const config &diff(const pinned<view> &from, const pinned<view> &to, std::function<void(std::string, std::string, std::string)> code) const = 0;
+	/**
+	 * Returns a handle for reading a numeric key from real-time threads without
+	 * locking, allocating, logging or throwing. Resolving the handle gives none
+	 * of those guarantees, so do it up front. For strings, take a snapshot()
+	 * and use view::key_view(): both are real-time safe too.
+	 */
+	virtual rt_key realtime(const std::string &k) const = 0;
+	/**
+	 * Returns a descriptor that becomes readable whenever the generation advances,
+	 * for use in poll/epoll loops. Read from it to reset it (8 bytes on Linux,
+	 * where it is an eventfd), then call changes_since(). Owned by this config.
+	 */
+	virtual int change_fd() const = 0;
+	/**
+	 * Calls code(key, value) with the current value of every key that changed
+	 * after the given generation, and returns the generation those values are
+	 * from, to pass in next time. Works from a snapshot, so takes no locks.
+	 */
+	virtual uint64_t changes_since(uint64_t generation, std::function<void(std::string, std::string)> code) const = 0;
+	/**
+	 * Starts recording each published change in a ring holding the given number
+	 * of entries, for read_changes(). Changes from before this call are not
+	 * recorded. Calling it again replaces the ring, and a capacity of 0 turns
+	 * recording off.
+	 */
+	virtual config &change_log(size_t capacity) = 0;
+	/**
+	 * Passes each recorded change after the cursor to code, oldest first, and
+	 * moves the cursor on to the latest generation. Does not lock, and costs
+	 * O(changes). If the cursor has fallen so far behind that some of its
+	 * changes were overwritten, or there is no change log, sets overflow and
+	 * delivers nothing: use changes_since() to catch up from there.
+	 * @returns the number of changes delivered
+	 */
+	virtual size_t read_changes(change_cursor &cursor, std::function<void(const change &)> code) const = 0;
+	/** Incremented each time a new value is published for the given key */
+	virtual uint32_t version(const std::string &k) const = 0;
+	/**
+	 * Blocks until the version of key k moves past since, or the timeout expires,
+	 * and returns the version at that point: if it still equals since, we timed
+	 * out. Sleeps in the kernel rather than polling, and changes to other keys
+	 * do not wake the caller.
+	 */
+	virtual uint32_t wait_for_change(const std::string &k, uint32_t since, std::chrono::milliseconds timeout) const = 0;
+	/**
+	 * Calls reload() from a background thread whenever the given signal (for
+	 * example SIGHUP) arrives. Signals that arrive while a reload is pending
+	 * are folded into it. Pass 0 to stop. Any handler already installed for
+	 * the signal keeps running, and is put back when we stop.
+	 */
+	virtual config &reload_on_signal(int signo) = 0;
+	/** Signal and reload counts, and signal-to-applied latency, for reload_on_signal() */
+	virtual reload_stats signal_reload_stats() const = 0;
+
+	/**
+	 * Sets k from text at the given time, on a timer thread shared by all
+	 * scheduled changes.
+	 * @returns an id for cancel_scheduled()
+	 * @throws std::invalid_argument if k is unknown or the value is not valid for it
+	 */
+	virtual uint64_t set_at(const std::string &k, const std::string &v, std::chrono::steady_clock::time_point when, const std::string &src = "scheduled") = 0;
+	/**
+	 * Sets k from text now, and puts the previous value back at the deadline,
+	 * unless something else has changed k by then.
+	 * @returns an id for cancel_scheduled(), which keeps the new value
+	 */
+	virtual uint64_t set_until(const std::string &k, const std::string &v, std::chrono::steady_clock::time_point deadline, const std::string &src = "override") = 0;
+	/**
+	 * Moves a numeric key in a straight line from its current value to the
+	 * target, one step at a time, rounding to the key's type.
+	 * @returns an id for cancel_scheduled(), which stops the ramp where it is
+	 */
+	virtual uint64_t ramp(const std::string &k, double target, std::chrono::milliseconds duration, std::chrono::milliseconds step = std::chrono::milliseconds(100)) = 0;
+	/** @returns false if the change has already happened or been cancelled */
+	virtual bool cancel_scheduled(uint64_t id) = 0;
+
+	/** set_at() for numbers */
+	template<typename T>
+	typename std::enable_if<std::is_arithmetic<T>::value, uint64_t>::type
+	set_at(const std::string &k, T v, std::chrono::steady_clock::time_point when, const std::string &src = "scheduled") {
+		return set_at(k, detail::format_element(v), when, src);
+	}
+	/** set_until() for numbers */
+	template<typename T>
+	typename std::enable_if<std::is_arithmetic<T>::value, uint64_t>::type
+	set_until(const std::string &k, T v, std::chrono::steady_clock::time_point deadline, const std::string &src = "override") {
+		return set_until(k, detail::format_element(v), deadline, src);
+	}
+	/**
+	 * Current values as seen by one tenant: its own overrides, falling back
+	 * to the global value for every other key. Returns snapshot() itself for
+	 * tenants without overrides. Takes no locks, but a tenant with overrides
+	 * gets a view built for the call. Unlike other views, it is freed on the
+	 * thread that releases it, along with any overrides only it still holds;
+	 * use key(tenant, k, default) where that matters.
+	 */
+	virtual pinned<view> tenant(const std::string &name) const = 0;
+	/**
+	 * Overrides k from text for a single tenant. Each tenant only costs the
+	 * keys it overrides. Tenant values are not seen by watchers, derived keys
+	 * or the change log, and do not advance the generation, and unlike
+	 * set() they keep no source or change time.
+	 * @throws std::invalid_argument if k is unknown or the value is not valid for it
+	 */
+	virtual void set_for(const std::string &tenant, const std::string &k, const std::string &v) = 0;
+	/** Removes one tenant override. @returns false if there was none */
+	virtual bool clear_for(const std::string &tenant, const std::string &k) = 0;
+	/** Removes every override for a tenant. @returns false if it had none */
+	virtual bool drop_tenant(const std::string &tenant) = 0;
+	/** Number of tenants with at least one override */
+	virtual size_t tenant_count() const = 0;
+
+	/** set_for() for numbers */
+	template<typename T>
+	typename std::enable_if<std::is_arithmetic<T>::value>::type
+	set_for(const std::string &tenant, const std::string &k, T v) {
+		set_for(tenant, k, detail::format_element(v));
+	}
+
+	/**
+	 * Value of k for a tenant, or the global value if it has no override.
+	 * Looks in the tenant's overrides and then the current snapshot directly,
+	 * so nothing is allocated, locked or freed.
+	 */
+	virtual std::string key(const std::string &tenant, const std::string &k, const std::string default_value) const = 0;
+	virtual float key(const std::string &tenant, const std::string &k, const float default_value) const = 0;
+	virtual uint8_t key(const std::string &tenant, const std::string &k, const uint8_t default_value) const = 0;
+	virtual uint16_t key(const std::string &tenant, const std::string &k, const uint16_t default_value) const = 0;
+	virtual uint32_t key(const std::string &tenant, const std::string &k, const uint32_t default_value) const = 0;
+	virtual uint64_t key(const std::string &tenant, const std::string &k, const uint64_t default_value) const = 0;
+	virtual int8_t key(const std::string &tenant, const std::string &k, const int8_t default_value) const = 0;
+	virtual int16_t key(const std::string &tenant, const std::string &k, const int16_t default_value) const = 0;
+	virtual int32_t key(const std::string &tenant, const std::string &k, const int32_t default_value) const = 0;
+	virtual int64_t key(const std::string &tenant, const std::string &k, const int64_t default_value) const = 0;
+
 	/** Iterates through all config values as strings */
 	virtual const config &each_as_string(std::function<void(std::string, std::string)> code) const = 0;
 
@@ -82,6 +350,24 @@ public:
 	virtual int32_t key(const std::string &k, const int32_t default_value) const = 0;
 	virtual int64_t key(const std::string &k, const int64_t default_value) const = 0;
 
+	/**
+	 * Current parsed value of a key declared with define(), or nothing if it
+	 * has no value. Takes no locks and does no parsing.
+	 */
+	virtual pinned<parsed_value> typed(const std::string &k) const = 0;
+	/**
+	 * As typed(k), but as the type it was registered with.
+	 * @throws std::bad_cast if the key holds some other type
+	 */
+	template<typename T>
+	pinned<const parsed<T>> typed(const std::string &k) const {
+		auto v = typed(k);
+		if(v && v->type() != typeid(T)) {
+			throw std::bad_cast();
+		}
+		return pinned<const parsed<T>>::adopt(static_cast<const parsed<T> *>(v.detach()));
+	}
+
 	virtual void set(const std::string &k, const std::string &v, const std::string &src = "unknown") = 0;
 	virtual void set(const std::string &k, const float v, const std::string &src = "unknown") = 0;
 	virtual void set(const std::string &k, const uint8_t v, const std::string &src = "unknown") = 0;
@@ -4,12 +4,40 @@
 
 #define BOOST_CHRONO_VERSION 2
 #include <appcon/config.h>
+#include <appcon/array.h>
+#include <appcon/change_signal.h>
+#include <appcon/disk_index.h>
+#include <appcon/fingerprint.h>
+#include <appcon/formats.h>
+#include <appcon/hamt.h>
+#include <appcon/interpolate.h>
+#include <appcon/numeric.h>
+#include <appcon/pinned.h>
+#include <appcon/stream_reader.h>
+#include <appcon/timer_wheel.h>
+#include <appcon/update_queue.h>
+#include <appcon/value_type.h>
+#include <appcon/wait.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <limits>
+#include <future>
 #include <memory>
 #include <mutex>
+#include <stdexcept>
+#include <thread>
 #include <map>
 #include <unordered_map>
+#include <unordered_set>
 #include <tuple>
+#include <boost/container/pmr/string.hpp>
+#include <boost/container/pmr/vector.hpp>
 #include <boost/program_options.hpp>
 #include <boost/program_options/variables_map.hpp>
 #include <boost/algorithm/string.hpp>
@@ -47,6 +75,72 @@ std::string to_string(const std::string &v) { return v; }
 template<> inline
 std::string to_string(const std::string v) { return v; }
 
+/** Types we can store as config values */
+using types = boost::mpl::list<
+	uint8_t, uint16_t, uint32_t, uint64_t,
+	int8_t, int16_t, int32_t, int64_t,
+	float, std::string
+>;
+using storage_type = boost::make_variant_over<types>::type;
+
+/** Renders any of our storage types as a string */
+struct string_visitor : public boost::static_visitor<std::string> {
+	template<typename T>
+	std::string operator()(const T &v) const { return to_string(v); }
+};
+
+/** Wraps the contained value in a boost::any, for passing to watchers */
+struct any_visitor_wrap : public boost::static_visitor<boost::any> {
+	template<typename T>
+	boost::any operator()(const T &v) const { return boost::any { v }; }
+};
+
+/** Encodes a value as a type tag and bit pattern for a realtime slot */
+struct rt_visitor : public boost::static_visitor<std::pair<rt_type, uint64_t>> {
+	template<typename T>
+	std::pair<rt_type, uint64_t> operator()(const T &v) const {
+		uint64_t bits = 0;
+		std::memcpy(&bits, &v, sizeof(T));
+		return std::make_pair(rt_type_of<T>::value, bits);
+	}
+	std::pair<rt_type, uint64_t> operator()(const std::string &) const {
+		return std::make_pair(rt_type::string, uint64_t { 0 });
+	}
+};
+
+/** Reads a numeric value as a double, for ramps */
+struct number_visitor : public boost::static_visitor<double> {
+	template<typename T>
+	double operator()(const T &v) const { return static_cast<double>(v); }
+	double operator()(const std::string &) const { throw std::invalid_argument("only numeric keys can be ramped"); }
+};
+
+/** Rounds a double to the contained value's type */
+struct ramp_visitor : public boost::static_visitor<storage_type> {
+	explicit ramp_visitor(double v):v_{ v } { }
+	template<typename T>
+	storage_type operator()(const T &) const {
+		auto v = std::round(v_);
+		if(v <= static_cast<double>(std::numeric_limits<T>::lowest())) {
+			return storage_type { std::numeric_limits<T>::lowest() };
+		}
+		if(v >= static_cast<double>(std::numeric_limits<T>::max())) {
+			return storage_type { std::numeric_limits<T>::max() };
+		}
+		return storage_type { static_cast<T>(v) };
+	}
+	storage_type operator()(const float &) const { return storage_type { static_cast<float>(v_) }; }
+	storage_type operator()(const std::string &) const { throw std::invalid_argument("only numeric keys can be ramped"); }
+private:
+	double v_;
+};
+
+/** Provides a default-constructed value of the contained type, wrapped in a boost::any */
+struct blank_visitor : public boost::static_visitor<boost::any> {
+	template<typename T>
+	boost::any operator()(const T &) const { return boost::any { T() }; }
+};
+
 namespace {
 
 /** Used for hashing the type info for map keys */
@@ -71,7 +165,7 @@ struct equal_ref {
 class any_visitor {
 public:
 	using type_info_ref = std::reference_wrapper<std::type_info const>;
-	using function = std::function<std::string(const std::string &, boost::any&, const std::string &)>;
+	using function = std::function<storage_type(boost::any&)>;
 	/** We store type info directly for our function lookups, so we also provide hashing and equality */
 	std::unordered_map<
 		type_info_ref,
@@ -84,88 +178,374 @@ public:
 	 * This is used to populate the type => function lookup table.
 	 */
 	template <typename T>
-	void insert_visitor(std::function<std::string(const std::string &, T&, const std::string &)> f) {
+	void insert_visitor() {
 		fs.insert(
 			std::make_pair(
 				std::ref(typeid(T)),
-				[f](const std::string &k, boost::any &x, const std::string &src) -> std::string {
-					auto v = boost::any_cast<T&>(x);
-					// std::cout << "Calling f() for " << k << " src " << src << "\n";// << type_id_with_cvr<decltype(casted)>().pretty_name() << "\n";
-					return f(k, v, src);
+				[](boost::any &x) -> storage_type {
+					return storage_type { boost::any_cast<T&>(x) };
 				}
 			)
 		);
 	}
 
 	/**
-	 * Dispatch a type to our lookup table, calling the matching function if found.
+	 * Dispatch a type to our lookup table, converting to our storage type if found.
 	 * @throws std::runtime_error if none found
 	 */
-	std::string operator()(const std::string &k, boost::any &x, const std::string &src) {
+	storage_type operator()(boost::any &x) const {
 		auto it = fs.find(x.type());
 		if (it != fs.end()) {
-			return it->second(k, x, src);
+			return it->second(x);
 		}
 		throw std::runtime_error("No type handler registered");
 	}
 };
 
 /**
- * Provides the templated operator for dispatching key/value/source information
- * to the appropriate appcon::config ->set overload.
+ * Provides the templated operator for registering each of our
+ * storage types with the any_visitor.
  */
 class handler {
 public:
 	handler(
-		any_visitor &a,
-		appcon::config *c
-	):av_(a),cfg_(c) {
+		any_visitor &a
+	):av_(a) {
 	}
 
 	template<typename T>
 	void operator()(T&) {
-		auto cfg = cfg_;
-		av_.insert_visitor<T>([cfg](const std::string &k, T &v, const std::string &src) {
-			auto s = to_string(v);
-			cfg->set(k, v, src);
-			return s;
-		});
+		av_.insert_visitor<T>();
 	}
 
 protected:
 	any_visitor &av_;
-	appcon::config *cfg_;
 };
 
 };
 
+/**
+ * What readers need for a key: its value, and the parsed value for registered
+ * types. Where and when it was set is kept apart, in config::key_meta, so the
+ * table's leaves stay small.
+ */
+using entry_type = std::tuple<
+	storage_type, // value
+	pinned<parsed_value> // parsed, for keys declared with define()
+>;
+/** Persistent table holding the current entry for each key */
+using table_type = hamt<entry_type>;
+/** Text in per-change records, allocated from the config's memory resource */
+using record_string = boost::container::pmr::string;
+
+/** Copies record text out for the interfaces that take a std::string */
+inline std::string to_string(const record_string &s) { return std::string { s.data(), s.size() }; }
+
+/** Cache line size we keep contended members apart by */
+static const size_t cache_line = 64;
+
+/**
+ * Spacer between members written by different threads, so that a write to
+ * one never evicts readers of the other. Padding rather than alignas, since
+ * C++11 new does not honour over-aligned types, and distance is all we need.
+ */
+struct cache_line_pad {
+	char bytes[cache_line];
+};
+
+/**
+ * Implements the typed appcon::view accessors for anything providing
+ * a find() that returns a storage_type pointer, or nullptr if missing.
+ */
+template<typename Derived>
+class typed_view : public appcon::view {
+public:
+	typed_view(uint64_t generation):generation_{ generation } { }
+
+	virtual uint64_t generation() const override { return generation_; }
+	virtual bool have_key(const std::string &k) const override { return self().find(k) != nullptr; }
+
+	virtual std::string key(const std::string &k, const std::string default_value) const override { return key_as<std::string>(k, default_value); }
+	virtual float key(const std::string &k, const float default_value) const override { return key_as<float>(k, default_value); }
+	virtual uint8_t key(const std::string &k, const uint8_t default_value) const override { return key_as<uint8_t>(k, default_value); }
+	virtual uint16_t key(const std::string &k, const uint16_t default_value) const override { return key_as<uint16_t>(k, default_value); }
+	virtual uint32_t key(const std::string &k, const uint32_t default_value) const override { return key_as<uint32_t>(k, default_value); }
+	virtual uint64_t key(const std::string &k, const uint64_t default_value) const override { return key_as<uint64_t>(k, default_value); }
+	virtual int8_t key(const std::string &k, const int8_t default_value) const override { return key_as<int8_t>(k, default_value); }
+	virtual int16_t key(const std::string &k, const int16_t default_value) const override { return key_as<int16_t>(k, default_value); }
+	virtual int32_t key(const std::string &k, const int32_t default_value) const override { return key_as<int32_t>(k, default_value); }
+	virtual int64_t key(const std::string &k, const int64_t default_value) const override { return key_as<int64_t>(k, default_value); }
+
+	/** Returns the value for k, or the default if it is missing or of a different type */
+	template<typename T>
+	T key_as(const std::string &k, const T default_value) const
+	{
+		auto found = self().find(k);
+		if(!found) {
+			return default_value;
+		}
+		auto v = boost::get<T>(found);
+		if(!v) {
+			ERROR << "Failed to get config value, this is probably a type mismatch: " << k;
+			return default_value;
+		}
+		return *v;
+	}
+
+	virtual boost::string_view key_view(boost::string_view k, boost::string_view default_value) const noexcept override {
+		auto found = self().find_view(k);
+		if(!found) {
+			return default_value;
+		}
+		auto v = boost::get<std::string>(found);
+		return v ? boost::string_view { *v } : default_value;
+	}
+
+private:
+	const Derived &self() const { return static_cast<const Derived &>(*this); }
+	uint64_t generation_;
+};
+
+/**
+ * A small, standalone set of values, as used for key groups.
+ */
+class values_view : public typed_view<values_view> {
+public:
+	using map_type = std::unordered_map<std::string, storage_type>;
+
+	values_view(
+		uint64_t generation,
+		map_type values
+	):typed_view<values_view>{ generation },
+	  values_(std::move(values))
+	{
+	}
+
+	const storage_type *find(const std::string &k) const {
+		auto it = values_.find(k);
+		return it == values_.end() ? nullptr : &it->second;
+	}
+
+	/** Groups are small, so a scan is fine and avoids building a std::string */
+	const storage_type *find_view(boost::string_view k) const noexcept {
+		for(const auto &it : values_) {
+			if(boost::string_view { it.first } == k) {
+				return &it.second;
+			}
+		}
+		return nullptr;
+	}
+
+private:
+	map_type values_;
+};
+
+/**
+ * A version of the full key table. Since the table is persistent, taking
+ * one of these shares every node with the live table.
+ */
+class table_view : public typed_view<table_view> {
+public:
+	table_view(
+		uint64_t generation,
+		table_type table
+	):typed_view<table_view>{ generation },
+	  table_(std::move(table))
+	{
+	}
+
+	const storage_type *find(const std::string &k) const {
+		auto e = table_.find(k);
+		return e ? &std::get<0>(*e) : nullptr;
+	}
+
+	const storage_type *find_view(boost::string_view k) const noexcept {
+		auto e = table_.find(k.data(), k.size());
+		return e ? &std::get<0>(*e) : nullptr;
+	}
+
+	virtual pinned<parsed_value> typed(const std::string &k) const override {
+		auto e = table_.find(k);
+		return e ? std::get<1>(*e) : pinned<parsed_value> { };
+	}
+
+	const table_type &table() const { return table_; }
+
+private:
+	table_type table_;
+};
+
+/**
+ * One tenant's overrides, laid over a global snapshot. Keys the tenant has
+ * not overridden fall through to the global value. These are built for each
+ * call to tenant() rather than published, so unlike other views they are
+ * freed as soon as they are released: parked on the retired list, they
+ * would pile up for as long as nothing else was written.
+ */
+class tenant_view : public typed_view<tenant_view> {
+public:
+	tenant_view(
+		pinned<view> global,
+		table_type overrides
+	):typed_view<tenant_view>{ global->generation() },
+	  global_(std::move(global)),
+	  overrides_(std::move(overrides))
+	{
+	}
+
+	const storage_type *find(const std::string &k) const {
+		auto e = overrides_.find(k);
+		return e ? &std::get<0>(*e) : global().find(k);
+	}
+
+	const storage_type *find_view(boost::string_view k) const noexcept {
+		auto e = overrides_.find(k.data(), k.size());
+		return e ? &std::get<0>(*e) : global().find_view(k);
+	}
+
+	virtual pinned<parsed_value> typed(const std::string &k) const override {
+		auto e = overrides_.find(k);
+		return e ? std::get<1>(*e) : global_->typed(k);
+	}
+
+protected:
+	virtual void dispose() const override { delete this; }
+
+private:
+	const table_view &global() const { return static_cast<const table_view &>(*global_); }
+
+	pinned<view> global_;
+	table_type overrides_;
+};
+
+/** Overrides for every tenant, published as a whole on each change */
+struct tenant_table : public retired_block {
+	explicit tenant_table(hamt<table_type> t):tenants(std::move(t)) { }
+	hamt<table_type> tenants;
+};
+
 class config : virtual public appcon::config {
 public:
-	using types = boost::mpl::list<
-		uint8_t, uint16_t, uint32_t, uint64_t,
-		int8_t, int16_t, int32_t, int64_t,
-		float, std::string
-	>;
-	using storage_type = boost::make_variant_over<types>::type;
-	using current_type = std::tuple<
-		storage_type, // value
-		std::string, // source
-		boost::chrono::high_resolution_clock::time_point // last changed
-	>;
-
-	config(
+	using current_type = entry_type;
+	/**
+	 * A value waiting to be applied: either a queued set() call, or parsed by
+	 * a loader. Copies keep the memory resource of the original.
+	 */
+	struct pending_update {
+		pending_update(
+			boost::string_view k,
+			storage_type v,
+			boost::string_view src,
+			pinned<parsed_value> p,
+			boost::container::pmr::memory_resource *memory
+		):key(k.data(), k.size(), memory),
+		  value(std::move(v)),
+		  source(src.data(), src.size(), memory),
+		  parsed(std::move(p))
+		{
+		}
+		pending_update(const pending_update &o)
+		 :key(o.key, o.key.get_allocator()),
+		  value(o.value),
+		  source(o.source, o.source.get_allocator()),
+		  parsed(o.parsed)
+		{
+		}
+		pending_update(pending_update &&) = default;
+		pending_update &operator=(const pending_update &) = default;
+		pending_update &operator=(pending_update &&) = default;
+
+		record_string key;
+		storage_type value;
+		record_string source;
+		/** Already parsed, for keys of a registered type */
+		pinned<parsed_value> parsed;
+	};
+	/** Turns text into a key's value */
+	struct converter {
+		storage_type (*convert)(boost::string_view);
+		/** Set for keys declared with define(), which are parsed by their type instead */
+		std::shared_ptr<const value_type> type;
+	};
+	/** A parsed config file, kept until its fingerprint changes */
+	struct parsed_file {
+		fingerprint id;
+		std::vector<pending_update> updates;
+		/** Targets of its include lines, as written */
+		std::vector<std::string> includes;
+	};
+
+	config():config(nullptr) { }
+
+	/**
+	 * Allocates the nodes of the key table, every snapshot's copy of it and
+	 * the tenant overrides from the given memory resource rather than the
+	 * global heap, along with the records each change leaves: pending
+	 * updates, key sources, change log entries and held changes. String
+	 * values in the table still use the global heap. Snapshots are released
+	 * on whichever thread drops them, so the resource must be thread-safe,
+	 * and it must outlive this config and every snapshot taken from it.
+	 */
+	explicit config(
+		boost::container::pmr::memory_resource *memory
 	):strict_mode_{ false },
 	  visitor_{ },
-	  handler_{ visitor_, this },
-	  options_desc_("Supported options")
+	  handler_{ visitor_ },
+	  options_desc_("Supported options"),
+	  memory_{ memory },
+	  current_{ memory },
+	  reload_stopping_{ false },
+	  combining_{ false },
+	  pending_{ memory },
+	  queued_{ 0 },
+	  applied_{ 0 },
+	  stopping_{ false },
+	  generation_{ 0 },
+	  batch_depth_{ 0 },
+	  changed_{ false },
+	  meta_{ memory },
+	  ring_{ nullptr },
+	  pending_changes_{ memory },
+	  held_changes_{ memory }
 	{
 		/* Apply our handlers for known types */
 		boost::mpl::for_each<types>(handler_);
+		/* Lists of each numeric type are built in */
+		register_type(std::make_shared<array_type<uint8_t>>());
+		register_type(std::make_shared<array_type<uint16_t>>());
+		register_type(std::make_shared<array_type<uint32_t>>());
+		register_type(std::make_shared<array_type<uint64_t>>());
+		register_type(std::make_shared<array_type<int8_t>>());
+		register_type(std::make_shared<array_type<int16_t>>());
+		register_type(std::make_shared<array_type<int32_t>>());
+		register_type(std::make_shared<array_type<int64_t>>());
+		register_type(std::make_shared<array_type<float>>());
+		snapshot_.store(pinned<view>::adopt(new table_view(0, current_)));
+		tenants_.store(pinned<tenant_table>::adopt(new tenant_table(hamt<table_type> { memory_ })));
 	}
 
 	config(const config &src) = default;
 	config(config &&src) = default;
-	virtual ~config() = default;
+	virtual ~config() {
+		/* The listener calls reload(), so it has to go before anything reload() uses */
+		reload_signal_.reset();
+		/* Likewise timers, which call update(); taken out first so callbacks stop rescheduling */
+		std::unique_ptr<timer_wheel> wheel;
+		{
+			std::lock_guard<std::mutex> guard(schedule_mutex_);
+			stopping_schedules_ = true;
+			wheel = std::move(wheel_);
+		}
+		wheel.reset();
+		streams_.clear();
+		stop_reload_executor();
+		write_combining(false);
+		/* Hand back our views and tenant tables now rather than leaving them for some other config to free */
+		snapshot_.store(pinned<view> { });
+		tenants_.store(pinned<tenant_table> { });
+		groups_.clear();
+		reclaim_views();
+	}
 
 	/** Record a new config entry */
 	virtual config &operator()( std::string k, const std::string &def, std::string desc) override { add_option(k, def, desc); return *this; }
@@ -179,12 +559,61 @@ public:
 	virtual config &operator()( std::string k, int32_t def, std::string desc) override { add_option(k, def, desc); return *this; }
 	virtual config &operator()( std::string k, int64_t def, std::string desc) override { add_option(k, def, desc); return *this; }
 
+	using appcon::config::operator();
+	virtual config &derive(const std::string &k, std::vector<std::string> inputs, std::function<std::string(const appcon::view &)> code) override {
+		converter c;
+		if(!find_converter(k, c)) {
+			throw std::invalid_argument("config key [" + k + "] must be declared before it can be derived");
+		}
+		if(inputs.empty()) {
+			throw std::invalid_argument("config key [" + k + "] needs at least one input");
+		}
+		{
+			std::lock_guard<std::mutex> guard(mutex_);
+			if(!set_derivation(k, derivation { inputs, std::move(code), false })) {
+				throw std::invalid_argument("config key [" + k + "] would depend on itself");
+			}
+			/* Computed straight away, as if its inputs had just changed */
+			touched_.insert(touched_.end(), inputs.begin(), inputs.end());
+			publish();
+		}
+		notify_held();
+		return *this;
+	}
+
+	using appcon::config::register_type;
+	virtual config &register_type(std::shared_ptr<const value_type> type) override {
+		std::lock_guard<std::mutex> guard(mutex_);
+		value_types_[type->name()] = std::move(type);
+		return *this;
+	}
+
+	virtual config &define(std::string k, const std::string &type, const std::string &def, std::string desc) override {
+		std::shared_ptr<const value_type> t;
+		{
+			std::lock_guard<std::mutex> guard(mutex_);
+			auto it = value_types_.find(type);
+			if(it == value_types_.end()) {
+				throw std::invalid_argument("config key [" + k + "]: unknown type " + type);
+			}
+			t = it->second;
+		}
+		pinned<parsed_value> parsed;
+		try {
+			parsed = t->parse(def);
+		} catch(const std::exception &ex) {
+			throw std::invalid_argument("config key [" + k + "]: bad default: " + ex.what());
+		}
+		auto text = t->format(*parsed);
+		add_option(k, text, desc, std::move(t), std::move(parsed));
+		return *this;
+	}
+
 	/** Indicates that we should also pull data from the environment, with the given prefix */
 	virtual config &from_environment(const std::string &prefix) override {
-		loaders_.push_back([this, prefix]() {
-			apply_environment(prefix);
+		add_loader([this, prefix](std::vector<pending_update> &out) {
+			parse_environment(prefix, out);
 		});
-		reload();
 		return *this;
 	}
 
@@ -194,24 +623,38 @@ public:
 		for(uint_fast16_t i = 0; i < static_cast<uint_fast16_t>(argc); ++i) {
 			copied.push_back(std::string { argv[i] });
 		}
-		loaders_.push_back([this, copied]() {
+		add_loader([this, copied](std::vector<pending_update> &out) {
 			int argc = static_cast<int>(copied.size());
 			const char *argv[argc];
 			for(uint_fast16_t i = 0; i < static_cast<uint_fast16_t>(argc); ++i) {
 				argv[i] = static_cast<const char *>(copied[i].data());
 			}
-			apply_args(argc, argv);
+			parse_args(argc, argv, out);
 		});
-		reload();
 		return *this;
 	}
 
 	/** config file */
 	virtual config &from_file(const std::string &path) override {
-		loaders_.push_back([this, path]() {
-			apply_file(path);
+		add_loader([this, path](std::vector<pending_update> &out) {
+			std::vector<std::string> chain;
+			resolve_file(path, out, chain);
+		});
+		return *this;
+	}
+
+	virtual config &from_directory(const std::string &path, const std::string &pattern) override {
+		add_loader([this, path, pattern](std::vector<pending_update> &out) {
+			parse_directory(path, pattern, out);
 		});
-		reload();
+		return *this;
+	}
+
+	virtual config &from_stream(int fd) override {
+		std::lock_guard<std::mutex> guard(reload_mutex_);
+		streams_.emplace_back(new stream_reader(fd, [this](boost::string_view k, boost::string_view v) {
+			apply_record(k, v, "stream");
+		}));
 		return *this;
 	}
 
@@ -224,8 +667,17 @@ public:
 		return *this;
 	}
 	/** Set a local override */
-	virtual bool have_key(std::string k) const override { return current_.count(k) > 0; }
-	virtual const std::string &description(const std::string &k) const override { return description_.at(k); }
+	virtual bool have_key(std::string k) const override {
+		if(auto index = paged_index(k)) {
+			std::string text;
+			return index->find(k, text);
+		}
+		return snapshot()->have_key(k);
+	}
+	virtual const std::string &description(const std::string &k) const override {
+		std::lock_guard<std::mutex> guard(mutex_);
+		return description_.at(k);
+	}
 	/** Watch a config var */
 	virtual std::shared_ptr<watcher> watch(const std::string &k, std::string, std::function<void(std::string, std::string)> code) const override { return watch_as<std::string>(k, code); }
 	virtual std::shared_ptr<watcher> watch(const std::string &k, float, std::function<void(float, float)> code) const override { return watch_as<float>(k, code); }
@@ -244,133 +696,1096 @@ public:
 	virtual config &apply() override { return *this; }
 	/** Alias for apply() */
 	virtual config &reload() override {
-		for(auto &code : loaders_) {
-			code();
-		}
+		std::lock_guard<std::mutex> guard(reload_mutex_);
+		apply_parsed(parse_sources());
 		return *this;
 	}
-	virtual const config &each_as_string(std::function<void(std::string, std::string)> code) const override {
-		for(const auto &it : current_as_string_) {
-			code(it.first, it.second);
+
+	virtual std::future<uint64_t> reload_async(std::function<void(std::exception_ptr)> done) override {
+		auto task = std::make_shared<std::packaged_task<uint64_t()>>([this, done]() -> uint64_t {
+			uint64_t gen;
+			try {
+				std::lock_guard<std::mutex> guard(reload_mutex_);
+				/* Taken as the reload publishes: by the time we return, a set() may have moved generation() on */
+				gen = apply_parsed(parse_sources());
+			} catch(...) {
+				if(done) done(std::current_exception());
+				throw;
+			}
+			if(done) done(nullptr);
+			return gen;
+		});
+		auto result = task->get_future();
+		{
+			std::lock_guard<std::mutex> guard(reload_jobs_mutex_);
+			if(!reload_thread_.joinable()) {
+				reload_thread_ = std::thread([this]() { reload_loop(); });
+			}
+			reload_jobs_.push_back([task]() { (*task)(); });
+		}
+		reload_cv_.notify_one();
+		return result;
+	}
+
+	/**
+	 * Switches set() between applying immediately and queuing for the applier thread.
+	 * Not safe to call while other threads are in set().
+	 */
+	virtual config &write_combining(bool v) override {
+		if(v == combining_.load()) {
+			return *this;
+		}
+		if(v) {
+			stopping_ = false;
+			combining_ = true;
+			applier_ = std::thread([this]() { apply_loop(); });
+		} else {
+			combining_ = false;
+			{
+				std::lock_guard<std::mutex> guard(queue_mutex_);
+				stopping_ = true;
+			}
+			queue_cv_.notify_one();
+			applier_.join();
 		}
 		return *this;
 	}
 
-	virtual std::string key(const std::string &k, const std::string default_value) const override { return key<std::string>(k, default_value); }
-	virtual float key(const std::string &k, const float default_value) const override { return key<float>(k, default_value); }
-	virtual uint8_t key(const std::string &k, const uint8_t default_value) const override { return key<uint8_t>(k, default_value); }
-	virtual uint16_t key(const std::string &k, const uint16_t default_value) const override { return key<uint16_t>(k, default_value); }
-	virtual uint32_t key(const std::string &k, const uint32_t default_value) const override { return key<uint32_t>(k, default_value); }
-	virtual uint64_t key(const std::string &k, const uint64_t default_value) const override { return key<uint64_t>(k, default_value); }
-	virtual int8_t key(const std::string &k, const int8_t default_value) const override { return key<int8_t>(k, default_value); }
-	virtual int16_t key(const std::string &k, const int16_t default_value) const override { return key<int16_t>(k, default_value); }
-	virtual int32_t key(const std::string &k, const int32_t default_value) const override { return key<int32_t>(k, default_value); }
-	virtual int64_t key(const std::string &k, const int64_t default_value) const override { return key<int64_t>(k, default_value); }
+	virtual config &flush() override {
+		if(!combining_.load(std::memory_order_acquire)) {
+			return *this;
+		}
+		/* Watchers run on the applier thread, and they should not wait on themselves */
+		if(std::this_thread::get_id() == applier_.get_id()) {
+			return *this;
+		}
+		std::unique_lock<std::mutex> lock(queue_mutex_);
+		auto target = queued_.load(std::memory_order_acquire);
+		flushed_cv_.wait(lock, [this, target]() { return applied_ >= target; });
+		return *this;
+	}
 
-	virtual void set(const std::string &k, const std::string &v, const std::string &src) override { set_as<std::string>(k, v, src); }
-	virtual void set(const std::string &k, float v, const std::string &src) override { set_as<float>(k, v, src); }
-	virtual void set(const std::string &k, uint8_t v, const std::string &src) override { set_as<uint8_t>(k, v, src); }
-	virtual void set(const std::string &k, uint16_t v, const std::string &src) override { set_as<uint16_t>(k, v, src); }
-	virtual void set(const std::string &k, uint32_t v, const std::string &src) override { set_as<uint32_t>(k, v, src); }
-	virtual void set(const std::string &k, uint64_t v, const std::string &src) override { set_as<uint64_t>(k, v, src); }
-	virtual void set(const std::string &k, int8_t v, const std::string &src) override { set_as<int8_t>(k, v, src); }
-	virtual void set(const std::string &k, int16_t v, const std::string &src) override { set_as<int16_t>(k, v, src); }
-	virtual void set(const std::string &k, int32_t v, const std::string &src) override { set_as<int32_t>(k, v, src); }
-	virtual void set(const std::string &k, int64_t v, const std::string &src) override { set_as<int64_t>(k, v, src); }
+	virtual uint64_t generation() const override { return generation_.load(std::memory_order_acquire); }
 
-	/**
-	 * Returns the current value for the given key.
-	 */
-	template<typename T>
-	T key(const std::string &k, const T default_value) const
-	{
+	virtual config &group(const std::string &name, std::vector<std::string> keys) override {
 		std::lock_guard<std::mutex> guard(mutex_);
-		if(strict_mode_ && defaults_.count(k) == 0) {
-			throw std::runtime_error("config key [" + k + "] does not exist");
+		if(groups_.count(name) > 0) {
+			ERROR << "Attempting to add config group [" << name << "] more than once";
+			return *this;
 		}
-
-		try {
-			if(defaults_.cend() == defaults_.find(k)) {
-				auto v = to_string(default_value);
-				// defaults_[k] = default_value;
-			} else if(boost::get<T>(defaults_[k]) != default_value) {
-				auto v = to_string(default_value);
-				ERROR << "Mismatched default value for config key [" << k << "], specified default was [" << v << "], current: " << current_info<T>(k);
-			}
-			if(current_.cend() == current_.find(k)) {
-				apply<T>(k, default_value, "default");
-			}
-			auto v = boost::get<T>(std::get<0>(current_[k]));
-			return v;
-		} catch(const boost::bad_get &ex) {
-			ERROR << "Failed to get config value, this is probably a type mismatch: " << k;
-			ERROR << "Returning default value for " << k << " as a last resort";
-			return default_value;
+		auto g = std::unique_ptr<key_group>(new key_group(std::move(keys)));
+		for(const auto &k : g->keys) {
+			key_groups_[k].push_back(g.get());
 		}
+		publish_group(*g, generation_.load(std::memory_order_relaxed));
+		groups_[name] = std::move(g);
+		return *this;
 	}
 
-protected:
-	template<typename T>
-	void set_as(const std::string &k, const T v, const std::string &src = "unknown")
-	{
-		boost::any prev;
-		try {
-			prev = boost::any { boost::get<T>(std::get<0>(current_[k])) };
-		} catch(const boost::bad_get &ex) {
-			/* This is fine, just means we had no previous value */
-			prev = boost::any { T() };
+	virtual pinned<view> group(const std::string &name) const override {
+		auto it = groups_.find(name);
+		if(it == groups_.end()) {
+			return pinned<view> { };
 		}
+		return it->second->current.load();
+	}
 
+	virtual pinned<view> snapshot() const override { return snapshot_.load(); }
+
+	virtual config &paged(const std::string &prefix, const std::string &path, size_t cache_entries) override {
 		{
 			std::lock_guard<std::mutex> guard(mutex_);
-			apply<T>(k, v, src);
-		}
-		if(watchers_.count(k) > 0) {
-			boost::any curr;
-			try {
-				curr = boost::any { boost::get<T>(std::get<0>(current_[k])) };
-				for(auto &code : *(watchers_[k])) {
-					TRACE << "Notifying watcher for new config value on " << k;
-					code(curr, prev);
-				}
-			} catch(const boost::bad_get &ex) {
-				ERROR << "Unable to get previous value in set: " << ex.what();
+			/* Keys under an earlier prefix would fall back to the table, with their values stranded on disk */
+			if(paging_) {
+				throw std::logic_error("paged() has already been called, for [" + paging_->prefix + "]");
 			}
+			/* Emptied first: the sources and set() rebuild it, and stale entries would outlive their source lines */
+			paging_.reset(new paging(prefix, path, cache_entries));
+			paged_.store(paging_.get(), std::memory_order_release);
 		}
+		/* Sources already added skipped these keys, so parse them again rather than reusing cached files */
+		{
+			std::lock_guard<std::mutex> guard(files_mutex_);
+			files_.clear();
+		}
+		reload();
+		return *this;
 	}
 
-	/**
-	 * Sets a new value for the given key.
-	 * We're const because we support being called when applying defaults.
-	 * (all relevant variables are mutable)
-	 */
-	template<typename T>
-	void apply(const std::string &k, const T v, const std::string &src = "unknown") const
-	{
-		current_[k] = std::make_tuple(
-			storage_type { v },
-			src,
-			boost::chrono::high_resolution_clock::now()
-		);
-		current_as_string_[k] = to_string(v);
+	virtual pinned<view> tenant(const std::string &name) const override {
+		auto global = snapshot_.load();
+		auto t = tenants_.load();
+		auto overrides = t->tenants.find(name);
+		if(!overrides) {
+			return global;
+		}
+		return pinned<view>::adopt(new tenant_view(std::move(global), *overrides));
 	}
 
-	template<typename T>
-	std::string current_info(const std::string &k) const
-	{
-		std::string src;
-		storage_type v;
-		boost::chrono::high_resolution_clock::time_point t;
-		std::tie(v, src, t) = current_.at(k);
+	using appcon::config::set_for;
+	virtual void set_for(const std::string &name, const std::string &k, const std::string &v) override {
+		storage_type value;
+		pinned<parsed_value> parsed;
+		convert_known(k, v, value, parsed);
+		std::lock_guard<std::mutex> guard(mutex_);
+		auto t = tenants_.load();
+		auto overrides = t->tenants.find(name);
+		auto updated = (overrides ? *overrides : table_type { memory_ }).set(k, std::make_tuple(std::move(value), std::move(parsed)));
+		publish_tenants(t->tenants.set(name, std::move(updated)));
+	}
 
-		std::stringstream s;
-		s << to_string(boost::get<T>(v)) << " (set by " << src << " at " << boost::chrono::time_fmt(boost::chrono::timezone::utc, "%Y-%m-%d %H:%M:%S") << t << ", default is " << to_string(boost::get<T>(defaults_[k])) << ")";
-		return s.str();
+	virtual bool clear_for(const std::string &name, const std::string &k) override {
+		std::lock_guard<std::mutex> guard(mutex_);
+		auto t = tenants_.load();
+		auto overrides = t->tenants.find(name);
+		if(!overrides || !overrides->find(k)) {
+			return false;
+		}
+		auto updated = overrides->erase(k);
+		publish_tenants(updated.empty() ? t->tenants.erase(name) : t->tenants.set(name, std::move(updated)));
+		return true;
+	}
+
+	virtual bool drop_tenant(const std::string &name) override {
+		std::lock_guard<std::mutex> guard(mutex_);
+		auto t = tenants_.load();
+		if(!t->tenants.find(name)) {
+			return false;
+		}
+		publish_tenants(t->tenants.erase(name));
+		return true;
+	}
+
+	virtual size_t tenant_count() const override { return tenants_.load()->tenants.size(); }
+
+	virtual rt_key realtime(const std::string &k) const override {
+		std::lock_guard<std::mutex> guard(mutex_);
+		return rt_key { &slot(key_id(k)) };
+	}
+
+	virtual int change_fd() const override { return signal_.fd(); }
+
+	virtual uint64_t changes_since(uint64_t generation, std::function<void(std::string, std::string)> code) const override {
+		auto s = snapshot();
+		static_cast<const table_view &>(*s).table().since(generation, [&code](const std::string &k, const entry_type &e) {
+			code(k, boost::apply_visitor(string_visitor(), std::get<0>(e)));
+		});
+		return s->generation();
+	}
+
+	virtual config &change_log(size_t capacity) override {
+		std::lock_guard<std::mutex> guard(mutex_);
+		if(capacity == 0) {
+			ring_.store(nullptr, std::memory_order_release);
+			return *this;
+		}
+		/* Readers may still be looking at an old ring, so we keep it until we go away */
+		rings_.emplace_back(new change_ring(capacity, generation_.load(std::memory_order_relaxed), memory_));
+		ring_.store(rings_.back().get(), std::memory_order_release);
+		return *this;
+	}
+
+	virtual size_t read_changes(change_cursor &cursor, std::function<void(const change &)> code) const override {
+		auto ring = ring_.load(std::memory_order_acquire);
+		if(!ring) {
+			cursor.overflow = true;
+			return 0;
+		}
+		return ring->read(cursor, generation_.load(std::memory_order_acquire), code);
+	}
+
+	virtual uint32_t version(const std::string &k) const override { return realtime(k).version(); }
+
+	virtual uint32_t wait_for_change(const std::string &k, uint32_t since, std::chrono::milliseconds timeout) const override {
+		const rt_slot *s;
+		std::atomic<uint32_t> *waiters;
+		{
+			std::lock_guard<std::mutex> guard(mutex_);
+			auto id = key_id(k);
+			s = &slot(id);
+			waiters = &slot_waiters(id);
+		}
+		auto deadline = std::chrono::steady_clock::now() + timeout;
+		/* Announce ourselves before the final check, so publish_slot() either sees us or we see its change */
+		waiters->fetch_add(1);
+		auto v = s->version.load();
+		while(v == since && std::chrono::steady_clock::now() < deadline) {
+			wait_on(s->version, since, deadline);
+			v = s->version.load();
+		}
+		waiters->fetch_sub(1);
+		return v;
+	}
+
+	virtual config &reload_on_signal(int signo) override {
+		reload_signal_.reset();
+		if(signo) {
+			reload_signal_.reset(new signal_listener(signo, [this]() { reload(); }));
+		}
+		return *this;
+	}
+
+	virtual reload_stats signal_reload_stats() const override {
+		return reload_signal_ ? reload_signal_->stats() : reload_stats { };
+	}
+
+	virtual uint64_t set_at(const std::string &k, const std::string &v, std::chrono::steady_clock::time_point when, const std::string &src) override {
+		storage_type value;
+		pinned<parsed_value> parsed;
+		convert_known(k, v, value, parsed);
+		auto id = reserve_schedule();
+		arm(id, when, [this, id, k, value, parsed, src]() {
+			if(finish_scheduled(id)) {
+				update(k, value, src, parsed);
+			}
+		});
+		return id;
+	}
+
+	virtual uint64_t set_until(const std::string &k, const std::string &v, std::chrono::steady_clock::time_point deadline, const std::string &src) override {
+		storage_type value;
+		pinned<parsed_value> parsed;
+		convert_known(k, v, value, parsed);
+		storage_type prev;
+		pinned<parsed_value> prev_parsed;
+		std::string prev_src;
+		{
+			std::lock_guard<std::mutex> guard(mutex_);
+			auto e = current_.find(k);
+			if(!e) {
+				throw std::invalid_argument("config key [" + k + "] has no value to go back to");
+			}
+			prev = std::get<0>(*e);
+			prev_src = to_string(meta_[key_id(k)].source);
+			prev_parsed = std::get<1>(*e);
+		}
+		update(k, value, src, parsed);
+		auto id = reserve_schedule();
+		arm(id, deadline, [this, id, k, value, prev, prev_src, prev_parsed]() {
+			if(!finish_scheduled(id)) {
+				return;
+			}
+			/* Only if nothing else has changed it since */
+			{
+				std::lock_guard<std::mutex> guard(mutex_);
+				auto e = current_.find(k);
+				if(!e || !(std::get<0>(*e) == value)) {
+					return;
+				}
+			}
+			update(k, prev, prev_src, prev_parsed);
+		});
+		return id;
+	}
+
+	virtual uint64_t ramp(const std::string &k, double target, std::chrono::milliseconds duration, std::chrono::milliseconds step) override {
+		storage_type from;
+		{
+			std::lock_guard<std::mutex> guard(mutex_);
+			auto e = current_.find(k);
+			if(!e) {
+				throw std::invalid_argument("config key [" + k + "] has no value to ramp from");
+			}
+			from = std::get<0>(*e);
+		}
+		if(!std::isfinite(target)) {
+			throw std::invalid_argument("ramp target for config key [" + k + "] must be finite");
+		}
+		auto start = boost::apply_visitor(number_visitor(), from);
+		/* Also checks the target can be stored */
+		boost::apply_visitor(ramp_visitor(target), from);
+		auto steps = step.count() > 0 ? duration.count() / step.count() : 0;
+		if(steps < 1) {
+			steps = 1;
+		}
+		auto id = reserve_schedule();
+		ramp_step(id, k, from, start, target, std::chrono::steady_clock::now(), duration, 1, steps);
+		return id;
+	}
+
+	virtual bool cancel_scheduled(uint64_t id) override {
+		std::lock_guard<std::mutex> guard(schedule_mutex_);
+		auto it = scheduled_.find(id);
+		if(it == scheduled_.end()) {
+			return false;
+		}
+		if(wheel_) {
+			wheel_->cancel(it->second);
+		}
+		scheduled_.erase(it);
+		return true;
+	}
+
+	virtual const config &diff(const pinned<view> &from, const pinned<view> &to, std::function<void(std::string, std::string, std::string)> code) const override {
+		auto a = dynamic_cast<const table_view *>(from.get());
+		auto b = dynamic_cast<const table_view *>(to.get());
+		if(!a || !b) {
+			throw std::invalid_argument("diff() needs two views from snapshot()");
+		}
+		table_type::diff(a->table(), b->table(), [&code](const std::string &k, const entry_type *old, const entry_type *curr) {
+			/* A set() to the same value still replaces the entry, so skip anything that compares equal */
+			if(old && curr && std::get<0>(*old) == std::get<0>(*curr)) {
+				return;
+			}
+			code(
+				k,
+				old ? boost::apply_visitor(string_visitor(), std::get<0>(*old)) : std::string { },
+				curr ? boost::apply_visitor(string_visitor(), std::get<0>(*curr)) : std::string { }
+			);
+		});
+		return *this;
+	}
+	virtual const config &each_as_string(std::function<void(std::string, std::string)> code) const override {
+		/* Built from a snapshot when asked for, rather than kept as text on every write */
+		std::vector<std::pair<std::string, std::string>> values;
+		auto s = snapshot_.load();
+		static_cast<const table_view &>(*s).table().for_each([&values](const std::string &k, const entry_type &e) {
+			values.emplace_back(k, boost::apply_visitor(string_visitor(), std::get<0>(e)));
+		});
+		std::sort(values.begin(), values.end());
+		for(const auto &it : values) {
+			code(it.first, it.second);
+		}
+		return *this;
+	}
+
+	virtual std::string key(const std::string &k, const std::string default_value) const override { return key<std::string>(k, default_value); }
+	virtual float key(const std::string &k, const float default_value) const override { return key<float>(k, default_value); }
+	virtual uint8_t key(const std::string &k, const uint8_t default_value) const override { return key<uint8_t>(k, default_value); }
+	virtual uint16_t key(const std::string &k, const uint16_t default_value) const override { return key<uint16_t>(k, default_value); }
+	virtual uint32_t key(const std::string &k, const uint32_t default_value) const override { return key<uint32_t>(k, default_value); }
+	virtual uint64_t key(const std::string &k, const uint64_t default_value) const override { return key<uint64_t>(k, default_value); }
+	virtual int8_t key(const std::string &k, const int8_t default_value) const override { return key<int8_t>(k, default_value); }
+	virtual int16_t key(const std::string &k, const int16_t default_value) const override { return key<int16_t>(k, default_value); }
+	virtual int32_t key(const std::string &k, const int32_t default_value) const override { return key<int32_t>(k, default_value); }
+	virtual int64_t key(const std::string &k, const int64_t default_value) const override { return key<int64_t>(k, default_value); }
+
+	virtual std::string key(const std::string &tenant, const std::string &k, const std::string default_value) const override { return tenant_key<std::string>(tenant, k, default_value); }
+	virtual float key(const std::string &tenant, const std::string &k, const float default_value) const override { return tenant_key<float>(tenant, k, default_value); }
+	virtual uint8_t key(const std::string &tenant, const std::string &k, const uint8_t default_value) const override { return tenant_key<uint8_t>(tenant, k, default_value); }
+	virtual uint16_t key(const std::string &tenant, const std::string &k, const uint16_t default_value) const override { return tenant_key<uint16_t>(tenant, k, default_value); }
+	virtual uint32_t key(const std::string &tenant, const std::string &k, const uint32_t default_value) const override { return tenant_key<uint32_t>(tenant, k, default_value); }
+	virtual uint64_t key(const std::string &tenant, const std::string &k, const uint64_t default_value) const override { return tenant_key<uint64_t>(tenant, k, default_value); }
+	virtual int8_t key(const std::string &tenant, const std::string &k, const int8_t default_value) const override { return tenant_key<int8_t>(tenant, k, default_value); }
+	virtual int16_t key(const std::string &tenant, const std::string &k, const int16_t default_value) const override { return tenant_key<int16_t>(tenant, k, default_value); }
+	virtual int32_t key(const std::string &tenant, const std::string &k, const int32_t default_value) const override { return tenant_key<int32_t>(tenant, k, default_value); }
+	virtual int64_t key(const std::string &tenant, const std::string &k, const int64_t default_value) const override { return tenant_key<int64_t>(tenant, k, default_value); }
+
+	using appcon::config::typed;
+	using appcon::config::set_at;
+	using appcon::config::set_until;
+	virtual pinned<parsed_value> typed(const std::string &k) const override { return snapshot_.load()->typed(k); }
+
+	virtual void set(const std::string &k, const std::string &v, const std::string &src) override { set_as<std::string>(k, v, src); }
+	virtual void set(const std::string &k, float v, const std::string &src) override { set_as<float>(k, v, src); }
+	virtual void set(const std::string &k, uint8_t v, const std::string &src) override { set_as<uint8_t>(k, v, src); }
+	virtual void set(const std::string &k, uint16_t v, const std::string &src) override { set_as<uint16_t>(k, v, src); }
+	virtual void set(const std::string &k, uint32_t v, const std::string &src) override { set_as<uint32_t>(k, v, src); }
+	virtual void set(const std::string &k, uint64_t v, const std::string &src) override { set_as<uint64_t>(k, v, src); }
+	virtual void set(const std::string &k, int8_t v, const std::string &src) override { set_as<int8_t>(k, v, src); }
+	virtual void set(const std::string &k, int16_t v, const std::string &src) override { set_as<int16_t>(k, v, src); }
+	virtual void set(const std::string &k, int32_t v, const std::string &src) override { set_as<int32_t>(k, v, src); }
+	virtual void set(const std::string &k, int64_t v, const std::string &src) override { set_as<int64_t>(k, v, src); }
+
+	/**
+	 * Returns the current value for the given key.
+	 */
+	template<typename T>
+	T key(const std::string &k, const T default_value) const
+	{
+		if(auto index = paged_index(k)) {
+			std::string text;
+			return index->find(k, text) ? paged_as<T>(k, text, default_value) : default_value;
+		}
+		std::lock_guard<std::mutex> guard(mutex_);
+		if(strict_mode_ && defaults_.count(k) == 0) {
+			throw std::runtime_error("config key [" + k + "] does not exist");
+		}
+
+		try {
+			if(defaults_.cend() == defaults_.find(k)) {
+				auto v = to_string(default_value);
+				// defaults_[k] = default_value;
+			} else if(boost::get<T>(defaults_[k]) != default_value) {
+				auto v = to_string(default_value);
+				ERROR << "Mismatched default value for config key [" << k << "], specified default was [" << v << "], current: " << current_info<T>(k);
+			}
+			if(!current_.find(k)) {
+				store(k, storage_type { default_value }, "default");
+				publish();
+			}
+			auto v = boost::get<T>(std::get<0>(*current_.find(k)));
+			return v;
+		} catch(const boost::bad_get &ex) {
+			ERROR << "Failed to get config value, this is probably a type mismatch: " << k;
+			ERROR << "Returning default value for " << k << " as a last resort";
+			return default_value;
+		}
+	}
+
+protected:
+	/** Value of k for a tenant: its override if it has one, or the global value */
+	template<typename T>
+	T tenant_key(const std::string &tenant, const std::string &k, const T default_value) const
+	{
+		{
+			auto t = tenants_.load();
+			auto overrides = t->tenants.find(tenant);
+			auto e = overrides ? overrides->find(k) : nullptr;
+			if(e) {
+				auto v = boost::get<T>(&std::get<0>(*e));
+				if(!v) {
+					ERROR << "Failed to get config value for tenant [" << tenant << "], this is probably a type mismatch: " << k;
+					return default_value;
+				}
+				return *v;
+			}
+		}
+		auto s = snapshot_.load();
+		return static_cast<const table_view &>(*s).key_as<T>(k, default_value);
+	}
+
+	template<typename T>
+	void set_as(const std::string &k, const T v, const std::string &src = "unknown")
+	{
+		storage_type value { v };
+		if(auto index = paged_index(k)) {
+			if(auto text = boost::get<std::string>(&value)) {
+				/* Checked against the declared type, if any, as the loaders do */
+				storage_type canonical;
+				pinned<parsed_value> unused;
+				convert_record(k, *text, canonical, unused);
+				value = std::move(canonical);
+			}
+			update_paged(*index, k, value);
+			return;
+		}
+		pinned<parsed_value> parsed;
+		if(auto text = boost::get<std::string>(&value)) {
+			/* Text for a registered type is parsed here, so the applier never sees bad values */
+			converter c;
+			if(find_converter(k, c) && c.type) {
+				storage_type canonical;
+				convert_record(k, *text, canonical, parsed);
+				value = std::move(canonical);
+			}
+		}
+		if(combining_.load(std::memory_order_acquire)) {
+			enqueue(k, value, src, std::move(parsed));
+		} else {
+			update(k, value, src, std::move(parsed));
+		}
+	}
+
+	/**
+	 * Applies a single change immediately, publishing it unless we are in a
+	 * batch. Inside a batch, watchers hear about it once the batch is
+	 * published, so they always see a snapshot with the new value.
+	 */
+	void update(const std::string &k, const storage_type &v, const std::string &src, pinned<parsed_value> parsed = { })
+	{
+		if(auto index = paged_index(k)) {
+			update_paged(*index, k, v);
+			return;
+		}
+		storage_type prev;
+		storage_type expanded;
+		const storage_type *value;
+		{
+			std::lock_guard<std::mutex> guard(mutex_);
+			value = &resolve(k, v, expanded);
+			prev = store(k, *value, src, std::move(parsed));
+			if(batch_depth_ > 0) {
+				held_changes_.emplace_back(k, *value, std::move(prev), memory_);
+				return;
+			}
+			publish();
+		}
+		notify(k, *value, prev);
+		notify_held();
+	}
+
+	/** The index holding k, if it is one of the keys kept on disk by paged() */
+	disk_index *paged_index(const std::string &k) const {
+		auto p = paged_.load(std::memory_order_acquire);
+		if(!p || k.size() < p->prefix.size() || k.compare(0, p->prefix.size(), p->prefix) != 0) {
+			return nullptr;
+		}
+		return &p->index;
+	}
+	bool is_paged(const std::string &k) const { return paged_index(k) != nullptr; }
+
+	/** Converts paged text to T, or gives the default if it is not a valid T */
+	template<typename T>
+	static T paged_as(const std::string &k, const std::string &text, const T default_value) {
+		try {
+			return boost::get<T>(convert_text<T>(text));
+		} catch(const std::exception &ex) {
+			ERROR << "Failed to convert config value for [" << k << "] from [" << text << "]: " << ex.what();
+			return default_value;
+		}
+	}
+
+	/**
+	 * Writes a paged key through to the index, as text, and tells watchers
+	 * as update() would. Nothing is published.
+	 */
+	void update_paged(disk_index &index, const std::string &k, const storage_type &v)
+	{
+		auto text = boost::apply_visitor(string_visitor(), v);
+		storage_type prev { std::string { } };
+		/* Outside mutex_, since a put can rewrite the whole file; the index swaps values under its own lock */
+		if(!index.put(k, text, &boost::get<std::string>(prev))) {
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> guard(mutex_);
+			if(watchers_.count(k) == 0) {
+				return;
+			}
+			if(batch_depth_ > 0) {
+				held_changes_.emplace_back(k, storage_type { std::move(text) }, std::move(prev), memory_);
+				return;
+			}
+		}
+		notify(k, storage_type { std::move(text) }, prev);
+		notify_held();
+	}
+
+	/** How a derived key is computed */
+	struct derivation {
+		std::vector<std::string> inputs;
+		std::function<std::string(const appcon::view &)> code;
+		/** Set for string values with ${} references, which a plain value replaces */
+		bool from_text;
+	};
+
+	/** Where and when a key was last set */
+	struct key_meta {
+		explicit key_meta(boost::container::pmr::memory_resource *memory):source(memory) { }
+		record_string source;
+		boost::chrono::high_resolution_clock::time_point changed;
+	};
+
+	/** A change made in a batch, or to a derived key, waiting to be passed to watchers */
+	struct held_change {
+		held_change(
+			const std::string &k,
+			storage_type v,
+			storage_type p,
+			boost::container::pmr::memory_resource *memory
+		):key(k.data(), k.size(), memory),
+		  value(std::move(v)),
+		  prev(std::move(p))
+		{
+		}
+		record_string key;
+		storage_type value;
+		storage_type prev;
+	};
+
+	static const uint32_t slot_chunk_size = 256;
+	/**
+	 * Realtime slots for a run of key ids. Waiter counts are written by
+	 * blocked threads and read only when publishing, so they live in an
+	 * array of their own rather than sharing cache lines with the values.
+	 */
+	struct slot_chunk {
+		slot_chunk() {
+			for(auto &w : waiters) {
+				w.store(0, std::memory_order_relaxed);
+			}
+		}
+		rt_slot slots[slot_chunk_size];
+		std::atomic<uint32_t> waiters[slot_chunk_size];
+	};
+
+	/**
+	 * Returns the value to store for k: a string key given text with ${}
+	 * references becomes derived from the keys it names, and is stored
+	 * expanded. Caller must hold mutex_.
+	 */
+	const storage_type &resolve(const std::string &k, const storage_type &v, storage_type &expanded) const
+	{
+		auto text = boost::get<std::string>(&v);
+		if(!text) {
+			return v;
+		}
+		if(!has_references(*text)) {
+			if(!derived_.empty()) {
+				auto it = derived_.find(k);
+				if(it != derived_.end() && it->second.from_text) {
+					drop_derivation(k);
+				}
+			}
+			return v;
+		}
+		converter c;
+		if(!find_converter(k, c) || c.type || c.convert != &convert_text<std::string>) {
+			return v;
+		}
+		auto pattern = *text;
+		derivation d {
+			references(pattern),
+			[pattern](const appcon::view &now) {
+				const auto &t = static_cast<const table_view &>(now);
+				return interpolate(pattern, [&t](const std::string &name) {
+					auto found = t.find(name);
+					return found ? boost::apply_visitor(string_visitor(), *found) : std::string { };
+				});
+			},
+			true
+		};
+		if(!set_derivation(k, d)) {
+			ERROR << "Config key [" << k << "] refers to itself, leaving [" << pattern << "] unexpanded";
+			drop_derivation(k);
+			return v;
+		}
+		expanded = evaluate(k, d);
+		return expanded;
+	}
+
+	/**
+	 * Makes k derived, replacing any earlier derivation. Caller must hold mutex_.
+	 * @returns false, changing nothing, if k would then depend on itself
+	 */
+	bool set_derivation(const std::string &k, derivation d) const
+	{
+		/* Everything that already depends on k, which k must not depend on in turn */
+		std::unordered_set<std::string> seen;
+		std::vector<std::string> pending { k };
+		while(!pending.empty()) {
+			auto c = std::move(pending.back());
+			pending.pop_back();
+			auto it = dependents_.find(c);
+			if(seen.insert(std::move(c)).second && it != dependents_.end()) {
+				pending.insert(pending.end(), it->second.begin(), it->second.end());
+			}
+		}
+		for(const auto &i : d.inputs) {
+			if(seen.count(i)) {
+				return false;
+			}
+		}
+		drop_derivation(k);
+		for(const auto &i : d.inputs) {
+			dependents_[i].push_back(k);
+		}
+		derived_[k] = std::move(d);
+		return true;
+	}
+
+	/** Makes k an ordinary key again. Caller must hold mutex_. */
+	void drop_derivation(const std::string &k) const
+	{
+		auto it = derived_.find(k);
+		if(it == derived_.end()) {
+			return;
+		}
+		for(const auto &i : it->second.inputs) {
+			auto &list = dependents_[i];
+			list.erase(std::remove(list.begin(), list.end(), k), list.end());
+			if(list.empty()) {
+				dependents_.erase(i);
+			}
+		}
+		derived_.erase(it);
+	}
+
+	/** Computes a derived value from the current table. Caller must hold mutex_. */
+	std::string evaluate(const std::string &k, const derivation &d) const
+	{
+		try {
+			table_view now { generation_.load(std::memory_order_relaxed), current_ };
+			return d.code(now);
+		} catch(const std::exception &ex) {
+			ERROR << "Failed to compute derived config key [" << k << "]: " << ex.what();
+			throw;
+		}
+	}
+
+	/**
+	 * Recomputes derived keys whose inputs changed since the last publish, in
+	 * dependency order. A key whose value comes out the same does not count
+	 * as changed, so nothing past it is recomputed. Caller must hold mutex_.
+	 */
+	void refresh_derived() const
+	{
+		if(touched_.empty()) {
+			return;
+		}
+		/* Depth-first, so each key lands after everything that depends on it */
+		std::vector<std::string> order;
+		std::unordered_set<std::string> seen;
+		std::function<void(const std::string &)> visit = [&](const std::string &k) {
+			auto it = dependents_.find(k);
+			if(it == dependents_.end()) {
+				return;
+			}
+			for(const auto &d : it->second) {
+				if(seen.insert(d).second) {
+					visit(d);
+					order.push_back(d);
+				}
+			}
+		};
+		for(const auto &k : touched_) {
+			visit(k);
+		}
+		std::unordered_set<std::string> changed(touched_.begin(), touched_.end());
+		touched_.clear();
+
+		for(auto it = order.rbegin(); it != order.rend(); ++it) {
+			const auto &k = *it;
+			auto d = derived_.find(k);
+			if(d == derived_.end() || std::none_of(
+				d->second.inputs.begin(),
+				d->second.inputs.end(),
+				[&changed](const std::string &i) { return changed.count(i) > 0; }
+			)) {
+				continue;
+			}
+			storage_type value;
+			pinned<parsed_value> parsed;
+			try {
+				auto text = evaluate(k, d->second);
+				if(!convert_record(k, text, value, parsed)) {
+					value = storage_type { text };
+				}
+			} catch(const std::exception &ex) {
+				ERROR << "Keeping previous value for derived config key [" << k << "]: " << ex.what();
+				continue;
+			}
+			auto existing = current_.find(k);
+			if(existing && std::get<0>(*existing) == value) {
+				continue;
+			}
+			auto prev = store_value(k, value, "derived", std::move(parsed));
+			held_changes_.emplace_back(k, std::move(value), std::move(prev), memory_);
+			changed.insert(k);
+		}
+	}
+
+	/** Passes held changes on to their watchers, once they have been published */
+	void notify_held() const
+	{
+		boost::container::pmr::vector<held_change> changes { memory_ };
+		{
+			std::lock_guard<std::mutex> guard(mutex_);
+			if(batch_depth_ > 0) {
+				return;
+			}
+			changes.swap(held_changes_);
+		}
+		for(const auto &c : changes) {
+			try {
+				notify(to_string(c.key), c.value, c.prev);
+			} catch(const std::exception &ex) {
+				ERROR << "Watcher for config key [" << c.key << "] failed: " << ex.what();
+			}
+		}
+	}
+
+	/**
+	 * Holds back publication until it goes out of scope, so that everything
+	 * applied in the meantime becomes visible at once. If given somewhere to
+	 * put it, records the generation current as the batch is published.
+	 */
+	class batch {
+	public:
+		batch(config &c, uint64_t *published = nullptr):cfg_(c), published_{ published } {
+			std::lock_guard<std::mutex> guard(cfg_.mutex_);
+			++cfg_.batch_depth_;
+		}
+		~batch() {
+			{
+				std::lock_guard<std::mutex> guard(cfg_.mutex_);
+				--cfg_.batch_depth_;
+				cfg_.publish();
+				if(published_) {
+					*published_ = cfg_.generation_.load(std::memory_order_relaxed);
+				}
+			}
+			cfg_.notify_held();
+		}
+	private:
+		config &cfg_;
+		uint64_t *published_;
+	};
+
+	/**
+	 * Makes everything stored so far visible as a new generation, unless a
+	 * batch is still open. Caller must hold mutex_.
+	 */
+	void publish() const
+	{
+		if(batch_depth_ > 0) {
+			return;
+		}
+		refresh_derived();
+		if(!changed_) {
+			return;
+		}
+		auto gen = generation_.load(std::memory_order_relaxed) + 1;
+		for(auto g : dirty_groups_) {
+			publish_group(*g, gen);
+		}
+		dirty_groups_.clear();
+		snapshot_.store(pinned<view>::adopt(new table_view(gen, current_)));
+		for(auto id : dirty_keys_) {
+			unpublished_[id] = false;
+			auto e = current_.find(key_names_[id]);
+			if(e) {
+				publish_slot(slot(id), slot_waiters(id), std::get<0>(*e));
+			}
+		}
+		dirty_keys_.clear();
+		auto ring = ring_.load(std::memory_order_relaxed);
+		for(auto &c : pending_changes_) {
+			if(ring) ring->append(std::move(c));
+		}
+		pending_changes_.clear();
+		changed_ = false;
+		generation_.store(gen, std::memory_order_release);
+		signal_.notify();
+		reclaim_views();
+	}
+
+	/** Writes a new value into a realtime slot. Caller must hold mutex_. */
+	static void publish_slot(rt_slot &s, const std::atomic<uint32_t> &waiters, const storage_type &v)
+	{
+		auto encoded = boost::apply_visitor(rt_visitor(), v);
+		auto type = static_cast<rt_type>(s.type.load(std::memory_order_relaxed));
+		/* Marked before the bits change, so no reader can pair the old type with them */
+		if(type != rt_type::none && type != encoded.first) {
+			s.type.store(static_cast<uint8_t>(rt_type::mixed), std::memory_order_release);
+		}
+		s.bits.store(encoded.second, std::memory_order_release);
+		if(type == rt_type::none) {
+			s.type.store(static_cast<uint8_t>(encoded.first), std::memory_order_release);
+		}
+		s.version.fetch_add(1);
+		if(waiters.load() > 0) {
+			wake_all(s.version);
+		}
+	}
+
+	/** Copies text into a record string on our memory resource */
+	record_string record_text(boost::string_view v) const { return record_string { v.data(), v.size(), memory_ }; }
+
+	/** Returns the dense id for k, assigning one if needed. Caller must hold mutex_. */
+	uint32_t key_id(const std::string &k) const
+	{
+		auto it = key_ids_.find(k);
+		if(it != key_ids_.end()) {
+			return it->second;
+		}
+		auto id = static_cast<uint32_t>(key_names_.size());
+		key_ids_.emplace(k, id);
+		key_names_.push_back(k);
+		unpublished_.push_back(false);
+		meta_.emplace_back(memory_);
+		return id;
+	}
+
+	/** Realtime slot for a key id, allocated on first use. Caller must hold mutex_. */
+	rt_slot &slot(uint32_t id) const
+	{
+		return chunk(id).slots[id % slot_chunk_size];
+	}
+
+	/** Count of threads in wait_for_change() for a key id. Caller must hold mutex_. */
+	std::atomic<uint32_t> &slot_waiters(uint32_t id) const
+	{
+		return chunk(id).waiters[id % slot_chunk_size];
+	}
+
+	/** Chunk holding a key id's slot, allocated on first use. Caller must hold mutex_. */
+	slot_chunk &chunk(uint32_t id) const
+	{
+		auto index = id / slot_chunk_size;
+		while(slot_chunks_.size() <= index) {
+			slot_chunks_.emplace_back(new slot_chunk());
+		}
+		return *slot_chunks_[index];
+	}
+
+	/**
+	 * Records a new value for k, returning the previous one. Keys derived
+	 * from k are recomputed at the next publish(). Caller must hold mutex_.
+	 */
+	storage_type store(const std::string &k, const storage_type &v, const std::string &src, pinned<parsed_value> parsed = { }) const
+	{
+		if(!dependents_.empty() && dependents_.count(k)) {
+			touched_.push_back(k);
+		}
+		return store_value(k, v, src, std::move(parsed));
+	}
+
+	/** As store(), without touching anything derived from k */
+	storage_type store_value(const std::string &k, const storage_type &v, const std::string &src, pinned<parsed_value> parsed) const
+	{
+		storage_type prev;
+		auto existing = current_.find(k);
+		if(existing) {
+			prev = std::get<0>(*existing);
+		}
+		if(ring_.load(std::memory_order_relaxed)) {
+			pending_changes_.push_back(change {
+				key_id(k),
+				record_text(k),
+				record_text(existing ? boost::apply_visitor(string_visitor(), prev) : std::string { }),
+				record_text(boost::apply_visitor(string_visitor(), v)),
+				record_text(src),
+				generation_.load(std::memory_order_relaxed) + 1
+			});
+		}
+		/* Stamped with the generation this change will be published as, for changes_since() */
+		current_ = current_.set(k, std::make_tuple(v, std::move(parsed)), generation_.load(std::memory_order_relaxed) + 1);
+		changed_ = true;
+		auto id = key_id(k);
+		meta_[id].source.assign(src.data(), src.size());
+		meta_[id].changed = boost::chrono::high_resolution_clock::now();
+		if(!unpublished_[id]) {
+			unpublished_[id] = true;
+			dirty_keys_.push_back(id);
+		}
+		auto g = key_groups_.find(k);
+		if(g != key_groups_.end()) {
+			dirty_groups_.insert(g->second.begin(), g->second.end());
+		}
+		return prev;
+	}
+
+	/** Passes the new and previous values for k to any watchers */
+	void notify(const std::string &k, const storage_type &curr, const storage_type &prev) const
+	{
+		std::vector<std::function<void(boost::any&, boost::any&)>> code;
+		{
+			std::lock_guard<std::mutex> guard(mutex_);
+			auto it = watchers_.find(k);
+			if(it == watchers_.end()) {
+				return;
+			}
+			code = *(it->second);
+		}
+		auto c = boost::apply_visitor(any_visitor_wrap(), curr);
+		/* No previous value, or one of a different type, is reported as T() */
+		auto p = prev.which() == curr.which()
+			? boost::apply_visitor(any_visitor_wrap(), prev)
+			: boost::apply_visitor(blank_visitor(), curr);
+		for(auto &f : code) {
+			TRACE << "Notifying watcher for new config value on " << k;
+			f(c, p);
+		}
+	}
+
+	/** Queues a change for the applier thread, waking it if the queue was idle */
+	void enqueue(const std::string &k, const storage_type &v, const std::string &src, pinned<parsed_value> parsed)
+	{
+		queued_.fetch_add(1, std::memory_order_acq_rel);
+		if(pending_.push(pending_update { k, v, src, std::move(parsed), memory_ })) {
+			std::lock_guard<std::mutex> guard(queue_mutex_);
+			queue_cv_.notify_one();
+		}
+	}
+
+	/** Body of the applier thread */
+	void apply_loop()
+	{
+		std::unique_lock<std::mutex> lock(queue_mutex_);
+		for(;;) {
+			queue_cv_.wait(lock, [this]() { return stopping_ || !pending_.empty(); });
+			if(stopping_ && pending_.empty()) {
+				break;
+			}
+			lock.unlock();
+			apply_queued();
+			lock.lock();
+		}
+	}
+
+	/**
+	 * Drains the update queue and applies it as one batch. Only the last write
+	 * to each key survives, and watchers see the value from before the batch
+	 * as the previous value.
+	 */
+	void apply_queued()
+	{
+		std::vector<pending_update> batch;
+		std::unordered_map<std::string, size_t> index;
+		auto count = pending_.drain([&batch, &index](pending_update &u) {
+			auto key = to_string(u.key);
+			auto it = index.find(key);
+			if(it == index.end()) {
+				index.emplace(std::move(key), batch.size());
+				batch.push_back(std::move(u));
+			} else {
+				batch[it->second] = std::move(u);
+			}
+		});
+		if(count == 0) {
+			return;
+		}
+
+		std::vector<storage_type> prev;
+		prev.reserve(batch.size());
+		{
+			std::lock_guard<std::mutex> guard(mutex_);
+			for(auto &u : batch) {
+				auto key = to_string(u.key);
+				storage_type expanded;
+				auto &value = resolve(key, u.value, expanded);
+				if(&value == &expanded) {
+					u.value = std::move(expanded);
+				}
+				prev.push_back(store(key, u.value, to_string(u.source), u.parsed));
+			}
+			publish();
+		}
+		DEBUG << "Applied " << batch.size() << " config updates from " << count << " queued";
+		for(size_t i = 0; i < batch.size(); ++i) {
+			try {
+				notify(to_string(batch[i].key), batch[i].value, prev[i]);
+			} catch(const std::exception &ex) {
+				ERROR << "Watcher for config key [" << batch[i].key << "] failed: " << ex.what();
+			}
+		}
+
+		notify_held();
+		{
+			std::lock_guard<std::mutex> guard(queue_mutex_);
+			applied_ += count;
+		}
+		flushed_cv_.notify_all();
+	}
+
+	template<typename T>
+	std::string current_info(const std::string &k) const
+	{
+		auto e = current_.find(k);
+		if(!e) {
+			throw std::out_of_range("config key [" + k + "] has no value");
+		}
+		const auto &v = std::get<0>(*e);
+		const auto &meta = meta_[key_id(k)];
+		const auto &src = meta.source;
+		const auto &t = meta.changed;
+
+		std::stringstream s;
+		s << to_string(boost::get<T>(v)) << " (set by " << src << " at " << boost::chrono::time_fmt(boost::chrono::timezone::utc, "%Y-%m-%d %H:%M:%S") << t << ", default is " << to_string(boost::get<T>(defaults_[k])) << ")";
+		return s.str();
 	}
 
 	template<typename T>
 	void
-	add_option(const std::string &k, T def, std::string desc) {
+	add_option(
+		const std::string &k,
+		T def,
+		std::string desc,
+		std::shared_ptr<const value_type> type = nullptr,
+		pinned<parsed_value> parsed = { }
+	) {
 		namespace po = boost::program_options;
 		{
 			std::lock_guard<std::mutex> guard(mutex_);
@@ -382,26 +1797,51 @@ protected:
 			defaults_[k] = def;
 		}
 
-		set(k, def, "definition");
-		options_desc_.add_options()
-			/* boost::po seems to be allergic to strings... */
-			(
-				static_cast<const char *>(k.data()),
-				po::value<T>(),
-				static_cast<const char *>(desc.data())
-			)
-		;
+		{
+			/* Loaders may be converting values on other threads while we declare keys */
+			std::lock_guard<std::mutex> guard(options_mutex_);
+			converters_[k] = converter { &convert_text<T>, std::move(type) };
+			/* program_options only splits the input up; values are converted by convert_text */
+			options_desc_.add_options()
+				/* boost::po seems to be allergic to strings... */
+				(
+					static_cast<const char *>(k.data()),
+					po::value<std::string>(),
+					static_cast<const char *>(desc.data())
+				)
+			;
+		}
+		update(k, storage_type { def }, "definition", std::move(parsed));
+	}
+
+	/** Copies out the converter for k. @returns false if k has not been declared */
+	bool find_converter(const std::string &k, converter &out) const {
+		std::lock_guard<std::mutex> guard(options_mutex_);
+		auto it = converters_.find(k);
+		if(it == converters_.end()) {
+			return false;
+		}
+		out = it->second;
+		return true;
 	}
 
-	void apply_from_vm(boost::program_options::variables_map &vm)
+	template<typename T>
+	static storage_type convert_text(boost::string_view v) { return storage_type { parse_as(v, static_cast<T *>(nullptr)) }; }
+	template<typename T>
+	static T parse_as(boost::string_view v, T *) { return parse_number<T>(v); }
+	static std::string parse_as(boost::string_view v, std::string *) { return v.to_string(); }
+
+	void parse_from_vm(boost::program_options::variables_map &vm, std::vector<pending_update> &out)
 	{
 		std::string src { "unknown" };
 		for(auto &v : vm) {
 			//std::cout << "vm entry: " << v.first << "\n";
 			if(!v.second.empty()) {
-				auto s = visitor_(v.first, v.second.value(), src);
-				DEBUG << "Applying config [" << v.first << "] = " << s;
-				current_as_string_[v.first] = s;
+				storage_type value;
+				pinned<parsed_value> parsed;
+				convert_record(v.first, v.second.as<std::string>(), value, parsed);
+				DEBUG << "Applying config [" << v.first << "] = " << boost::apply_visitor(string_visitor(), value);
+				out.emplace_back(v.first, value, src, std::move(parsed), memory_);
 			}
 		}
 	}
@@ -423,6 +1863,17 @@ protected:
 				>
 			> { });
 		}
+		if(is_paged(k)) {
+			/* Paged values are always text, with an empty string for no previous value */
+			watchers_[k]->push_back([k, code](boost::any &curr, boost::any &prev) {
+				const auto &old = boost::any_cast<std::string &>(prev);
+				code(
+					paged_as<T>(k, boost::any_cast<std::string &>(curr), T()),
+					old.empty() ? T() : paged_as<T>(k, old, T())
+				);
+			});
+			return std::make_shared<watcher>();
+		}
 		auto entry = [code](boost::any &curr, boost::any &prev) {
 			T old = boost::any_cast<T&>(prev);
 			T v = boost::any_cast<T&>(curr);
@@ -432,82 +1883,437 @@ protected:
 		return std::make_shared<watcher>();
 	}
 
-	void apply_environment(const std::string &prefix) {
+	void parse_environment(const std::string &prefix, std::vector<pending_update> &out) {
 		namespace po = boost::program_options;
 		po::variables_map vm;
-		po::store(
-			po::parse_environment(
-				options_desc_,
-				[&prefix](const std::string &in) -> std::string {
-					if(in.compare(0, prefix.size(), prefix) == 0) {
-						// Skip trailing _ as well
-						auto key = in.substr(prefix.size() + 1);
-						boost::algorithm::to_lower(key);
-						return key;
+		{
+			std::lock_guard<std::mutex> guard(options_mutex_);
+			po::store(
+				po::parse_environment(
+					options_desc_,
+					[&prefix](const std::string &in) -> std::string {
+						if(in.compare(0, prefix.size(), prefix) == 0) {
+							// Skip trailing _ as well
+							auto key = in.substr(prefix.size() + 1);
+							boost::algorithm::to_lower(key);
+							return key;
+						}
+						return "";
 					}
-					return "";
-				}
-			),
-			vm
-		);
-		apply_from_vm(vm);
-	}
-
-	void apply_args(int argc, const char *argv[]) {
-		namespace po = boost::program_options;
-		po::variables_map vm;
-		po::store(
-			po::command_line_parser(
-				argc, argv
-			).options(options_desc_)
-			 .allow_unregistered()
-			 .run(),
-			vm
-		);
-		apply_from_vm(vm);
+				),
+				vm
+			);
+		}
+		parse_from_vm(vm, out);
 	}
 
-	void apply_file(const std::string &path) {
+	void parse_args(int argc, const char *argv[], std::vector<pending_update> &out) {
 		namespace po = boost::program_options;
 		po::variables_map vm;
-		if(boost::filesystem::exists(path)) {
-			DEBUG << "Loading config from file [" << path << "]";
+		{
+			std::lock_guard<std::mutex> guard(options_mutex_);
 			po::store(
-				po::parse_config_file<char>(
-					path.data(),
-					options_desc_,
-					true // allow unregistered
-				),
+				po::command_line_parser(
+					argc, argv
+				).options(options_desc_)
+				 .allow_unregistered()
+				 .run(),
 				vm
 			);
-		} else {
+		}
+		parse_from_vm(vm, out);
+	}
+
+	/** Parses a single file, collecting its include lines rather than following them */
+	void parse_file(const std::string &path, std::vector<pending_update> &out, std::vector<std::string> &includes) {
+		auto ext = boost::algorithm::to_lower_copy(boost::filesystem::path(path).extension().string());
+		auto parser = ext == ".json" ? parse_json : ext == ".toml" ? parse_toml : parse_ini;
+		parse_document(path, parser, out, includes);
+	}
+
+	/**
+	 * Parses a file with the given format, flattening nested tables into dotted
+	 * keys. Keys we do not know are skipped, but include lines are collected.
+	 */
+	void parse_document(
+		const std::string &path,
+		void (*parser)(boost::string_view, const record_handler &),
+		std::vector<pending_update> &out,
+		std::vector<std::string> &includes
+	) {
+		DEBUG << "Loading config from file [" << path << "]";
+		std::ifstream in { path, std::ios::in | std::ios::binary };
+		if(!in) {
+			throw std::runtime_error("could not open config file " + path);
+		}
+		std::string text { std::istreambuf_iterator<char> { in }, std::istreambuf_iterator<char> { } };
+		std::string src { "unknown" };
+		/*
+		 * Array elements arrive as key.0, key.1 and so on, and are joined back
+		 * into list syntax. An empty array arrives as key[], and clears the list.
+		 */
+		std::vector<std::pair<std::string, std::string>> lists;
+		parser(text, [this, &out, &includes, &src, &lists](boost::string_view k, boost::string_view v) {
+			if(k == "include") {
+				includes.emplace_back(v.data(), v.size());
+				return;
+			}
+			std::string key { k.data(), k.size() };
+			storage_type value;
+			pinned<parsed_value> parsed;
+			if(convert_record(key, v, value, parsed)) {
+				out.emplace_back(key, std::move(value), src, std::move(parsed), memory_);
+				return;
+			}
+			if(k.ends_with("[]")) {
+				key.resize(key.size() - 2);
+				converter c;
+				if(find_converter(key, c) && c.type) {
+					lists.emplace_back(std::move(key), std::string { });
+				}
+				return;
+			}
+			auto dot = k.rfind('.');
+			if(dot == boost::string_view::npos || dot + 1 == k.size()
+			|| k.find_first_not_of("0123456789", dot + 1) != boost::string_view::npos) {
+				return;
+			}
+			key.resize(dot);
+			converter c;
+			if(!find_converter(key, c) || !c.type) {
+				return;
+			}
+			if(lists.empty() || lists.back().first != key) {
+				lists.emplace_back(std::move(key), std::string { });
+			} else {
+				lists.back().second += ',';
+			}
+			lists.back().second.append(v.data(), v.size());
+		});
+		for(auto &l : lists) {
+			storage_type value;
+			pinned<parsed_value> parsed;
+			convert_record(l.first, l.second, value, parsed);
+			out.emplace_back(l.first, std::move(value), src, std::move(parsed), memory_);
+		}
+	}
+
+	/**
+	 * Appends the values from a file to out, after those from everything it
+	 * includes, so a file can override what it pulls in. Only files whose
+	 * fingerprint has changed are parsed again.
+	 * @throws std::runtime_error if the includes form a cycle
+	 */
+	void resolve_file(const std::string &path, std::vector<pending_update> &out, std::vector<std::string> &chain) {
+		auto name = canonical_path(path);
+		if(std::find(chain.begin(), chain.end(), name) != chain.end()) {
+			std::string msg { "Config include cycle: " };
+			for(const auto &c : chain) {
+				msg += c + " -> ";
+			}
+			throw std::runtime_error(msg + name);
+		}
+		auto file = parsed_file_for(name);
+		if(!file) {
 			INFO << "File [" << path << "] not found, skipping config";
+			return;
+		}
+		chain.push_back(name);
+		auto dir = boost::filesystem::path(name).parent_path();
+		for(const auto &inc : file->includes) {
+			auto target = boost::filesystem::absolute(inc, dir);
+			if(inc.find_first_of("*?[") == std::string::npos) {
+				resolve_file(target.string(), out, chain);
+				continue;
+			}
+			for(const auto &match : matching_files(target.parent_path().string(), target.filename().string())) {
+				resolve_file(match, out, chain);
+			}
+		}
+		chain.pop_back();
+		out.insert(out.end(), file->updates.begin(), file->updates.end());
+	}
+
+	/** Returns the cached parse for a file, parsing it again if it has changed, or nothing if it is missing */
+	std::shared_ptr<const parsed_file> parsed_file_for(const std::string &name) {
+		fingerprint id;
+		if(!fingerprint_of(name, id)) {
+			return nullptr;
+		}
+		{
+			std::lock_guard<std::mutex> guard(files_mutex_);
+			auto it = files_.find(name);
+			if(it != files_.end() && it->second->id == id) {
+				return it->second;
+			}
+		}
+		auto file = std::make_shared<parsed_file>();
+		file->id = id;
+		parse_file(name, file->updates, file->includes);
+		std::lock_guard<std::mutex> guard(files_mutex_);
+		files_[name] = file;
+		return file;
+	}
+
+	static std::string canonical_path(const std::string &path) {
+		boost::system::error_code ec;
+		auto p = boost::filesystem::canonical(path, ec);
+		return ec ? boost::filesystem::absolute(path).lexically_normal().string() : p.string();
+	}
+
+	/**
+	 * Resolves the matching files in a directory on a small pool of threads,
+	 * then merges them in name order, so later names win.
+	 * @throws the first error from any of the files
+	 */
+	void parse_directory(const std::string &path, const std::string &pattern, std::vector<pending_update> &out) {
+		auto paths = matching_files(path, pattern);
+		std::vector<std::vector<pending_update>> results(paths.size());
+		std::vector<std::exception_ptr> errors(paths.size());
+		std::atomic<size_t> next { 0 };
+		auto work = [&]() {
+			for(size_t i; (i = next++) < paths.size(); ) {
+				try {
+					std::vector<std::string> chain;
+					resolve_file(paths[i], results[i], chain);
+				} catch(...) {
+					errors[i] = std::current_exception();
+				}
+			}
+		};
+		auto threads = std::min<size_t>(paths.size(), std::max(1u, std::min(4u, std::thread::hardware_concurrency())));
+		std::vector<std::thread> pool;
+		for(size_t i = 1; i < threads; ++i) {
+			pool.emplace_back(work);
+		}
+		work();
+		for(auto &t : pool) {
+			t.join();
+		}
+		for(size_t i = 0; i < paths.size(); ++i) {
+			if(errors[i]) {
+				std::rethrow_exception(errors[i]);
+			}
+			out.insert(out.end(), results[i].begin(), results[i].end());
+		}
+	}
+
+	/**
+	 * As convert_record(), for values from the API.
+	 * @throws std::invalid_argument if there is no such key
+	 */
+	void convert_known(const std::string &k, boost::string_view v, storage_type &out, pinned<parsed_value> &parsed) const {
+		if(!convert_record(k, v, out, parsed)) {
+			throw std::invalid_argument("config key [" + k + "] has not been declared");
+		}
+	}
+
+	/** Takes an id for a scheduled change, which arm() then attaches timers to */
+	uint64_t reserve_schedule() {
+		std::lock_guard<std::mutex> guard(schedule_mutex_);
+		auto id = next_schedule_++;
+		scheduled_.emplace(id, 0);
+		return id;
+	}
+
+	/** Runs code at the given time, unless id is cancelled first. Starts the timer thread if needed. */
+	void arm(uint64_t id, std::chrono::steady_clock::time_point when, std::function<void()> code) {
+		std::lock_guard<std::mutex> guard(schedule_mutex_);
+		auto it = scheduled_.find(id);
+		if(it == scheduled_.end()) {
+			return;
+		}
+		if(!wheel_) {
+			if(stopping_schedules_) {
+				return;
+			}
+			wheel_.reset(new timer_wheel());
+		}
+		it->second = wheel_->schedule(when, std::move(code));
+	}
+
+	/** Called as a one-off scheduled change fires. @returns false if it was cancelled */
+	bool finish_scheduled(uint64_t id) {
+		std::lock_guard<std::mutex> guard(schedule_mutex_);
+		return scheduled_.erase(id) > 0;
+	}
+
+	/** Applies step i of n of a ramp, and arms the next one */
+	void ramp_step(
+		uint64_t id,
+		const std::string &k,
+		const storage_type &type,
+		double from,
+		double to,
+		std::chrono::steady_clock::time_point start,
+		std::chrono::milliseconds duration,
+		int64_t i,
+		int64_t n
+	) {
+		arm(id, start + duration * i / n, [this, id, k, type, from, to, start, duration, i, n]() {
+			{
+				std::lock_guard<std::mutex> guard(schedule_mutex_);
+				if(!scheduled_.count(id)) {
+					return;
+				}
+			}
+			auto v = i == n ? to : from + (to - from) * static_cast<double>(i) / static_cast<double>(n);
+			update(k, boost::apply_visitor(ramp_visitor(v), type), "ramp");
+			if(i == n) {
+				finish_scheduled(id);
+			} else {
+				ramp_step(id, k, type, from, to, start, duration, i + 1, n);
+			}
+		});
+	}
+
+	/**
+	 * Converts a single key/value record using the option's declared type, and
+	 * applies it. Unknown keys are ignored and bad values are logged, since
+	 * there is nobody to throw to.
+	 */
+	void apply_record(boost::string_view k, boost::string_view v, const std::string &src) {
+		std::string key { k.data(), k.size() };
+		try {
+			storage_type value;
+			pinned<parsed_value> parsed;
+			if(convert_record(key, v, value, parsed)) {
+				update(key, value, src, std::move(parsed));
+			} else {
+				DEBUG << "Ignoring unknown config key [" << key << "] from " << src;
+			}
+		} catch(const std::exception &ex) {
+			ERROR << "Invalid value for config key [" << key << "] from " << src << ": " << ex.what();
+		}
+	}
+
+	/**
+	 * Converts a value from text to the key's declared type. Values of a
+	 * registered type are parsed into parsed, and out gets their canonical text.
+	 * @returns false if there is no such key
+	 * @throws std::invalid_argument if the value is not of that type
+	 * @throws std::out_of_range if the value does not fit in that type
+	 */
+	bool convert_record(const std::string &key, boost::string_view v, storage_type &out, pinned<parsed_value> &parsed) const {
+		converter c;
+		if(!find_converter(key, c)) {
+			if(is_paged(key)) {
+				/* Undeclared paged keys hold any text, which key() converts on the way out */
+				out = v.to_string();
+				return true;
+			}
+			return false;
+		}
+		try {
+			if(c.type) {
+				parsed = c.type->parse(v);
+				out = c.type->format(*parsed);
+			} else {
+				out = c.convert(v);
+			}
+		} catch(const std::out_of_range &ex) {
+			throw std::out_of_range("config key [" + key + "]: " + ex.what());
+		} catch(const std::invalid_argument &ex) {
+			throw std::invalid_argument("config key [" + key + "]: " + ex.what());
+		}
+		return true;
+	}
+
+	void add_loader(std::function<void(std::vector<pending_update> &)> code) {
+		{
+			std::lock_guard<std::mutex> guard(reload_mutex_);
+			loaders_.push_back(std::move(code));
+		}
+		reload();
+	}
+
+	/**
+	 * Reads every source, without touching the published values. Caller holds
+	 * reload_mutex_.
+	 */
+	std::vector<pending_update> parse_sources() {
+		std::vector<pending_update> parsed;
+		for(auto &code : loaders_) {
+			code(parsed);
+		}
+		return parsed;
+	}
+
+	/**
+	 * Applies the results of parse_sources() as a single generation.
+	 * @returns the generation holding the reloaded values
+	 */
+	uint64_t apply_parsed(const std::vector<pending_update> &parsed) {
+		/* Anything already queued should be applied before the reload overrides it */
+		flush();
+		uint64_t gen = 0;
+		{
+			batch guard { *this, &gen };
+			for(const auto &u : parsed) {
+				update(to_string(u.key), u.value, to_string(u.source), u.parsed);
+			}
+		}
+		return gen;
+	}
+
+	/** Runs reload_async() jobs one at a time, in the order they were requested */
+	void reload_loop() {
+		std::unique_lock<std::mutex> lock(reload_jobs_mutex_);
+		for(;;) {
+			reload_cv_.wait(lock, [this]() { return reload_stopping_ || !reload_jobs_.empty(); });
+			if(reload_jobs_.empty()) {
+				break;
+			}
+			auto job = std::move(reload_jobs_.front());
+			reload_jobs_.pop_front();
+			lock.unlock();
+			job();
+			lock.lock();
+		}
+	}
+
+	/** Finishes any outstanding reload_async() jobs and stops the executor thread */
+	void stop_reload_executor() {
+		{
+			std::lock_guard<std::mutex> guard(reload_jobs_mutex_);
+			reload_stopping_ = true;
+		}
+		reload_cv_.notify_one();
+		if(reload_thread_.joinable()) {
+			reload_thread_.join();
 		}
-		apply_from_vm(vm);
 	}
 
 private:
 	/** Strict mode means that we don't accept unknown key requests */
 	bool strict_mode_;
+	/* Every writer locks this, so keep it away from fields that readers use */
+	cache_line_pad before_mutex_;
 	/** Guard access across threads */
 	mutable std::mutex mutex_;
+	cache_line_pad after_mutex_;
 	/** Used for type iteration */
 	any_visitor visitor_;
 	/** Handler that glues type iterator to the config update call */
 	handler handler_;
+	/**
+	 * Guards options_desc_ and converters_, which loader, stream and timer
+	 * threads read while keys may still be declared. Taken after mutex_
+	 * when both are needed.
+	 */
+	mutable std::mutex options_mutex_;
 	/** Boost program_options descriptor */
 	boost::program_options::options_description options_desc_;
+	/** Text to typed value conversion for each key */
+	std::unordered_map<std::string, converter> converters_;
+	/** Types available to define(), by name */
+	std::unordered_map<std::string, std::shared_ptr<const value_type>> value_types_;
 	/** Default values for the known config entries */
 	mutable std::unordered_map<std::string, storage_type> defaults_;
-	/** Current values for keys */
-	mutable std::unordered_map<
-		std::string, // key
-		current_type
-	> current_;
-	mutable std::map<
-		std::string, // key
-		std::string
-	> current_as_string_;
+	/** Where the key table and queued updates are allocated, or nullptr for the global heap */
+	boost::container::pmr::memory_resource *memory_;
+	/** Current values for keys, guarded by mutex_ */
+	mutable table_type current_;
 	/** Key descriptions */
 	std::unordered_map<
 		std::string, // key
@@ -523,9 +2329,151 @@ private:
 			>
 		>
 	> watchers_;
+	/** Source readers, in the order they apply, guarded by reload_mutex_ */
 	std::vector<
-		std::function<void()>
+		std::function<void(std::vector<pending_update> &)>
 	> loaders_;
+	/**
+	 * Every config file we have parsed, by canonical path. Each entry's include
+	 * lines are the edges of the include graph, and an entry is only replaced
+	 * when its own fingerprint changes, so a change deep in an include chain
+	 * only parses that one file again.
+	 */
+	std::unordered_map<std::string, std::shared_ptr<const parsed_file>> files_;
+	std::mutex files_mutex_;
+	/** Serialises reloads, so two of them never interleave their updates */
+	std::mutex reload_mutex_;
+	/** Executor for reload_async() */
+	std::thread reload_thread_;
+	std::mutex reload_jobs_mutex_;
+	std::condition_variable reload_cv_;
+	std::deque<std::function<void()>> reload_jobs_;
+	bool reload_stopping_;
+
+	/** Set when set() should queue updates for the applier thread */
+	std::atomic<bool> combining_;
+	/* Producers write the queue head and count; combining_ is read by every set() */
+	cache_line_pad before_queue_;
+	/** Updates waiting for the applier thread */
+	update_queue<pending_update> pending_;
+	/** Total number of updates pushed onto pending_ */
+	std::atomic<uint64_t> queued_;
+	cache_line_pad after_queue_;
+	/** Total number of updates the applier has processed, guarded by queue_mutex_ */
+	uint64_t applied_;
+	/** Tells the applier thread to finish, guarded by queue_mutex_ */
+	bool stopping_;
+	std::mutex queue_mutex_;
+	/** Wakes the applier when the queue goes from empty to non-empty */
+	std::condition_variable queue_cv_;
+	/** Signalled after each batch, for flush() */
+	std::condition_variable flushed_cv_;
+	std::thread applier_;
+	cache_line_pad before_generation_;
+	/** Incremented each time a change or batch of changes is published */
+	mutable std::atomic<uint64_t> generation_;
+
+	/** Keys that are published together as a single block */
+	struct key_group {
+		key_group(std::vector<std::string> k):keys(std::move(k)) { }
+		std::vector<std::string> keys;
+		atomic_pinned<view> current;
+	};
+
+	/**
+	 * Publishes the current values for a group's keys.
+	 * Caller must hold mutex_.
+	 */
+	void publish_group(key_group &g, uint64_t gen) const
+	{
+		values_view::map_type values;
+		for(const auto &k : g.keys) {
+			auto e = current_.find(k);
+			if(e) {
+				values.emplace(k, std::get<0>(*e));
+			}
+		}
+		g.current.store(pinned<view>::adopt(new values_view(gen, std::move(values))));
+	}
+
+	/** Replaces the published tenant overrides. Caller must hold mutex_. */
+	void publish_tenants(hamt<table_type> tenants) {
+		tenants_.store(pinned<tenant_table>::adopt(new tenant_table(std::move(tenants))));
+		reclaim_views();
+	}
+
+	/** Number of open batches, guarded by mutex_ */
+	int batch_depth_;
+	/** Set when there are stored changes that have not been published yet, guarded by mutex_ */
+	mutable bool changed_;
+	/** Key groups by name. Only modified when declaring a group. */
+	std::unordered_map<std::string, std::unique_ptr<key_group>> groups_;
+	/** Groups each key belongs to */
+	std::unordered_map<std::string, std::vector<key_group *>> key_groups_;
+	/** Groups with changes waiting for the next publish(), guarded by mutex_ */
+	mutable std::unordered_set<key_group *> dirty_groups_;
+	/* Every reader takes a reference through snapshot_ and tenants_, which writes to them */
+	cache_line_pad before_snapshot_;
+	/** Every value as of the latest generation */
+	mutable atomic_pinned<view> snapshot_;
+	cache_line_pad after_snapshot_;
+	/** A prefix kept on disk by paged(), with its index */
+	struct paging {
+		paging(const std::string &prefix, const std::string &path, size_t cache_entries)
+			:prefix(prefix), index(path, cache_entries, true) { }
+		const std::string prefix;
+		disk_index index;
+	};
+	/** Set once by paged(), under mutex_ */
+	std::unique_ptr<paging> paging_;
+	/** paging_ for readers, published whole so they never see a prefix without its index */
+	std::atomic<paging *> paged_ { nullptr };
+	cache_line_pad before_tenants_;
+	/** Overrides by tenant, written under mutex_ */
+	atomic_pinned<tenant_table> tenants_;
+	cache_line_pad after_tenants_;
+
+	/** Dense id for each key we have seen, guarded by mutex_ */
+	mutable std::unordered_map<std::string, uint32_t> key_ids_;
+	/** Key for each id */
+	mutable std::vector<std::string> key_names_;
+	/** Set for ids with values stored but not yet written to their slots */
+	mutable std::vector<bool> unpublished_;
+	/** Where and when each key was last set, by id, kept out of the key table since reads never need it */
+	mutable boost::container::pmr::vector<key_meta> meta_;
+	/** Ids waiting for the next publish() to update their slots */
+	mutable std::vector<uint32_t> dirty_keys_;
+	/** Realtime slots by id, in chunks that never move once allocated */
+	mutable std::vector<std::unique_ptr<slot_chunk>> slot_chunks_;
+	/** Descriptor for change_fd(), poked on every publish */
+	mutable change_signal signal_;
+	/** Current change log, if any */
+	std::atomic<change_ring *> ring_;
+	/** Every change log we have had, since readers may still be using old ones */
+	std::vector<std::unique_ptr<change_ring>> rings_;
+	/** Changes waiting for the next publish() to add them to the log, guarded by mutex_ */
+	mutable boost::container::pmr::vector<change> pending_changes_;
+	/** How each derived key is computed, guarded by mutex_ */
+	mutable std::unordered_map<std::string, derivation> derived_;
+	/** Derived keys using each key, guarded by mutex_ */
+	mutable std::unordered_map<std::string, std::vector<std::string>> dependents_;
+	/** Keys with dependents that changed since the last publish(), guarded by mutex_ */
+	mutable std::vector<std::string> touched_;
+	/** Changes for notify_held(), guarded by mutex_ */
+	mutable boost::container::pmr::vector<held_change> held_changes_;
+	/** Readers for from_stream(), guarded by reload_mutex_ */
+	std::vector<std::unique_ptr<stream_reader>> streams_;
+	/** Background reloader for reload_on_signal() */
+	std::unique_ptr<signal_listener> reload_signal_;
+	/** Guards the scheduling state below */
+	std::mutex schedule_mutex_;
+	/** Thread for set_at(), set_until() and ramp(), started on first use */
+	std::unique_ptr<timer_wheel> wheel_;
+	/** Current timer for each scheduled change that has not finished */
+	std::unordered_map<uint64_t, uint64_t> scheduled_;
+	uint64_t next_schedule_ = 1;
+	/** Set once we are going away, so no new timer thread starts */
+	bool stopping_schedules_ = false;
 };
 };
 };
@@ -0,0 +1,97 @@
+/**
+ * @file
+ */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <boost/utility/string_view.hpp>
+
+namespace appcon {
+namespace detail {
+
+/**
+ * A string to string hash table in a memory-mapped file, for key counts too
+ * large to keep resident.
+ *
+ * The file holds a header, an open-addressed bucket array of (hash, offset)
+ * pairs, and an append-only area of key/value records. Nothing is read up
+ * front: the kernel pages in the buckets and records a lookup touches, and
+ * is free to drop them again under memory pressure. A small direct-mapped
+ * cache of recently used entries sits in front, so hot keys cost no page
+ * faults at all. Replacing a value appends a new record; the old one is
+ * reclaimed when the bucket array next doubles, which rewrites the file.
+ * Entries persist, so reopening the file brings them back unless it is
+ * opened with truncate set. Each file is locked while it is open, so only
+ * one index at a time can map it.
+ *
+ * All methods are thread-safe.
+ */
+class disk_index {
+public:
+	/**
+	 * Opens the index at path, creating it if needed, and emptying it first
+	 * if truncate is set.
+	 * @throws std::system_error if the file cannot be opened or mapped, or
+	 * another index has it open
+	 * @throws std::runtime_error if it exists but is not an index
+	 */
+	explicit disk_index(std::string path, size_t cache_entries = 4096, bool truncate = false);
+	disk_index(const disk_index &) = delete;
+	disk_index &operator=(const disk_index &) = delete;
+	~disk_index();
+
+	/** Copies the value for k into out. @returns false if k has no value */
+	bool find(boost::string_view k, std::string &out) const;
+	/**
+	 * Stores v for k, replacing any value it had. If prev is given, it gets
+	 * the value being replaced, or an empty string if there was none.
+	 * @returns false if k already had this value
+	 */
+	bool put(boost::string_view k, boost::string_view v, std::string *prev = nullptr);
+	/** Number of keys with a value */
+	size_t size() const;
+
+	/** Lookups answered from the cache, and from the file */
+	size_t cache_hits() const;
+	size_t cache_misses() const;
+
+private:
+	struct header;
+	struct bucket;
+	struct cached {
+		uint64_t hash = 0;
+		std::string key;
+		std::string value;
+	};
+
+	/** Lays out an empty index with the given number of buckets */
+	static void format(char *base, uint64_t buckets);
+	void map(size_t len);
+	void unmap();
+	header &head() const;
+	bucket *buckets() const;
+	/** Bucket holding k, or the empty one where it would go. Caller holds mutex_. */
+	bucket &probe(uint64_t h, boost::string_view k) const;
+	boost::string_view record_key(uint64_t offset) const;
+	boost::string_view record_value(uint64_t offset) const;
+	/** Appends a record, growing the file if needed. Caller holds mutex_. */
+	uint64_t append(boost::string_view k, boost::string_view v);
+	/** Rewrites the file with twice the buckets and only live records. Caller holds mutex_. */
+	void rebuild();
+
+	std::string path_;
+	int fd_;
+	char *base_;
+	size_t length_;
+	mutable std::mutex mutex_;
+	/** Recent entries, indexed by hash */
+	mutable std::vector<cached> cache_;
+	mutable size_t hits_;
+	mutable size_t misses_;
+};
+
+};
+};
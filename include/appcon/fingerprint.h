@@ -0,0 +1,46 @@
+/**
+ * @file
+ */
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace appcon {
+namespace detail {
+
+/**
+ * Cheap identity for a file's contents: if any of these change, the file
+ * needs parsing again. Uses stat() only, so it never reads the file. The
+ * change time is included because every write moves it, even when a tool
+ * such as rsync -t or cp -p puts the modification time back.
+ */
+struct fingerprint {
+	fingerprint():device{ 0 }, inode{ 0 }, size{ 0 }, mtime_ns{ 0 }, ctime_ns{ 0 } { }
+	uint64_t device;
+	uint64_t inode;
+	uint64_t size;
+	int64_t mtime_ns;
+	int64_t ctime_ns;
+
+	bool operator==(const fingerprint &other) const {
+		return device == other.device
+			&& inode == other.inode
+			&& size == other.size
+			&& mtime_ns == other.mtime_ns
+			&& ctime_ns == other.ctime_ns;
+	}
+	bool operator!=(const fingerprint &other) const { return !(*this == other); }
+};
+
+/** @returns false if the file cannot be found */
+bool fingerprint_of(const std::string &path, fingerprint &out);
+
+/**
+ * Lists the regular files in dir whose names match the shell-style pattern,
+ * sorted by name. A missing directory gives an empty list.
+ */
+std::vector<std::string> matching_files(const std::string &dir, const std::string &pattern);
+
+};
+};
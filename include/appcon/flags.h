@@ -0,0 +1,124 @@
+/**
+ * @file
+ */
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <boost/utility/string_view.hpp>
+#include <appcon/config.h>
+
+namespace appcon {
+
+/**
+ * Feature flags with percentage rollouts, backed by config keys.
+ *
+ * Each flag is a float key holding the percentage of contexts (users,
+ * requests, hosts) it is enabled for. Whenever one of those keys changes,
+ * the percentages are compiled into a table of thresholds, and enabled()
+ * is a few atomic loads and a hash: no locks, no key lookup.
+ * A context's bucket depends only on its hash and the flag's name, so it
+ * is the same in every process, and raising a percentage only ever
+ * enables more contexts.
+ */
+class flags {
+public:
+	/** A declared flag */
+	class flag {
+	public:
+		flag():id_{ ~uint32_t { 0 } } { }
+	private:
+		friend class flags;
+		explicit flag(uint32_t id):id_{ id } { }
+		uint32_t id_;
+	};
+
+	/** Flags are stored as keys named prefix + flag name */
+	explicit flags(std::shared_ptr<config> cfg, std::string prefix = "flags.");
+	flags(const flags &) = delete;
+	flags &operator=(const flags &) = delete;
+	~flags();
+
+	/** Declares a flag, enabled for the given percentage of contexts until the config says otherwise */
+	flag declare(const std::string &name, float percent, const std::string &desc);
+
+	/** Is the flag on for this context? Wait-free. Flags that were never declared are off. */
+	bool enabled(flag f, uint64_t context_hash) const noexcept {
+		auto t = state_->current.load(std::memory_order_acquire);
+		if(f.id_ >= t->count.load(std::memory_order_acquire)) {
+			return false;
+		}
+		const auto &d = t->entries[f.id_];
+		return (mix(context_hash ^ d.salt) >> 32) < d.threshold.load(std::memory_order_acquire);
+	}
+	/** As enabled(), hashing the context with hash() */
+	bool enabled(flag f, boost::string_view context) const noexcept { return enabled(f, hash(context)); }
+
+	/** Stable 64-bit hash for context strings, FNV-1a */
+	static uint64_t hash(boost::string_view s) noexcept {
+		uint64_t h = 0xcbf29ce484222325ull;
+		for(auto c : s) {
+			h = (h ^ static_cast<unsigned char>(c)) * 0x100000001b3ull;
+		}
+		return h;
+	}
+
+	/** Number of times the decision table has been built */
+	uint64_t builds() const;
+
+private:
+	/** What enabled() needs for one flag */
+	struct decision {
+		/** Mixed hashes with their top 32 bits below this are enabled, so 2^32 means everyone */
+		std::atomic<uint64_t> threshold;
+		/** Per-flag, so each flag splits contexts differently. Set before the entry is counted. */
+		uint64_t salt;
+	};
+	/**
+	 * Decisions for up to capacity flags. Rebuilds update thresholds in
+	 * place and declaring a flag fills in the next entry, so a new table is
+	 * only needed once this one is full.
+	 */
+	struct table {
+		explicit table(uint32_t capacity);
+		uint32_t capacity;
+		/** Entries below this are filled in */
+		std::atomic<uint32_t> count;
+		std::unique_ptr<decision[]> entries;
+	};
+	/** Shared with our watchers, which may outlive us */
+	struct state {
+		std::shared_ptr<config> cfg;
+		std::string prefix;
+		std::atomic<const flags::table *> current;
+		/** Guards everything below */
+		std::mutex mutex;
+		std::vector<std::string> names;
+		uint64_t built_generation;
+		uint64_t builds;
+		/**
+		 * Every table we have had, since readers may still be using old ones.
+		 * Each has twice the room of the one before, so together they take
+		 * less than twice the space of the current one, however many times
+		 * percentages change.
+		 */
+		std::vector<std::unique_ptr<flags::table>> tables;
+	};
+
+	/** splitmix64's finaliser */
+	static uint64_t mix(uint64_t h) noexcept {
+		h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+		h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+		return h ^ (h >> 31);
+	}
+
+	/** Compiles the current percentages into the table, unless nothing has changed. Caller holds s.mutex. */
+	static void rebuild(state &s, bool force);
+
+	std::shared_ptr<state> state_;
+};
+
+};
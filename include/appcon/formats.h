@@ -0,0 +1,64 @@
+/**
+ * @file
+ */
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <boost/utility/string_view.hpp>
+
+namespace appcon {
+namespace detail {
+
+/**
+ * Receives each scalar value in a document, keyed by the dotted path to it,
+ * so {"db": {"port": 5432}} gives ("db.port", "5432"). Array elements are
+ * keyed by their index. An empty array, which has no elements to report,
+ * gives a single record keyed by its path and "[]", so {"cpus": []} gives
+ * ("cpus[]", ""). Both views are only valid until the call returns.
+ */
+using record_handler = std::function<void(boost::string_view key, boost::string_view value)>;
+
+/**
+ * Parses an INI document: key = value lines, [section] headers that prefix
+ * the keys after them, # comments and ; comment lines.
+ * @throws std::runtime_error on malformed lines, with the line number
+ */
+void parse_ini(boost::string_view text, const record_handler &code);
+
+/**
+ * Parses a JSON document in a single pass, without building a tree.
+ * The top level must be an object. null values are skipped.
+ * @throws std::runtime_error on malformed input, with the line number
+ */
+void parse_json(boost::string_view text, const record_handler &code);
+
+/**
+ * Parses a TOML document in a single pass, without building a tree.
+ * Integers in hex, octal or binary are passed on in decimal, and dates and
+ * times are passed on as written.
+ * @throws std::runtime_error on malformed input, with the line number
+ */
+void parse_toml(boost::string_view text, const record_handler &code);
+
+/** Appends a code point to a string as UTF-8 */
+inline void append_utf8(std::string &out, uint32_t cp) {
+	if(cp < 0x80) {
+		out += static_cast<char>(cp);
+	} else if(cp < 0x800) {
+		out += static_cast<char>(0xC0 | (cp >> 6));
+		out += static_cast<char>(0x80 | (cp & 0x3F));
+	} else if(cp < 0x10000) {
+		out += static_cast<char>(0xE0 | (cp >> 12));
+		out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+		out += static_cast<char>(0x80 | (cp & 0x3F));
+	} else {
+		out += static_cast<char>(0xF0 | (cp >> 18));
+		out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+		out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+		out += static_cast<char>(0x80 | (cp & 0x3F));
+	}
+}
+
+};
+};
@@ -0,0 +1,476 @@
+/**
+ * @file
+ */
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <initializer_list>
+#include <new>
+#include <string>
+#include <utility>
+#include <boost/container/pmr/memory_resource.hpp>
+
+namespace appcon {
+namespace detail {
+
+/** FNV-1a with a final avalanche step, so every bit of the result is usable as a trie index */
+struct key_hash {
+	uint64_t operator()(const char *p, size_t len) const noexcept {
+		uint64_t h = 0xcbf29ce484222325ULL;
+		for(size_t i = 0; i < len; ++i) {
+			h ^= static_cast<unsigned char>(p[i]);
+			h *= 0x100000001b3ULL;
+		}
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdULL;
+		h ^= h >> 33;
+		h *= 0xc4ceb9fe1a85ec53ULL;
+		h ^= h >> 33;
+		return h;
+	}
+	uint64_t operator()(const std::string &k) const noexcept { return (*this)(k.data(), k.size()); }
+};
+
+/**
+ * Persistent hash array mapped trie from string keys to V.
+ *
+ * Every modification returns a new version that shares all untouched
+ * nodes with the old one, so set() costs O(log32 n) allocations and
+ * keeping old versions around costs only the nodes that differ.
+ * Nodes are reference-counted atomically, which means versions can be
+ * handed to other threads and read without locking.
+ *
+ * Nodes and leaves come from the memory resource given at construction, or
+ * the global heap if there is none. Versions derived from a trie share its
+ * resource, which must be thread-safe if they are released on several
+ * threads, and must outlive all of them.
+ */
+template<typename V, typename Hash = key_hash>
+class hamt {
+	static const unsigned bits = 5;
+	static const unsigned hash_bits = 64;
+
+	struct counted {
+		counted():refs{ 1 } { }
+		mutable std::atomic<uint32_t> refs;
+	};
+
+	/** Fields in the order a lookup reads them; the stamp is only for since() */
+	struct leaf : counted {
+		leaf(uint64_t h, std::string k, V v, uint64_t s):hash{ h }, key(std::move(k)), value(std::move(v)), stamp{ s } { }
+		uint64_t hash;
+		std::string key;
+		V value;
+		uint64_t stamp;
+	};
+
+	/**
+	 * Interior node. Slots follow the header in the same allocation, and
+	 * are tagged pointers: the low bit is set for leaves. Collision nodes
+	 * hold leaves whose full hashes are identical, in no particular order.
+	 * The stamp is the highest stamp of any leaf below this node.
+	 */
+	struct node : counted {
+		node(uint32_t b, uint32_t c, bool coll):bitmap{ b }, count{ c }, collision{ coll }, stamp{ 0 } { }
+		uint32_t bitmap;
+		uint32_t count;
+		bool collision;
+		uint64_t stamp;
+		uintptr_t *slots() noexcept { return reinterpret_cast<uintptr_t *>(this + 1); }
+		const uintptr_t *slots() const noexcept { return reinterpret_cast<const uintptr_t *>(this + 1); }
+	};
+
+public:
+	using memory_resource = boost::container::pmr::memory_resource;
+
+	hamt():root_{ 0 }, size_{ 0 }, mr_{ nullptr } { }
+	explicit hamt(memory_resource *mr):root_{ 0 }, size_{ 0 }, mr_{ mr } { }
+	hamt(const hamt &src):root_{ retain(src.root_) }, size_{ src.size_ }, mr_{ src.mr_ } { }
+	hamt(hamt &&src) noexcept:root_{ src.root_ }, size_{ src.size_ }, mr_{ src.mr_ } { src.root_ = 0; src.size_ = 0; }
+	~hamt() { release(mr_, root_); }
+
+	hamt &operator=(hamt src) noexcept {
+		std::swap(root_, src.root_);
+		std::swap(size_, src.size_);
+		std::swap(mr_, src.mr_);
+		return *this;
+	}
+
+	/** Where nodes are allocated, or nullptr for the global heap */
+	memory_resource *resource() const noexcept { return mr_; }
+
+	size_t size() const noexcept { return size_; }
+	bool empty() const noexcept { return size_ == 0; }
+
+	/** Returns the value for k, or nullptr if we don't have one */
+	const V *find(const std::string &k) const noexcept { return find(k.data(), k.size()); }
+	const V *find(const char *k, size_t len) const noexcept {
+		auto l = find_leaf(root_, Hash()(k, len), k, len, 0);
+		return l ? &l->value : nullptr;
+	}
+
+	/**
+	 * Returns a new version with k set to v. The stamp is stored alongside
+	 * the entry, for use with since().
+	 */
+	hamt set(const std::string &k, V v, uint64_t stamp = 0) const {
+		auto l = make_leaf(mr_, Hash()(k), k, std::move(v), stamp);
+		bool added = false;
+		hamt r { mr_ };
+		r.root_ = root_
+			? insert(mr_, root_, 0, l, added)
+			: seal(make_node(mr_, uint32_t { 1 } << index(l->hash, 0), 1, false, { tag(l) }));
+		r.size_ = size_ + (root_ && !added ? 0 : 1);
+		return r;
+	}
+
+	/** Returns a new version without k, or this one if k is missing */
+	hamt erase(const std::string &k) const {
+		auto h = Hash()(k);
+		if(!find_leaf(root_, h, k.data(), k.size(), 0)) {
+			return *this;
+		}
+		hamt r { mr_ };
+		r.root_ = remove(mr_, root_, h, k, 0);
+		r.size_ = size_ - 1;
+		return r;
+	}
+
+	/** Calls code(key, value) for every entry */
+	template<typename F>
+	void for_each(F code) const { visit(root_, [&code](const leaf *l) { code(l->key, l->value); }); }
+
+	/**
+	 * Calls code(key, old, current) for every key whose entry differs between
+	 * two versions, with nullptr for a side that has no such key. Subtrees
+	 * shared between the versions are skipped without being visited, so the
+	 * cost is proportional to the number of changes rather than the size.
+	 */
+	template<typename F>
+	static void diff(const hamt &from, const hamt &to, F code) { diff_slot(from.root_, to.root_, 0, code); }
+
+	/**
+	 * Calls code(key, value) for every entry set with a stamp greater than
+	 * the one given. Subtrees with nothing newer are skipped, so this costs
+	 * O(changes * log n) rather than a scan of every entry.
+	 */
+	template<typename F>
+	void since(uint64_t stamp, F code) const { since_slot(root_, stamp, code); }
+
+private:
+	static bool is_leaf(uintptr_t s) noexcept { return (s & 1) != 0; }
+	static leaf *as_leaf(uintptr_t s) noexcept { return reinterpret_cast<leaf *>(s & ~uintptr_t { 1 }); }
+	static node *as_node(uintptr_t s) noexcept { return reinterpret_cast<node *>(s); }
+	static uintptr_t tag(leaf *l) noexcept { return reinterpret_cast<uintptr_t>(l) | 1; }
+	static uintptr_t tag(node *n) noexcept { return reinterpret_cast<uintptr_t>(n); }
+	static const counted *as_counted(uintptr_t s) noexcept {
+		return is_leaf(s) ? static_cast<const counted *>(as_leaf(s)) : static_cast<const counted *>(as_node(s));
+	}
+
+	static unsigned index(uint64_t h, unsigned shift) noexcept { return static_cast<unsigned>(h >> shift) & ((1u << bits) - 1); }
+	static unsigned popcount(uint32_t v) noexcept {
+#if defined(__GNUC__)
+		return static_cast<unsigned>(__builtin_popcount(v));
+#else
+		v = v - ((v >> 1) & 0x55555555u);
+		v = (v & 0x33333333u) + ((v >> 2) & 0x33333333u);
+		return (((v + (v >> 4)) & 0x0f0f0f0fu) * 0x01010101u) >> 24;
+#endif
+	}
+
+	static uintptr_t retain(uintptr_t s) noexcept {
+		if(s) as_counted(s)->refs.fetch_add(1, std::memory_order_relaxed);
+		return s;
+	}
+
+	static void *allocate(memory_resource *mr, size_t size, size_t align) {
+		return mr ? mr->allocate(size, align) : ::operator new(size);
+	}
+
+	static void deallocate(memory_resource *mr, void *p, size_t size, size_t align) noexcept {
+		if(mr) {
+			mr->deallocate(p, size, align);
+		} else {
+			::operator delete(p);
+		}
+	}
+
+	static void release(memory_resource *mr, uintptr_t s) noexcept {
+		if(!s || as_counted(s)->refs.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+			return;
+		}
+		if(is_leaf(s)) {
+			auto l = as_leaf(s);
+			l->~leaf();
+			deallocate(mr, l, sizeof(leaf), alignof(leaf));
+			return;
+		}
+		auto n = as_node(s);
+		auto size = sizeof(node) + n->count * sizeof(uintptr_t);
+		for(uint32_t i = 0; i < n->count; ++i) {
+			release(mr, n->slots()[i]);
+		}
+		n->~node();
+		deallocate(mr, n, size, alignof(node));
+	}
+
+	static leaf *make_leaf(memory_resource *mr, uint64_t h, const std::string &k, V v, uint64_t stamp) {
+		auto mem = allocate(mr, sizeof(leaf), alignof(leaf));
+		try {
+			return new (mem) leaf(h, k, std::move(v), stamp);
+		} catch(...) {
+			deallocate(mr, mem, sizeof(leaf), alignof(leaf));
+			throw;
+		}
+	}
+
+	/** Allocates a node with room for count slots, filling them from init if given */
+	static node *make_node(memory_resource *mr, uint32_t bitmap, uint32_t count, bool collision, std::initializer_list<uintptr_t> init = { }) {
+		auto mem = allocate(mr, sizeof(node) + count * sizeof(uintptr_t), alignof(node));
+		auto n = new (mem) node(bitmap, count, collision);
+		uint32_t i = 0;
+		for(auto s : init) {
+			n->slots()[i++] = s;
+		}
+		return n;
+	}
+
+	static uint64_t stamp_of(uintptr_t s) noexcept {
+		return is_leaf(s) ? as_leaf(s)->stamp : as_node(s)->stamp;
+	}
+
+	/** Records the highest stamp below a freshly built node, once its slots are filled */
+	static uintptr_t seal(node *n) noexcept {
+		uint64_t stamp = 0;
+		for(uint32_t i = 0; i < n->count; ++i) {
+			auto s = stamp_of(n->slots()[i]);
+			if(s > stamp) stamp = s;
+		}
+		n->stamp = stamp;
+		return tag(n);
+	}
+
+	/** Copies n, retaining every child apart from the one at skip, which the caller replaces */
+	static node *copy_node(memory_resource *mr, const node *n, uint32_t skip) {
+		auto c = make_node(mr, n->bitmap, n->count, n->collision);
+		for(uint32_t i = 0; i < n->count; ++i) {
+			c->slots()[i] = i == skip ? 0 : retain(n->slots()[i]);
+		}
+		return c;
+	}
+
+	static const leaf *find_leaf(uintptr_t s, uint64_t h, const char *k, size_t len, unsigned shift) noexcept {
+		while(s) {
+			if(is_leaf(s)) {
+				auto l = as_leaf(s);
+				return l->hash == h && l->key.size() == len && l->key.compare(0, len, k, len) == 0 ? l : nullptr;
+			}
+			auto n = as_node(s);
+			if(n->collision) {
+				for(uint32_t i = 0; i < n->count; ++i) {
+					auto l = find_leaf(n->slots()[i], h, k, len, shift);
+					if(l) return l;
+				}
+				return nullptr;
+			}
+			auto bit = uint32_t { 1 } << index(h, shift);
+			if(!(n->bitmap & bit)) {
+				return nullptr;
+			}
+			s = n->slots()[popcount(n->bitmap & (bit - 1))];
+			shift += bits;
+		}
+		return nullptr;
+	}
+
+	/** Builds the smallest subtree holding two leaves with different keys */
+	static uintptr_t merge(memory_resource *mr, leaf *a, leaf *b, unsigned shift) {
+		if(shift >= hash_bits) {
+			return seal(make_node(mr, 0, 2, true, { tag(a), tag(b) }));
+		}
+		auto ia = index(a->hash, shift);
+		auto ib = index(b->hash, shift);
+		if(ia == ib) {
+			auto child = merge(mr, a, b, shift + bits);
+			return seal(make_node(mr, uint32_t { 1 } << ia, 1, false, { child }));
+		}
+		auto bitmap = (uint32_t { 1 } << ia) | (uint32_t { 1 } << ib);
+		return ia < ib
+			? seal(make_node(mr, bitmap, 2, false, { tag(a), tag(b) }))
+			: seal(make_node(mr, bitmap, 2, false, { tag(b), tag(a) }));
+	}
+
+	/**
+	 * Returns a copy of the subtree at s with l inserted, taking over the
+	 * caller's reference to l. The original subtree is left untouched.
+	 */
+	static uintptr_t insert(memory_resource *mr, uintptr_t s, unsigned shift, leaf *l, bool &added) {
+		auto n = as_node(s);
+		if(n->collision) {
+			for(uint32_t i = 0; i < n->count; ++i) {
+				if(as_leaf(n->slots()[i])->key == l->key) {
+					auto c = copy_node(mr, n, i);
+					c->slots()[i] = tag(l);
+					return seal(c);
+				}
+			}
+			added = true;
+			auto c = make_node(mr, 0, n->count + 1, true);
+			for(uint32_t i = 0; i < n->count; ++i) {
+				c->slots()[i] = retain(n->slots()[i]);
+			}
+			c->slots()[n->count] = tag(l);
+			return seal(c);
+		}
+
+		auto bit = uint32_t { 1 } << index(l->hash, shift);
+		auto pos = popcount(n->bitmap & (bit - 1));
+		if(!(n->bitmap & bit)) {
+			added = true;
+			auto c = make_node(mr, n->bitmap | bit, n->count + 1, false);
+			for(uint32_t i = 0, j = 0; i < c->count; ++i) {
+				c->slots()[i] = i == pos ? tag(l) : retain(n->slots()[j++]);
+			}
+			return seal(c);
+		}
+
+		auto child = n->slots()[pos];
+		uintptr_t replacement;
+		if(is_leaf(child)) {
+			auto existing = as_leaf(child);
+			if(existing->hash == l->hash && existing->key == l->key) {
+				replacement = tag(l);
+			} else {
+				added = true;
+				replacement = merge(mr, as_leaf(retain(child)), l, shift + bits);
+			}
+		} else {
+			replacement = insert(mr, child, shift + bits, l, added);
+		}
+		auto c = copy_node(mr, n, pos);
+		c->slots()[pos] = replacement;
+		return seal(c);
+	}
+
+	/**
+	 * Returns a copy of the node at s without k, which must be somewhere below
+	 * it, or 0 if that leaves it empty. Below the root, a node left holding a
+	 * single leaf is replaced by that leaf.
+	 */
+	static uintptr_t remove(memory_resource *mr, uintptr_t s, uint64_t h, const std::string &k, unsigned shift) {
+		auto n = as_node(s);
+		uint32_t pos = 0;
+		uintptr_t replacement = 0;
+		auto bitmap = n->bitmap;
+		if(n->collision) {
+			while(as_leaf(n->slots()[pos])->key != k) {
+				++pos;
+			}
+		} else {
+			auto bit = uint32_t { 1 } << index(h, shift);
+			pos = popcount(n->bitmap & (bit - 1));
+			auto child = n->slots()[pos];
+			if(!is_leaf(child)) {
+				replacement = remove(mr, child, h, k, shift + bits);
+			}
+			if(!replacement) {
+				bitmap &= ~bit;
+			}
+		}
+		if(replacement) {
+			auto c = copy_node(mr, n, pos);
+			c->slots()[pos] = replacement;
+			return seal(c);
+		}
+		if(n->count == 1) {
+			return 0;
+		}
+		if(shift > 0 && n->count == 2 && is_leaf(n->slots()[1 - pos])) {
+			return retain(n->slots()[1 - pos]);
+		}
+		auto c = make_node(mr, bitmap, n->count - 1, n->collision);
+		for(uint32_t i = 0, j = 0; i < n->count; ++i) {
+			if(i != pos) {
+				c->slots()[j++] = retain(n->slots()[i]);
+			}
+		}
+		return seal(c);
+	}
+
+	template<typename F>
+	static void visit(uintptr_t s, F &&code) {
+		if(!s) return;
+		if(is_leaf(s)) {
+			code(as_leaf(s));
+			return;
+		}
+		auto n = as_node(s);
+		for(uint32_t i = 0; i < n->count; ++i) {
+			visit(n->slots()[i], code);
+		}
+	}
+
+	template<typename F>
+	static void since_slot(uintptr_t s, uint64_t stamp, F &code) {
+		if(!s || stamp_of(s) <= stamp) {
+			return;
+		}
+		if(is_leaf(s)) {
+			auto l = as_leaf(s);
+			code(l->key, l->value);
+			return;
+		}
+		auto n = as_node(s);
+		for(uint32_t i = 0; i < n->count; ++i) {
+			since_slot(n->slots()[i], stamp, code);
+		}
+	}
+
+	template<typename F>
+	static void diff_slot(uintptr_t a, uintptr_t b, unsigned shift, F &code) {
+		if(a == b) {
+			return;
+		}
+		if(!a) {
+			visit(b, [&code](const leaf *l) { code(l->key, static_cast<const V *>(nullptr), &l->value); });
+			return;
+		}
+		if(!b) {
+			visit(a, [&code](const leaf *l) { code(l->key, &l->value, static_cast<const V *>(nullptr)); });
+			return;
+		}
+		if(!is_leaf(a) && !is_leaf(b) && !as_node(a)->collision && !as_node(b)->collision) {
+			auto na = as_node(a);
+			auto nb = as_node(b);
+			auto all = na->bitmap | nb->bitmap;
+			while(all) {
+				auto bit = all & (~all + 1);
+				all &= ~bit;
+				auto sa = (na->bitmap & bit) ? na->slots()[popcount(na->bitmap & (bit - 1))] : 0;
+				auto sb = (nb->bitmap & bit) ? nb->slots()[popcount(nb->bitmap & (bit - 1))] : 0;
+				diff_slot(sa, sb, shift + bits, code);
+			}
+			return;
+		}
+		/* Shapes differ (a leaf was split into a subtree, or we hit a collision node), so compare by lookup */
+		visit(a, [&](const leaf *l) {
+			auto other = find_leaf(b, l->hash, l->key.data(), l->key.size(), shift);
+			if(other != l) {
+				code(l->key, &l->value, other ? &other->value : static_cast<const V *>(nullptr));
+			}
+		});
+		visit(b, [&](const leaf *l) {
+			if(!find_leaf(a, l->hash, l->key.data(), l->key.size(), shift)) {
+				code(l->key, static_cast<const V *>(nullptr), &l->value);
+			}
+		});
+	}
+
+	uintptr_t root_;
+	size_t size_;
+	memory_resource *mr_;
+};
+
+};
+};
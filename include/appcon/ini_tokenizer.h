@@ -0,0 +1,166 @@
+/**
+ * @file
+ */
+#pragma once
+#include <string>
+#include <boost/utility/string_view.hpp>
+#include <appcon/scan.h>
+
+namespace appcon {
+namespace detail {
+
+/**
+ * Splits INI-style text into key/value records as it arrives, in chunks of
+ * any size. Understands [section] headers, which prefix the keys that follow
+ * with "section.", # comments anywhere on a line, and ; comment lines.
+ * Memory use is bounded: lines longer than the limit are dropped and counted
+ * rather than buffered. Newlines, '=' and '#' are found with the fastest
+ * vector instructions the CPU has, unless another scanner is given.
+ */
+class ini_tokenizer {
+public:
+	explicit ini_tokenizer(size_t max_line = 4096, line_scanner scan = best_line_scanner())
+	 :max_line_{ max_line },
+	  scan_{ scan },
+	  overflow_{ false },
+	  lines_{ 0 },
+	  skipped_{ 0 },
+	  first_skipped_{ 0 }
+	{
+	}
+
+	/**
+	 * Calls code(key, value) for each complete line in the chunk. The views
+	 * are only valid until code returns.
+	 */
+	template<typename F>
+	void feed(const char *data, size_t len, F code) {
+		auto end = data + len;
+		while(data < end) {
+			auto m = scan_(data, end);
+			if(m.eol == end) {
+				append(data, static_cast<size_t>(end - data));
+				return;
+			}
+			if(buf_.empty() && !overflow_) {
+				/* The whole line is in this chunk, so there is no need to copy it */
+				++lines_;
+				if(static_cast<size_t>(m.eol - data) > max_line_) {
+					skip();
+				} else {
+					line(data, m, code);
+				}
+			} else {
+				append(data, static_cast<size_t>(m.eol - data));
+				buffered_line(code);
+			}
+			data = m.eol + 1;
+		}
+	}
+
+	/** Handles a final line with no newline, at the end of the input */
+	template<typename F>
+	void finish(F code) {
+		if(!buf_.empty() || overflow_) {
+			buffered_line(code);
+		}
+	}
+
+	/** Number of lines dropped for being malformed or too long */
+	size_t skipped() const { return skipped_; }
+	/** Line number of the first line dropped, counting from 1, or 0 if none were */
+	size_t first_skipped() const { return first_skipped_; }
+
+private:
+	void skip() {
+		if(!skipped_++) {
+			first_skipped_ = lines_;
+		}
+	}
+
+	void append(const char *data, size_t len) {
+		if(overflow_) {
+			return;
+		}
+		if(buf_.size() + len > max_line_) {
+			overflow_ = true;
+			buf_.clear();
+			return;
+		}
+		buf_.append(data, len);
+	}
+
+	template<typename F>
+	void buffered_line(F &code) {
+		++lines_;
+		if(overflow_) {
+			skip();
+		} else {
+			auto end = buf_.data() + buf_.size();
+			auto m = scan_(buf_.data(), end);
+			line(buf_.data(), m, code);
+		}
+		buf_.clear();
+		overflow_ = false;
+	}
+
+	static boost::string_view trim(boost::string_view s) {
+		while(!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+		while(!s.empty() && (s.back() == ' ' || s.back() == '\t' || s.back() == '\r')) s.remove_suffix(1);
+		return s;
+	}
+
+	template<typename F>
+	void line(const char *data, const line_marks &m, F &code) {
+		auto s = trim(boost::string_view { data, static_cast<size_t>(m.hash - data) });
+		if(s.empty() || s.front() == ';') {
+			return;
+		}
+		if(s.front() == '[') {
+			if(s.back() != ']') {
+				skip();
+				return;
+			}
+			auto name = trim(s.substr(1, s.size() - 2));
+			section_.assign(name.data(), name.size());
+			if(!section_.empty()) {
+				section_ += '.';
+			}
+			return;
+		}
+		if(m.equals >= m.hash) {
+			skip();
+			return;
+		}
+		auto key = trim(boost::string_view { data, static_cast<size_t>(m.equals - data) });
+		auto value = trim(boost::string_view { m.equals + 1, static_cast<size_t>(m.hash - m.equals - 1) });
+		if(key.empty()) {
+			skip();
+			return;
+		}
+		if(section_.empty()) {
+			code(key, value);
+			return;
+		}
+		key_.assign(section_);
+		key_.append(key.data(), key.size());
+		code(boost::string_view { key_ }, value);
+	}
+
+	size_t max_line_;
+	line_scanner scan_;
+	/** Start of a line that has not finished arriving yet */
+	std::string buf_;
+	/** Set while we are discarding the rest of an overlong line */
+	bool overflow_;
+	size_t lines_;
+	size_t skipped_;
+	size_t first_skipped_;
+	/** Current section, with the trailing dot */
+	std::string section_;
+	/** Scratch space for section-qualified keys */
+	std::string key_;
+};
+
+};
+};
@@ -0,0 +1,70 @@
+/**
+ * @file
+ */
+#pragma once
+#include <string>
+#include <vector>
+#include <boost/utility/string_view.hpp>
+
+namespace appcon {
+namespace detail {
+
+/** Does this text refer to other keys as ${name}? */
+inline bool has_references(boost::string_view text) {
+	return text.find("${") != boost::string_view::npos;
+}
+
+/**
+ * Calls code(name) for each ${name} in the text, and code(literal) with
+ * is_ref false for the text between them. An unterminated ${ is literal.
+ */
+template<typename F>
+void each_part(boost::string_view text, F code) {
+	while(!text.empty()) {
+		auto start = text.find("${");
+		auto end = start == boost::string_view::npos ? start : text.find('}', start + 2);
+		if(end == boost::string_view::npos) {
+			code(text, false);
+			return;
+		}
+		if(start > 0) {
+			code(text.substr(0, start), false);
+		}
+		code(text.substr(start + 2, end - start - 2), true);
+		text.remove_prefix(end + 1);
+	}
+}
+
+/** Keys referred to by the text, each once, in order of first use */
+inline std::vector<std::string> references(boost::string_view text) {
+	std::vector<std::string> out;
+	each_part(text, [&out](boost::string_view part, bool is_ref) {
+		if(!is_ref) {
+			return;
+		}
+		for(const auto &k : out) {
+			if(boost::string_view { k } == part) {
+				return;
+			}
+		}
+		out.emplace_back(part.data(), part.size());
+	});
+	return out;
+}
+
+/** Replaces each ${name} in the text with lookup(name) */
+template<typename F>
+std::string interpolate(boost::string_view text, F lookup) {
+	std::string out;
+	each_part(text, [&out, &lookup](boost::string_view part, bool is_ref) {
+		if(is_ref) {
+			out += lookup(std::string { part.data(), part.size() });
+		} else {
+			out.append(part.data(), part.size());
+		}
+	});
+	return out;
+}
+
+};
+};
@@ -0,0 +1,233 @@
+/**
+ * @file
+ */
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <locale>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <boost/utility/string_view.hpp>
+
+namespace appcon {
+namespace detail {
+
+inline const char *type_name(uint8_t) { return "uint8_t"; }
+inline const char *type_name(uint16_t) { return "uint16_t"; }
+inline const char *type_name(uint32_t) { return "uint32_t"; }
+inline const char *type_name(uint64_t) { return "uint64_t"; }
+inline const char *type_name(int8_t) { return "int8_t"; }
+inline const char *type_name(int16_t) { return "int16_t"; }
+inline const char *type_name(int32_t) { return "int32_t"; }
+inline const char *type_name(int64_t) { return "int64_t"; }
+inline const char *type_name(float) { return "float"; }
+inline const char *type_name(double) { return "double"; }
+
+inline boost::string_view trim_number(boost::string_view s) {
+	while(!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+	while(!s.empty() && (s.back() == ' ' || s.back() == '\t' || s.back() == '\r' || s.back() == '\n')) s.remove_suffix(1);
+	return s;
+}
+
+template<typename T>
+[[noreturn]] void bad_number(boost::string_view text) {
+	throw std::invalid_argument("\"" + text.to_string() + "\" is not a valid " + type_name(T { }));
+}
+
+template<typename T>
+[[noreturn]] void number_out_of_range(boost::string_view text) {
+	std::string msg { "\"" + text.to_string() + "\" is out of range for " + type_name(T { }) };
+	if(std::is_integral<T>::value) {
+		/* + 0 promotes the 8-bit types, so they print as numbers */
+		msg += " (" + std::to_string(std::numeric_limits<T>::lowest() + 0) + " to " + std::to_string(std::numeric_limits<T>::max() + 0) + ")";
+	}
+	throw std::out_of_range(msg);
+}
+
+/**
+ * Parses a decimal integer, with an optional sign and surrounding blanks.
+ * Does not go through iostreams or locales, and treats 8-bit types as
+ * numbers rather than characters.
+ * @throws std::invalid_argument if the text is not an integer
+ * @throws std::out_of_range if the value does not fit in T
+ */
+template<typename T>
+typename std::enable_if<std::is_integral<T>::value, T>::type
+parse_number(boost::string_view text) {
+	auto s = trim_number(text);
+	bool negative = false;
+	if(!s.empty() && (s.front() == '+' || s.front() == '-')) {
+		negative = s.front() == '-';
+		s.remove_prefix(1);
+	}
+	if(s.empty()) {
+		bad_number<T>(text);
+	}
+	/* Largest magnitude allowed, so the checks below never overflow */
+	uint64_t limit = negative
+		? (std::is_signed<T>::value ? static_cast<uint64_t>(std::numeric_limits<T>::max()) + 1 : 0)
+		: static_cast<uint64_t>(std::numeric_limits<T>::max());
+	uint64_t v = 0;
+	bool overflow = false;
+	for(auto c : s) {
+		if(c < '0' || c > '9') {
+			bad_number<T>(text);
+		}
+		auto d = static_cast<uint64_t>(c - '0');
+		if(v > (limit - d) / 10 || limit < d) {
+			overflow = true;
+		} else {
+			v = v * 10 + d;
+		}
+	}
+	if(overflow) {
+		number_out_of_range<T>(text);
+	}
+	if(!negative || v == 0) {
+		return static_cast<T>(v);
+	}
+	/* v - 1 fits even for the most negative value */
+	return static_cast<T>(-static_cast<T>(v - 1) - 1);
+}
+
+inline bool narrow_exactly(double d, double &out) {
+	out = d;
+	return true;
+}
+
+/**
+ * Narrows a correctly rounded double to float. That can round differently
+ * from parsing straight to float only when the double sits exactly halfway
+ * between two floats, so those, and anything outside the normal float
+ * range, are refused.
+ */
+inline bool narrow_exactly(double d, float &out) {
+	if(d == 0) {
+		out = 0;
+		return true;
+	}
+	if(d < std::numeric_limits<float>::min() || d > std::numeric_limits<float>::max()) {
+		return false;
+	}
+	uint64_t bits;
+	std::memcpy(&bits, &d, sizeof(bits));
+	/* A double has 29 more significand bits than a float */
+	if((bits & ((uint64_t { 1 } << 29) - 1)) == (uint64_t { 1 } << 28)) {
+		return false;
+	}
+	out = static_cast<float>(d);
+	return true;
+}
+
+/**
+ * Parses a decimal floating-point number. The common case, where the digits
+ * and the power of ten are both exact in a double, is handled directly and
+ * rounds correctly; anything else goes through the classic "C" locale, so
+ * the process locale never changes the decimal point.
+ * @throws std::invalid_argument if the text is not a number
+ * @throws std::out_of_range if the value overflows or underflows T
+ */
+template<typename T>
+typename std::enable_if<std::is_floating_point<T>::value, T>::type
+parse_number(boost::string_view text) {
+	auto s = trim_number(text);
+	auto p = s.begin();
+	auto end = s.end();
+	bool negative = false;
+	if(p != end && (*p == '+' || *p == '-')) {
+		negative = *p == '-';
+		++p;
+	}
+	auto word = boost::string_view { p, static_cast<size_t>(end - p) };
+	if(word == "inf" || word == "infinity" || word == "INF") {
+		return negative ? -std::numeric_limits<T>::infinity() : std::numeric_limits<T>::infinity();
+	}
+	if(word == "nan" || word == "NAN") {
+		return std::numeric_limits<T>::quiet_NaN();
+	}
+
+	/* Collect up to 19 significant digits, which always fit in a uint64_t */
+	uint64_t mantissa = 0;
+	int digits = 0;
+	int exponent = 0;
+	bool exact = true;
+	bool any = false;
+	for(; p != end && *p >= '0' && *p <= '9'; ++p) {
+		any = true;
+		if(digits < 19) {
+			mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+			if(mantissa) ++digits;
+		} else {
+			++exponent;
+			exact = exact && *p == '0';
+		}
+	}
+	if(p != end && *p == '.') {
+		++p;
+		for(; p != end && *p >= '0' && *p <= '9'; ++p) {
+			any = true;
+			if(digits < 19) {
+				mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+				if(mantissa) ++digits;
+				--exponent;
+			} else {
+				exact = exact && *p == '0';
+			}
+		}
+	}
+	if(!any) {
+		bad_number<T>(text);
+	}
+	if(p != end && (*p == 'e' || *p == 'E')) {
+		++p;
+		bool negative_exp = false;
+		if(p != end && (*p == '+' || *p == '-')) {
+			negative_exp = *p == '-';
+			++p;
+		}
+		if(p == end) {
+			bad_number<T>(text);
+		}
+		int e = 0;
+		for(; p != end && *p >= '0' && *p <= '9'; ++p) {
+			if(e < 100000) e = e * 10 + (*p - '0');
+		}
+		exponent += negative_exp ? -e : e;
+	}
+	if(p != end) {
+		bad_number<T>(text);
+	}
+
+	/* Both the mantissa and 10^|exponent| are exact doubles, so one operation rounds correctly */
+	if(exact && mantissa <= (uint64_t { 1 } << 53) && exponent >= -22 && exponent <= 22) {
+		static const double powers[] = {
+			1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+			1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+		};
+		auto d = static_cast<double>(mantissa);
+		d = exponent < 0 ? d / powers[-exponent] : d * powers[exponent];
+		T v;
+		if(narrow_exactly(d, v)) {
+			return negative ? -v : v;
+		}
+	}
+	if(mantissa == 0) {
+		return negative ? -T(0) : T(0);
+	}
+
+	std::istringstream in { s.to_string() };
+	in.imbue(std::locale::classic());
+	T v;
+	in >> v;
+	if(in.fail() || std::isinf(v) || v == 0) {
+		number_out_of_range<T>(text);
+	}
+	return v;
+}
+
+};
+};
@@ -0,0 +1,138 @@
+/**
+ * @file
+ */
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <utility>
+
+namespace appcon {
+
+/**
+ * Base for immutable, reference-counted blocks of config data.
+ * Blocks start with a single reference held by whoever created them.
+ */
+class shared_block {
+public:
+	shared_block():refs_{ 1 } { }
+	shared_block(const shared_block &) = delete;
+	shared_block &operator=(const shared_block &) = delete;
+	virtual ~shared_block() = default;
+
+	void retain(uint32_t n = 1) const noexcept { refs_.fetch_add(n, std::memory_order_relaxed); }
+	void release() const {
+		if(refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			dispose();
+		}
+	}
+
+protected:
+	/** Called once the last reference has gone */
+	virtual void dispose() const { delete this; }
+
+private:
+	mutable std::atomic<uint32_t> refs_;
+};
+
+/**
+ * Holds a reference to a shared_block. Copying costs a single atomic increment.
+ */
+template<typename T>
+class pinned {
+public:
+	pinned():p_{ nullptr } { }
+	pinned(const pinned &src):p_{ src.p_ } { if(p_) p_->retain(); }
+	pinned(pinned &&src) noexcept:p_{ src.p_ } { src.p_ = nullptr; }
+	template<typename U>
+	pinned(pinned<U> &&src) noexcept:p_{ src.detach() } { }
+	~pinned() { if(p_) p_->release(); }
+
+	pinned &operator=(pinned src) noexcept { std::swap(p_, src.p_); return *this; }
+
+	/** Takes over the reference owned by p */
+	static pinned adopt(T *p) noexcept { pinned r; r.p_ = p; return r; }
+	/** Gives up our reference without releasing it */
+	T *detach() noexcept { auto p = p_; p_ = nullptr; return p; }
+
+	T *get() const noexcept { return p_; }
+	T *operator->() const noexcept { return p_; }
+	T &operator*() const noexcept { return *p_; }
+	explicit operator bool() const noexcept { return p_ != nullptr; }
+
+private:
+	T *p_;
+};
+
+namespace detail {
+
+/**
+ * An atomically-replaceable pinned<T>.
+ *
+ * Uses a split reference count: the upper bits of the word hold the number
+ * of readers that are between loading the pointer and taking their own
+ * reference. A writer replacing the pointer hands that count over to the
+ * old block, so readers never touch a block that might already be freed,
+ * and neither side takes a lock. Requires pointers to fit in the low 48
+ * bits on 64-bit platforms.
+ */
+template<typename T>
+class atomic_pinned {
+	static const unsigned shift = sizeof(void *) == 8 ? 48 : 32;
+	static const uint64_t one = uint64_t { 1 } << shift;
+	static const uint64_t mask = one - 1;
+
+public:
+	atomic_pinned():word_{ 0 } { }
+	atomic_pinned(const atomic_pinned &) = delete;
+	atomic_pinned &operator=(const atomic_pinned &) = delete;
+	~atomic_pinned() {
+		auto p = ptr(word_.load(std::memory_order_acquire));
+		if(p) p->release();
+	}
+
+	/** Takes a reference to the current block */
+	pinned<T> load() const noexcept {
+		auto w = word_.fetch_add(one, std::memory_order_acquire);
+		auto p = ptr(w);
+		if(p) p->retain();
+		/* Drop our in-flight mark, unless a writer has already handed it to p */
+		auto cur = w + one;
+		while(!word_.compare_exchange_weak(
+			cur,
+			cur - one,
+			std::memory_order_release,
+			std::memory_order_relaxed
+		)) {
+			if(ptr(cur) != p) {
+				if(p) p->release();
+				break;
+			}
+		}
+		return pinned<T>::adopt(p);
+	}
+
+	/** Replaces the current block */
+	void store(pinned<T> next) noexcept {
+		auto w = word_.exchange(
+			static_cast<uint64_t>(reinterpret_cast<uintptr_t>(next.detach())),
+			std::memory_order_acq_rel
+		);
+		auto p = ptr(w);
+		if(p) {
+			/* Readers still in flight will each drop one of these */
+			auto inflight = static_cast<uint32_t>(w >> shift);
+			if(inflight) p->retain(inflight);
+			p->release();
+		}
+	}
+
+private:
+	static T *ptr(uint64_t w) noexcept {
+		return reinterpret_cast<T *>(static_cast<uintptr_t>(w & mask));
+	}
+
+	mutable std::atomic<uint64_t> word_;
+};
+
+};
+};
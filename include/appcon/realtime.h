@@ -0,0 +1,99 @@
+/**
+ * @file
+ */
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+namespace appcon {
+
+/** Type held by a realtime slot */
+enum class rt_type : uint8_t {
+	none,
+	u8, u16, u32, u64,
+	i8, i16, i32, i64,
+	f32,
+	string,
+	/** The key has held values of more than one type, so typed reads give the default */
+	mixed
+};
+
+template<typename T> struct rt_type_of;
+template<> struct rt_type_of<uint8_t> : std::integral_constant<rt_type, rt_type::u8> { };
+template<> struct rt_type_of<uint16_t> : std::integral_constant<rt_type, rt_type::u16> { };
+template<> struct rt_type_of<uint32_t> : std::integral_constant<rt_type, rt_type::u32> { };
+template<> struct rt_type_of<uint64_t> : std::integral_constant<rt_type, rt_type::u64> { };
+template<> struct rt_type_of<int8_t> : std::integral_constant<rt_type, rt_type::i8> { };
+template<> struct rt_type_of<int16_t> : std::integral_constant<rt_type, rt_type::i16> { };
+template<> struct rt_type_of<int32_t> : std::integral_constant<rt_type, rt_type::i32> { };
+template<> struct rt_type_of<int64_t> : std::integral_constant<rt_type, rt_type::i64> { };
+template<> struct rt_type_of<float> : std::integral_constant<rt_type, rt_type::f32> { };
+template<> struct rt_type_of<std::string> : std::integral_constant<rt_type, rt_type::string> { };
+
+namespace detail {
+
+/**
+ * Latest published value of a single key. The type is fixed by the first
+ * value stored. If a later value has another type, the slot is marked mixed
+ * before the new bits are written, and readers check the type again after
+ * loading the bits, so they never pair the old type with the new bits.
+ * Slots hold only what readers touch, packed into 16 bytes so four share a
+ * cache line and none straddles two.
+ */
+struct rt_slot {
+	rt_slot():bits{ 0 }, version{ 0 }, type{ static_cast<uint8_t>(rt_type::none) } { }
+	std::atomic<uint64_t> bits;
+	/** Incremented each time a new value is published */
+	std::atomic<uint32_t> version;
+	std::atomic<uint8_t> type;
+};
+static_assert(sizeof(rt_slot) == 16, "realtime slots should pack four to a cache line");
+
+};
+
+/**
+ * Handle for reading a numeric key from a real-time thread.
+ *
+ * Reads are wait-free: they never lock, allocate, log or throw, and cost
+ * three atomic loads. Obtain handles up front with config::realtime(),
+ * since resolving one does none of those guarantees.
+ */
+class rt_key {
+public:
+	rt_key() noexcept:slot_{ nullptr } { }
+	explicit rt_key(const detail::rt_slot *s) noexcept:slot_{ s } { }
+
+	/**
+	 * Returns the latest published value, or default_value if the key has
+	 * no value yet or holds a different type.
+	 */
+	template<typename T>
+	T get(const T default_value) const noexcept {
+		static_assert(rt_type_of<T>::value != rt_type::string, "use view::key_view() for strings");
+		const auto type = static_cast<uint8_t>(rt_type_of<T>::value);
+		if(!slot_ || slot_->type.load(std::memory_order_acquire) != type) {
+			return default_value;
+		}
+		auto bits = slot_->bits.load(std::memory_order_acquire);
+		/* Bits from a value of another type were stored after the slot was marked mixed, so we would see that here */
+		if(slot_->type.load(std::memory_order_relaxed) != type) {
+			return default_value;
+		}
+		T v;
+		std::memcpy(&v, &bits, sizeof(T));
+		return v;
+	}
+
+	/** Incremented each time a new value is published for this key */
+	uint32_t version() const noexcept { return slot_ ? slot_->version.load(std::memory_order_acquire) : 0; }
+
+	explicit operator bool() const noexcept { return slot_ != nullptr; }
+
+private:
+	const detail::rt_slot *slot_;
+};
+
+};
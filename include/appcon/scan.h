@@ -0,0 +1,33 @@
+/**
+ * @file
+ */
+#pragma once
+
+namespace appcon {
+namespace detail {
+
+/** Where the interesting bytes in a line are */
+struct line_marks {
+	/** First newline, or the end of the input */
+	const char *eol;
+	/** First '=' before eol, or eol if there is none */
+	const char *equals;
+	/** First '#' before eol, or eol if there is none */
+	const char *hash;
+};
+
+using line_scanner = line_marks (*)(const char *p, const char *end);
+
+enum class simd_level { scalar, sse2, avx2 };
+
+/**
+ * Returns the scanner for the given instruction set, or nullptr if this
+ * build or this CPU does not support it.
+ */
+line_scanner line_scanner_for(simd_level level);
+
+/** The fastest scanner this CPU supports, chosen once at startup */
+line_scanner best_line_scanner();
+
+};
+};
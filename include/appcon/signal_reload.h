@@ -0,0 +1,62 @@
+/**
+ * @file
+ */
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace appcon {
+
+/** Counters for config::reload_on_signal() */
+struct reload_stats {
+	reload_stats():signals{ 0 }, reloads{ 0 }, failures{ 0 }, last_latency{ 0 }, max_latency{ 0 } { }
+	/** Signals received */
+	uint64_t signals;
+	/** Reloads run: a burst of signals only counts once */
+	uint64_t reloads;
+	/** Reloads that threw */
+	uint64_t failures;
+	/** Time from the first signal in a burst to the end of its reload */
+	std::chrono::nanoseconds last_latency;
+	std::chrono::nanoseconds max_latency;
+};
+
+namespace detail {
+
+/**
+ * Runs code on a background thread whenever the given signal arrives.
+ * The signal handler only writes a byte to a pipe, so it is async-signal
+ * safe, and every signal that arrives before code starts is folded into
+ * the same call. Any number of listeners can share a signal; the previous
+ * handler is put back once the last of them has gone.
+ */
+class signal_listener {
+public:
+	/** @throws std::system_error if the handler cannot be installed */
+	signal_listener(int signo, std::function<void()> code);
+	signal_listener(const signal_listener &) = delete;
+	signal_listener &operator=(const signal_listener &) = delete;
+	~signal_listener();
+
+	int signal() const { return signo_; }
+	reload_stats stats() const;
+
+private:
+	void run();
+
+	int signo_;
+	/** Index into the process-wide table the signal handler reads */
+	size_t slot_;
+	std::function<void()> code_;
+	std::atomic<bool> stopping_;
+	mutable std::mutex mutex_;
+	reload_stats stats_;
+	std::thread thread_;
+};
+
+};
+};
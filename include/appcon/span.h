@@ -0,0 +1,33 @@
+/**
+ * @file
+ */
+#pragma once
+#include <cstddef>
+
+namespace appcon {
+
+/**
+ * A view of values held contiguously somewhere else, along the lines of
+ * C++20's std::span. It owns nothing: whatever holds the values must
+ * outlive it.
+ */
+template<typename T>
+class span {
+public:
+	span():data_{ nullptr }, size_{ 0 } { }
+	span(T *data, size_t size):data_{ data }, size_{ size } { }
+
+	T *data() const noexcept { return data_; }
+	size_t size() const noexcept { return size_; }
+	bool empty() const noexcept { return size_ == 0; }
+
+	T &operator[](size_t i) const noexcept { return data_[i]; }
+	T *begin() const noexcept { return data_; }
+	T *end() const noexcept { return data_ + size_; }
+
+private:
+	T *data_;
+	size_t size_;
+};
+
+};
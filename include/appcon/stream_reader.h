@@ -0,0 +1,45 @@
+/**
+ * @file
+ */
+#pragma once
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <boost/utility/string_view.hpp>
+#include <appcon/ini_tokenizer.h>
+
+namespace appcon {
+namespace detail {
+
+/**
+ * Reads INI-style records from a descriptor on a background thread, and
+ * hands each complete record to code as soon as it has been read. Uses a
+ * fixed-size read buffer, and stops at end of file or on destruction.
+ * The descriptor is never closed.
+ */
+class stream_reader {
+public:
+	using handler = std::function<void(boost::string_view key, boost::string_view value)>;
+
+	/** @throws std::system_error if the stop pipe cannot be created */
+	stream_reader(int fd, handler code);
+	stream_reader(const stream_reader &) = delete;
+	stream_reader &operator=(const stream_reader &) = delete;
+	~stream_reader();
+
+	/** True once the other end has closed the stream */
+	bool finished() const { return finished_.load(std::memory_order_acquire); }
+
+private:
+	void run();
+
+	int fd_;
+	int stop_[2];
+	handler code_;
+	ini_tokenizer tokenizer_;
+	std::atomic<bool> finished_;
+	std::thread thread_;
+};
+
+};
+};
@@ -0,0 +1,92 @@
+/**
+ * @file
+ */
+#pragma once
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+namespace appcon {
+namespace detail {
+
+/**
+ * Runs callbacks at given times, on a single background thread.
+ *
+ * Timers live in a hierarchical wheel: four levels of 64 slots, with
+ * millisecond ticks at the bottom and each level 64 times coarser than the
+ * one below. Scheduling and cancelling are O(1), and a timer moves down a
+ * level at most three times before it fires. Timers further out than the
+ * top level can reach wait in its last slot and are placed again when it
+ * comes round. The thread sleeps until the next occupied slot, and not at
+ * all while nothing is scheduled.
+ */
+class timer_wheel {
+public:
+	using clock = std::chrono::steady_clock;
+
+	timer_wheel();
+	timer_wheel(const timer_wheel &) = delete;
+	timer_wheel &operator=(const timer_wheel &) = delete;
+	/** Drops any timers that have not fired yet */
+	~timer_wheel();
+
+	/**
+	 * Calls code at or soon after when, which may be in the past.
+	 * @returns an id for cancel(), never 0
+	 */
+	uint64_t schedule(clock::time_point when, std::function<void()> code);
+	/** @returns false if the timer has already fired or was never scheduled */
+	bool cancel(uint64_t id);
+	/** Number of timers waiting to fire */
+	size_t pending() const;
+
+private:
+	static const unsigned levels = 4;
+	static const unsigned slot_bits = 6;
+	static const unsigned slots = 1u << slot_bits;
+
+	struct timer {
+		uint64_t id;
+		/** Tick at which this fires */
+		uint64_t due;
+		std::function<void()> code;
+		/** Where this is in the wheel */
+		unsigned level;
+		unsigned index;
+	};
+	using slot_type = std::list<timer>;
+
+	void run();
+	/** Tick for a time, rounded down or up to the millisecond */
+	uint64_t tick_at(clock::time_point t, bool round_up) const;
+	/** Moves a timer into the slot for its due tick. Caller holds mutex_. */
+	void place(slot_type &from, slot_type::iterator t);
+	/** Takes a slot's timers out of the wheel. Caller holds mutex_. */
+	void take(unsigned level, unsigned index, slot_type &out);
+	/** Handles tick now_: brings timers down from higher levels and collects those due. Caller holds mutex_. */
+	void process(slot_type &ready);
+	/** The next tick with a slot that needs attention, or 0 if nothing is scheduled. Caller holds mutex_. */
+	uint64_t next_tick() const;
+
+	clock::time_point start_;
+	mutable std::mutex mutex_;
+	std::condition_variable cv_;
+	std::array<std::array<slot_type, slots>, levels> wheel_;
+	/** Bit per occupied slot, for each level */
+	std::array<uint64_t, levels> occupied_;
+	/** Every tick before this one has been processed */
+	uint64_t now_;
+	uint64_t next_id_;
+	std::unordered_map<uint64_t, slot_type::iterator> timers_;
+	bool stopping_;
+	std::thread thread_;
+};
+
+};
+};
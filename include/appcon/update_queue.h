@@ -0,0 +1,114 @@
+/**
+ * @file
+ */
+#pragma once
+#include <atomic>
+#include <new>
+#include <utility>
+#include <boost/container/pmr/memory_resource.hpp>
+
+namespace appcon {
+namespace detail {
+
+/**
+ * Lock-free multi-producer, single-consumer queue.
+ *
+ * Producers push onto an intrusive list with a CAS on the head pointer.
+ * The consumer takes everything queued so far in one exchange, so a
+ * drain costs a single atomic operation no matter how many producers
+ * are active. Nodes come from the given memory resource, which must be
+ * thread-safe, or the global heap if there is none.
+ */
+template<typename T>
+class update_queue {
+public:
+	using memory_resource = boost::container::pmr::memory_resource;
+
+	explicit update_queue(memory_resource *mr = nullptr):head_{ nullptr }, mr_{ mr } { }
+	update_queue(const update_queue &) = delete;
+	update_queue &operator=(const update_queue &) = delete;
+	~update_queue() { drain([](T &) { }); }
+
+	/**
+	 * Adds an item to the queue.
+	 * @returns true if the queue was empty beforehand, in which case the
+	 * consumer may need waking up
+	 */
+	bool push(T v) {
+		auto n = make_node(std::move(v));
+		auto prev = head_.load(std::memory_order_relaxed);
+		do {
+			n->next = prev;
+		} while(!head_.compare_exchange_weak(
+			prev,
+			n,
+			std::memory_order_release,
+			std::memory_order_relaxed
+		));
+		return prev == nullptr;
+	}
+
+	/** True if nothing is waiting to be drained */
+	bool empty() const { return head_.load(std::memory_order_acquire) == nullptr; }
+
+	/**
+	 * Removes everything currently queued, passing each item to code
+	 * in the order it was pushed.
+	 * @returns the number of items drained
+	 */
+	template<typename F>
+	size_t drain(F code) {
+		auto n = head_.exchange(nullptr, std::memory_order_acquire);
+		/* The list is newest-first, reverse it so we hand things out in order */
+		node *list = nullptr;
+		while(n) {
+			auto next = n->next;
+			n->next = list;
+			list = n;
+			n = next;
+		}
+		size_t count = 0;
+		while(list) {
+			auto next = list->next;
+			code(list->value);
+			free_node(list);
+			list = next;
+			++count;
+		}
+		return count;
+	}
+
+private:
+	struct node {
+		node *next;
+		T value;
+	};
+
+	node *make_node(T v) {
+		if(!mr_) {
+			return new node { nullptr, std::move(v) };
+		}
+		auto mem = mr_->allocate(sizeof(node), alignof(node));
+		try {
+			return new (mem) node { nullptr, std::move(v) };
+		} catch(...) {
+			mr_->deallocate(mem, sizeof(node), alignof(node));
+			throw;
+		}
+	}
+
+	void free_node(node *n) noexcept {
+		if(!mr_) {
+			delete n;
+			return;
+		}
+		n->~node();
+		mr_->deallocate(n, sizeof(node), alignof(node));
+	}
+
+	std::atomic<node *> head_;
+	memory_resource *mr_;
+};
+
+};
+};
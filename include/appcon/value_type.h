@@ -0,0 +1,85 @@
+/**
+ * @file
+ */
+#pragma once
+#include <functional>
+#include <string>
+#include <typeinfo>
+#include <utility>
+#include <boost/utility/string_view.hpp>
+#include <appcon/pinned.h>
+
+namespace appcon {
+
+/**
+ * A value of a registered type. These are parsed once, when the key changes,
+ * and shared by every reader of that generation.
+ */
+class parsed_value : public shared_block {
+public:
+	/** Type held, for checked downcasts */
+	virtual const std::type_info &type() const noexcept = 0;
+};
+
+/** A parsed_value holding a T */
+template<typename T>
+class parsed : public parsed_value {
+public:
+	explicit parsed(T v):value_(std::move(v)) { }
+
+	const T &get() const noexcept { return value_; }
+	const T &operator*() const noexcept { return value_; }
+	const T *operator->() const noexcept { return &value_; }
+
+	virtual const std::type_info &type() const noexcept override { return typeid(T); }
+
+private:
+	T value_;
+};
+
+/**
+ * Converts values of a registered type to and from text. Every loader hands
+ * us text, so this is all the config needs to know about a type.
+ */
+class value_type {
+public:
+	virtual ~value_type() = default;
+
+	virtual const std::string &name() const = 0;
+	/** @throws std::invalid_argument or std::out_of_range if the text is not a valid value */
+	virtual pinned<parsed_value> parse(boost::string_view text) const = 0;
+	/** Canonical text for a value, as shown by key(), watchers and the change log */
+	virtual std::string format(const parsed_value &v) const = 0;
+};
+
+/** A value_type built from a pair of functions */
+template<typename T>
+class basic_value_type : public value_type {
+public:
+	basic_value_type(
+		std::string name,
+		std::function<T(boost::string_view)> parse,
+		std::function<std::string(const T &)> format
+	):name_(std::move(name)),
+	  parse_(std::move(parse)),
+	  format_(std::move(format))
+	{
+	}
+
+	virtual const std::string &name() const override { return name_; }
+
+	virtual pinned<parsed_value> parse(boost::string_view text) const override {
+		return pinned<parsed_value>::adopt(new parsed<T>(parse_(text)));
+	}
+
+	virtual std::string format(const parsed_value &v) const override {
+		return format_(static_cast<const parsed<T> &>(v).get());
+	}
+
+private:
+	std::string name_;
+	std::function<T(boost::string_view)> parse_;
+	std::function<std::string(const T &)> format_;
+};
+
+};
@@ -0,0 +1,107 @@
+/**
+ * @file
+ */
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <typeinfo>
+#include <vector>
+#include <boost/utility/string_view.hpp>
+#include <appcon/pinned.h>
+#include <appcon/span.h>
+#include <appcon/value_type.h>
+
+namespace appcon {
+
+class retired_block;
+
+namespace detail {
+/** Views and other published blocks that have lost their last reference, waiting for a writer to free them */
+extern std::atomic<const retired_block *> retired_views;
+/** Frees every retired block. Writers call this after publishing. */
+void reclaim_views();
+};
+
+/**
+ * A shared_block that readers reach without locks. Releasing one never
+ * frees memory on the releasing thread: the block goes onto a lock-free
+ * list, and the next writer to publish frees it. Subclasses built per call
+ * rather than published, such as the views from config::tenant(), override
+ * dispose() to free themselves straight away instead.
+ */
+class retired_block : public shared_block {
+protected:
+	virtual void dispose() const override {
+		auto head = detail::retired_views.load(std::memory_order_relaxed);
+		do {
+			retired_next_ = head;
+		} while(!detail::retired_views.compare_exchange_weak(
+			head,
+			this,
+			std::memory_order_release,
+			std::memory_order_relaxed
+		));
+	}
+
+private:
+	friend void detail::reclaim_views();
+	mutable const retired_block *retired_next_ = nullptr;
+};
+
+/**
+ * An immutable set of config values, as they were at a single generation.
+ * Reads take no locks, and the values never change underneath the caller.
+ * Releasing a view from snapshot() never frees memory on the releasing
+ * thread. The exception is a view from config::tenant() for a tenant with
+ * overrides: it is built for that call and freed, along with any overrides
+ * only it still holds, by whichever thread releases it last.
+ */
+class view : public retired_block {
+public:
+	/** Generation these values were published at */
+	virtual uint64_t generation() const = 0;
+	/** Do we have a value for this key? */
+	virtual bool have_key(const std::string &k) const = 0;
+
+	virtual std::string key(const std::string &k, const std::string default_value) const = 0;
+	virtual float key(const std::string &k, const float default_value) const = 0;
+	virtual uint8_t key(const std::string &k, const uint8_t default_value) const = 0;
+	virtual uint16_t key(const std::string &k, const uint16_t default_value) const = 0;
+	virtual uint32_t key(const std::string &k, const uint32_t default_value) const = 0;
+	virtual uint64_t key(const std::string &k, const uint64_t default_value) const = 0;
+	virtual int8_t key(const std::string &k, const int8_t default_value) const = 0;
+	virtual int16_t key(const std::string &k, const int16_t default_value) const = 0;
+	virtual int32_t key(const std::string &k, const int32_t default_value) const = 0;
+	virtual int64_t key(const std::string &k, const int64_t default_value) const = 0;
+
+	/**
+	 * Looks up a string value without locking, allocating, logging or throwing,
+	 * so this is safe to call from real-time threads. The result points into
+	 * this view and stays valid for as long as the view is held.
+	 */
+	virtual boost::string_view key_view(boost::string_view k, boost::string_view default_value) const noexcept = 0;
+
+	/**
+	 * Parsed value of a key declared with config::define(), or nothing if the
+	 * key has no value or is not of a registered type. No parsing happens here.
+	 */
+	virtual pinned<parsed_value> typed(const std::string &k) const { (void)k; return { }; }
+
+	/**
+	 * Values of a list key declared with element type T, or an empty span if
+	 * the key has no value or holds something else. The span points into this
+	 * view, and stays valid for as long as the view is held.
+	 */
+	template<typename T>
+	span<const T> array(const std::string &k) const {
+		auto v = typed(k);
+		if(!v || v->type() != typeid(std::vector<T>)) {
+			return { };
+		}
+		const auto &values = static_cast<const parsed<std::vector<T>> &>(*v).get();
+		return { values.data(), values.size() };
+	}
+};
+
+};
@@ -0,0 +1,24 @@
+/**
+ * @file
+ */
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace appcon {
+namespace detail {
+
+/**
+ * Sleeps while word still holds expected, until woken or the deadline
+ * passes. Spurious returns are possible, so callers re-check the word.
+ * Uses a futex on Linux, and a small table of condition variables keyed
+ * by address elsewhere.
+ */
+void wait_on(const std::atomic<uint32_t> &word, uint32_t expected, std::chrono::steady_clock::time_point deadline);
+
+/** Wakes every thread in wait_on() for this word */
+void wake_all(const std::atomic<uint32_t> &word);
+
+};
+};
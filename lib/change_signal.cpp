@@ -0,0 +1,76 @@
+#include <appcon/change_signal.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <system_error>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+using namespace appcon::detail;
+
+change_signal::change_signal(
+):read_fd_{ -1 },
+  write_fd_{ -1 }
+{
+}
+
+change_signal::~change_signal()
+{
+	auto w = write_fd_.load();
+	if(w >= 0 && w != read_fd_) {
+		::close(w);
+	}
+	if(read_fd_ >= 0) {
+		::close(read_fd_);
+	}
+}
+
+int
+change_signal::fd()
+{
+	std::lock_guard<std::mutex> guard(mutex_);
+	if(read_fd_ >= 0) {
+		return read_fd_;
+	}
+#ifdef __linux__
+	auto efd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if(efd < 0) {
+		throw std::system_error(errno, std::system_category(), "eventfd");
+	}
+	read_fd_ = efd;
+	write_fd_.store(efd, std::memory_order_release);
+#else
+	int fds[2];
+	if(::pipe(fds) != 0) {
+		throw std::system_error(errno, std::system_category(), "pipe");
+	}
+	for(auto f : fds) {
+		::fcntl(f, F_SETFL, ::fcntl(f, F_GETFL) | O_NONBLOCK);
+		::fcntl(f, F_SETFD, FD_CLOEXEC);
+	}
+	read_fd_ = fds[0];
+	write_fd_.store(fds[1], std::memory_order_release);
+#endif
+	return read_fd_;
+}
+
+void
+change_signal::notify() noexcept
+{
+	auto w = write_fd_.load(std::memory_order_acquire);
+	if(w < 0) {
+		return;
+	}
+#ifdef __linux__
+	uint64_t one = 1;
+	auto written = ::write(w, &one, sizeof(one));
+#else
+	char one = 1;
+	/* A full pipe is fine: it is already readable */
+	auto written = ::write(w, &one, sizeof(one));
+#endif
+	(void) written;
+}
@@ -3,3 +3,15 @@
 using namespace appcon::detail;
 
 
+std::atomic<const appcon::retired_block *> appcon::detail::retired_views { nullptr };
+
+void
+appcon::detail::reclaim_views()
+{
+	auto v = retired_views.exchange(nullptr, std::memory_order_acquire);
+	while(v) {
+		auto next = v->retired_next_;
+		delete v;
+		v = next;
+	}
+}
@@ -0,0 +1,399 @@
+#include <appcon/disk_index.h>
+#include <appcon/hamt.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace appcon::detail;
+
+namespace {
+
+const char magic[8] = { 'A', 'P', 'P', 'C', 'O', 'N', 'I', 'X' };
+const uint32_t format_version = 1;
+const uint64_t initial_buckets = 1024;
+const size_t initial_data = 64 * 1024;
+
+/** Records start with the key and value lengths, and are padded to 8 bytes */
+size_t record_size(size_t klen, size_t vlen) {
+	return (8 + klen + vlen + 7) & ~size_t { 7 };
+}
+
+uint64_t hash_of(boost::string_view k) {
+	auto h = key_hash()(k.data(), k.size());
+	/* 0 marks an empty bucket */
+	return h ? h : 1;
+}
+
+int open_file(const std::string &path, int flags) {
+	auto fd = ::open(path.c_str(), flags | O_RDWR | O_CLOEXEC, 0644);
+	if(fd < 0) {
+		throw std::system_error(errno, std::system_category(), "open " + path);
+	}
+	return fd;
+}
+
+/** Two indexes writing through the same mapping would corrupt it, so each one holds the file */
+void lock_file(int fd, const std::string &path) {
+	if(::flock(fd, LOCK_EX | LOCK_NB) != 0) {
+		throw std::system_error(errno, std::system_category(), "lock " + path);
+	}
+}
+
+/** Makes a rename in the directory holding path durable */
+void sync_directory(const std::string &path) {
+	auto slash = path.find_last_of('/');
+	auto dir = slash == std::string::npos ? std::string { "." } : slash == 0 ? std::string { "/" } : path.substr(0, slash);
+	auto fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if(fd < 0 || ::fsync(fd) != 0) {
+		auto err = errno;
+		if(fd >= 0) ::close(fd);
+		throw std::system_error(err, std::system_category(), "fsync " + dir);
+	}
+	::close(fd);
+}
+
+void resize_file(int fd, size_t len) {
+	if(::ftruncate(fd, static_cast<off_t>(len)) != 0) {
+		throw std::system_error(errno, std::system_category(), "ftruncate");
+	}
+}
+
+char *map_file(int fd, size_t len) {
+	auto p = ::mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if(p == MAP_FAILED) {
+		throw std::system_error(errno, std::system_category(), "mmap");
+	}
+	/* Lookups jump around the file, so readahead would only waste memory */
+	::madvise(p, len, MADV_RANDOM);
+	return static_cast<char *>(p);
+}
+
+}
+
+struct disk_index::header {
+	char magic[8];
+	uint32_t version;
+	uint32_t reserved;
+	/** Size of the bucket array, always a power of two */
+	uint64_t buckets;
+	/** Buckets in use */
+	uint64_t used;
+	/** Records run from data_start to data_end */
+	uint64_t data_start;
+	uint64_t data_end;
+};
+
+struct disk_index::bucket {
+	uint64_t hash;
+	/** Offset of the latest record for this key, or 0 if the bucket is empty */
+	uint64_t offset;
+};
+
+disk_index::disk_index(
+	std::string path,
+	size_t cache_entries,
+	bool truncate
+):path_(std::move(path)),
+  fd_{ open_file(path_, O_CREAT) },
+  base_{ nullptr },
+  length_{ 0 },
+  cache_(cache_entries),
+  hits_{ 0 },
+  misses_{ 0 }
+{
+	static_assert(sizeof(header) <= 64, "index header must fit before the buckets");
+	static_assert(sizeof(bucket) == 16, "buckets are laid out as two 64-bit words");
+	try {
+		lock_file(fd_, path_);
+		if(truncate) {
+			resize_file(fd_, 0);
+		}
+		struct stat st;
+		if(::fstat(fd_, &st) != 0) {
+			throw std::system_error(errno, std::system_category(), "fstat " + path_);
+		}
+		if(st.st_size == 0) {
+			auto len = 64 + initial_buckets * sizeof(bucket) + initial_data;
+			resize_file(fd_, len);
+			map(len);
+			format(base_, initial_buckets);
+			return;
+		}
+		if(static_cast<size_t>(st.st_size) < 64) {
+			throw std::runtime_error(path_ + " is not a config index");
+		}
+		map(static_cast<size_t>(st.st_size));
+		auto &h = head();
+		if(std::memcmp(h.magic, magic, sizeof(magic)) != 0 || h.version != format_version || h.data_end > length_) {
+			throw std::runtime_error(path_ + " is not a config index");
+		}
+	} catch(...) {
+		unmap();
+		::close(fd_);
+		throw;
+	}
+}
+
+disk_index::~disk_index()
+{
+	unmap();
+	::close(fd_);
+}
+
+void
+disk_index::format(char *base, uint64_t buckets)
+{
+	auto h = reinterpret_cast<header *>(base);
+	std::memcpy(h->magic, magic, sizeof(magic));
+	h->version = format_version;
+	h->reserved = 0;
+	h->buckets = buckets;
+	h->used = 0;
+	h->data_start = 64 + buckets * sizeof(bucket);
+	h->data_end = h->data_start;
+}
+
+void
+disk_index::map(size_t len)
+{
+	base_ = map_file(fd_, len);
+	length_ = len;
+}
+
+void
+disk_index::unmap()
+{
+	if(base_) {
+		::munmap(base_, length_);
+		base_ = nullptr;
+	}
+}
+
+disk_index::header &
+disk_index::head() const
+{
+	return *reinterpret_cast<header *>(base_);
+}
+
+disk_index::bucket *
+disk_index::buckets() const
+{
+	return reinterpret_cast<bucket *>(base_ + 64);
+}
+
+boost::string_view
+disk_index::record_key(uint64_t offset) const
+{
+	uint32_t klen;
+	std::memcpy(&klen, base_ + offset, sizeof(klen));
+	return boost::string_view { base_ + offset + 8, klen };
+}
+
+boost::string_view
+disk_index::record_value(uint64_t offset) const
+{
+	uint32_t len[2];
+	std::memcpy(len, base_ + offset, sizeof(len));
+	return boost::string_view { base_ + offset + 8 + len[0], len[1] };
+}
+
+disk_index::bucket &
+disk_index::probe(uint64_t h, boost::string_view k) const
+{
+	auto mask = head().buckets - 1;
+	for(auto i = h & mask; ; i = (i + 1) & mask) {
+		auto &b = buckets()[i];
+		if(!b.offset || (b.hash == h && record_key(b.offset) == k)) {
+			return b;
+		}
+	}
+}
+
+bool
+disk_index::find(boost::string_view k, std::string &out) const
+{
+	auto h = hash_of(k);
+	std::lock_guard<std::mutex> guard(mutex_);
+	cached *c = nullptr;
+	if(!cache_.empty()) {
+		c = &cache_[h % cache_.size()];
+		if(c->hash == h && c->key == k) {
+			++hits_;
+			out = c->value;
+			return true;
+		}
+	}
+	++misses_;
+	auto &b = probe(h, k);
+	if(!b.offset) {
+		return false;
+	}
+	auto v = record_value(b.offset);
+	out.assign(v.data(), v.size());
+	if(c) {
+		c->hash = h;
+		c->key.assign(k.data(), k.size());
+		c->value = out;
+	}
+	return true;
+}
+
+bool
+disk_index::put(boost::string_view k, boost::string_view v, std::string *prev)
+{
+	auto h = hash_of(k);
+	std::lock_guard<std::mutex> guard(mutex_);
+	{
+		auto &b = probe(h, k);
+		if(prev) {
+			prev->clear();
+			if(b.offset) {
+				auto old = record_value(b.offset);
+				prev->assign(old.data(), old.size());
+			}
+		}
+		if(b.offset && record_value(b.offset) == v) {
+			return false;
+		}
+		if(!b.offset && (head().used + 1) * 2 > head().buckets) {
+			rebuild();
+		}
+	}
+	/* Appending may move the mapping, so find the bucket again afterwards */
+	auto offset = append(k, v);
+	auto &b = probe(h, k);
+	if(!b.offset) {
+		b.hash = h;
+		++head().used;
+	}
+	b.offset = offset;
+	if(!cache_.empty()) {
+		auto &c = cache_[h % cache_.size()];
+		if(c.hash == h && c.key == k) {
+			c.value.assign(v.data(), v.size());
+		}
+	}
+	return true;
+}
+
+size_t
+disk_index::size() const
+{
+	std::lock_guard<std::mutex> guard(mutex_);
+	return static_cast<size_t>(head().used);
+}
+
+size_t
+disk_index::cache_hits() const
+{
+	std::lock_guard<std::mutex> guard(mutex_);
+	return hits_;
+}
+
+size_t
+disk_index::cache_misses() const
+{
+	std::lock_guard<std::mutex> guard(mutex_);
+	return misses_;
+}
+
+uint64_t
+disk_index::append(boost::string_view k, boost::string_view v)
+{
+	auto need = record_size(k.size(), v.size());
+	auto offset = head().data_end;
+	if(offset + need > length_) {
+		auto len = length_ * 2;
+		if(len < offset + need) {
+			len = offset + need;
+		}
+		resize_file(fd_, len);
+		unmap();
+		map(len);
+	}
+	uint32_t len[2] = { static_cast<uint32_t>(k.size()), static_cast<uint32_t>(v.size()) };
+	std::memcpy(base_ + offset, len, sizeof(len));
+	std::memcpy(base_ + offset + 8, k.data(), k.size());
+	std::memcpy(base_ + offset + 8 + k.size(), v.data(), v.size());
+	head().data_end = offset + need;
+	return offset;
+}
+
+void
+disk_index::rebuild()
+{
+	auto &old = head();
+	auto count = old.buckets * 2;
+	size_t live = 0;
+	for(uint64_t i = 0; i < old.buckets; ++i) {
+		auto &b = buckets()[i];
+		if(b.offset) {
+			live += record_size(record_key(b.offset).size(), record_value(b.offset).size());
+		}
+	}
+	auto data = live * 2 > initial_data ? live * 2 : initial_data;
+	auto len = 64 + count * sizeof(bucket) + data;
+
+	/*
+	 * Built beside the old file, written to disk, and renamed over it, so a
+	 * crash or power loss leaves one or the other
+	 */
+	auto tmp = path_ + ".tmp";
+	auto fd = open_file(tmp, O_CREAT | O_TRUNC);
+	char *base;
+	try {
+		lock_file(fd, tmp);
+		resize_file(fd, len);
+		base = map_file(fd, len);
+	} catch(...) {
+		::close(fd);
+		::unlink(tmp.c_str());
+		throw;
+	}
+	format(base, count);
+	auto &h = *reinterpret_cast<header *>(base);
+	auto slots = reinterpret_cast<bucket *>(base + 64);
+	for(uint64_t i = 0; i < old.buckets; ++i) {
+		auto &b = buckets()[i];
+		if(!b.offset) {
+			continue;
+		}
+		auto size = record_size(record_key(b.offset).size(), record_value(b.offset).size());
+		std::memcpy(base + h.data_end, base_ + b.offset, size);
+		auto j = b.hash & (count - 1);
+		while(slots[j].offset) {
+			j = (j + 1) & (count - 1);
+		}
+		slots[j].hash = b.hash;
+		slots[j].offset = h.data_end;
+		h.data_end += size;
+		++h.used;
+	}
+	const char *failed = nullptr;
+	if(::msync(base, len, MS_SYNC) != 0 || ::fsync(fd) != 0) {
+		failed = "fsync ";
+	} else if(::rename(tmp.c_str(), path_.c_str()) != 0) {
+		failed = "rename ";
+	}
+	if(failed) {
+		auto err = errno;
+		::munmap(base, len);
+		::close(fd);
+		::unlink(tmp.c_str());
+		throw std::system_error(err, std::system_category(), failed + tmp);
+	}
+	unmap();
+	::close(fd_);
+	fd_ = fd;
+	base_ = base;
+	length_ = len;
+	sync_directory(path_);
+}
@@ -0,0 +1,47 @@
+#include <appcon/fingerprint.h>
+
+#include <algorithm>
+#include <fnmatch.h>
+#include <sys/stat.h>
+#include <boost/filesystem.hpp>
+
+using namespace appcon::detail;
+
+bool
+appcon::detail::fingerprint_of(const std::string &path, fingerprint &out)
+{
+	struct stat st;
+	if(::stat(path.c_str(), &st) != 0) {
+		return false;
+	}
+	out.device = static_cast<uint64_t>(st.st_dev);
+	out.inode = static_cast<uint64_t>(st.st_ino);
+	out.size = static_cast<uint64_t>(st.st_size);
+#ifdef __APPLE__
+	out.mtime_ns = static_cast<int64_t>(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+	out.ctime_ns = static_cast<int64_t>(st.st_ctimespec.tv_sec) * 1000000000 + st.st_ctimespec.tv_nsec;
+#else
+	out.mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+	out.ctime_ns = static_cast<int64_t>(st.st_ctim.tv_sec) * 1000000000 + st.st_ctim.tv_nsec;
+#endif
+	return true;
+}
+
+std::vector<std::string>
+appcon::detail::matching_files(const std::string &dir, const std::string &pattern)
+{
+	namespace fs = boost::filesystem;
+	std::vector<std::string> found;
+	boost::system::error_code ec;
+	for(fs::directory_iterator it { dir, ec }, end; !ec && it != end; it.increment(ec)) {
+		if(!fs::is_regular_file(it->status())) {
+			continue;
+		}
+		auto name = it->path().filename().string();
+		if(::fnmatch(pattern.c_str(), name.c_str(), FNM_PERIOD) == 0) {
+			found.push_back(it->path().string());
+		}
+	}
+	std::sort(found.begin(), found.end());
+	return found;
+}
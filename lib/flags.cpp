@@ -0,0 +1,110 @@
+#include <appcon/flags.h>
+
+#include <cmath>
+
+using namespace appcon;
+
+namespace {
+
+/** Room in the first table; later ones double it */
+const uint32_t initial_capacity = 16;
+
+}
+
+flags::table::table(
+	uint32_t capacity
+):capacity{ capacity },
+  count{ 0 },
+  entries{ new decision[capacity] }
+{
+	for(uint32_t i = 0; i < capacity; ++i) {
+		entries[i].threshold.store(0, std::memory_order_relaxed);
+		entries[i].salt = 0;
+	}
+}
+
+flags::flags(
+	std::shared_ptr<config> cfg,
+	std::string prefix
+):state_(std::make_shared<state>())
+{
+	state_->cfg = std::move(cfg);
+	state_->prefix = std::move(prefix);
+	state_->built_generation = 0;
+	state_->builds = 0;
+	state_->tables.emplace_back(new table(initial_capacity));
+	std::lock_guard<std::mutex> guard(state_->mutex);
+	rebuild(*state_, true);
+}
+
+flags::~flags()
+{
+}
+
+flags::flag
+flags::declare(const std::string &name, float percent, const std::string &desc)
+{
+	auto key = state_->prefix + name;
+	(*state_->cfg)(key, percent, desc);
+	uint32_t id;
+	{
+		std::lock_guard<std::mutex> guard(state_->mutex);
+		id = static_cast<uint32_t>(state_->names.size());
+		state_->names.push_back(name);
+		rebuild(*state_, true);
+	}
+	std::weak_ptr<state> weak { state_ };
+	state_->cfg->watch(key, 0.0f, [weak](float, float) {
+		if(auto s = weak.lock()) {
+			std::lock_guard<std::mutex> guard(s->mutex);
+			rebuild(*s, false);
+		}
+	});
+	return flag { id };
+}
+
+uint64_t
+flags::builds() const
+{
+	std::lock_guard<std::mutex> guard(state_->mutex);
+	return state_->builds;
+}
+
+void
+flags::rebuild(state &s, bool force)
+{
+	auto snapshot = s.cfg->snapshot();
+	/* Watchers for several flags fire for the same generation, which only needs one rebuild */
+	if(!force && snapshot->generation() == s.built_generation) {
+		return;
+	}
+	auto count = static_cast<uint32_t>(s.names.size());
+	auto t = s.tables.back().get();
+	if(count > t->capacity) {
+		auto capacity = t->capacity * 2;
+		while(capacity < count) {
+			capacity *= 2;
+		}
+		s.tables.emplace_back(new table(capacity));
+		t = s.tables.back().get();
+	}
+	auto filled = t->count.load(std::memory_order_relaxed);
+	for(uint32_t i = 0; i < count; ++i) {
+		auto percent = static_cast<double>(snapshot->key(s.prefix + s.names[i], 0.0f));
+		uint64_t threshold = 0;
+		if(percent >= 100.0) {
+			threshold = uint64_t { 1 } << 32;
+		} else if(percent > 0.0) {
+			threshold = static_cast<uint64_t>(std::llround(percent / 100.0 * 4294967296.0));
+		}
+		/* Readers cannot see entries past count yet, so their salt is safe to set */
+		if(i >= filled) {
+			t->entries[i].salt = hash(s.names[i]);
+		}
+		t->entries[i].threshold.store(threshold, std::memory_order_release);
+	}
+	t->count.store(count, std::memory_order_release);
+	s.current.store(t, std::memory_order_release);
+	s.built_generation = snapshot->generation();
+	++s.builds;
+}
@@ -0,0 +1,21 @@
+#include <appcon/formats.h>
+#include <appcon/ini_tokenizer.h>
+
+#include <stdexcept>
+
+using namespace appcon::detail;
+
+void
+appcon::detail::parse_ini(boost::string_view text, const record_handler &code)
+{
+	/* The whole document is already in memory, so no line is too long */
+	ini_tokenizer tok { text.size() };
+	tok.feed(text.data(), text.size(), code);
+	tok.finish(code);
+	if(tok.skipped()) {
+		throw std::runtime_error(
+			"INI line " + std::to_string(tok.first_skipped()) + ": expected key = value, a [section] or a comment"
+			+ (tok.skipped() > 1 ? " (and " + std::to_string(tok.skipped() - 1) + " more bad lines)" : "")
+		);
+	}
+}
@@ -0,0 +1,266 @@
+#include <appcon/formats.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+using namespace appcon::detail;
+
+namespace {
+
+/** Deeper documents are rejected rather than risking the stack */
+const size_t max_depth = 64;
+
+class json_parser {
+public:
+	json_parser(boost::string_view text, const record_handler &code)
+	 :begin_{ text.data() },
+	  p_{ text.data() },
+	  end_{ text.data() + text.size() },
+	  code_(code)
+	{
+	}
+
+	void parse() {
+		skip_ws();
+		if(p_ == end_ || *p_ != '{') {
+			fail("expected an object at the top level");
+		}
+		object(0);
+		skip_ws();
+		if(p_ != end_) {
+			fail("unexpected data after the top-level object");
+		}
+	}
+
+private:
+	[[noreturn]] void fail(const std::string &msg) const {
+		auto line = 1 + std::count(begin_, p_, '\n');
+		throw std::runtime_error("JSON line " + std::to_string(line) + ": " + msg);
+	}
+
+	char peek() const {
+		if(p_ == end_) {
+			fail("unexpected end of input");
+		}
+		return *p_;
+	}
+
+	void expect(char c) {
+		if(peek() != c) {
+			fail(std::string { "expected '" } + c + "'");
+		}
+		++p_;
+	}
+
+	void skip_ws() {
+		while(p_ != end_ && (*p_ == ' ' || *p_ == '\t' || *p_ == '\n' || *p_ == '\r')) {
+			++p_;
+		}
+	}
+
+	void emit(boost::string_view value) {
+		code_(boost::string_view { path_ }, value);
+	}
+
+	/** Adds a path component, returning the length to cut back to afterwards */
+	size_t push(boost::string_view part) {
+		auto mark = path_.size();
+		if(mark) {
+			path_ += '.';
+		}
+		path_.append(part.data(), part.size());
+		return mark;
+	}
+
+	void value(size_t depth) {
+		skip_ws();
+		switch(peek()) {
+		case '{': object(depth + 1); break;
+		case '[': array(depth + 1); break;
+		case '"': emit(string(value_)); break;
+		case 't': literal("true"); emit("true"); break;
+		case 'f': literal("false"); emit("false"); break;
+		case 'n': literal("null"); break;
+		default: emit(number()); break;
+		}
+	}
+
+	void object(size_t depth) {
+		if(depth > max_depth) {
+			fail("nested too deeply");
+		}
+		++p_;
+		skip_ws();
+		if(peek() == '}') {
+			++p_;
+			return;
+		}
+		for(;;) {
+			skip_ws();
+			if(peek() != '"') {
+				fail("expected a string key");
+			}
+			auto mark = push(string(key_));
+			skip_ws();
+			expect(':');
+			value(depth);
+			path_.resize(mark);
+			skip_ws();
+			if(peek() == ',') {
+				++p_;
+				continue;
+			}
+			expect('}');
+			return;
+		}
+	}
+
+	void array(size_t depth) {
+		if(depth > max_depth) {
+			fail("nested too deeply");
+		}
+		++p_;
+		skip_ws();
+		if(peek() == ']') {
+			++p_;
+			auto mark = path_.size();
+			path_ += "[]";
+			emit("");
+			path_.resize(mark);
+			return;
+		}
+		for(size_t i = 0; ; ++i) {
+			auto mark = push(std::to_string(i));
+			value(depth);
+			path_.resize(mark);
+			skip_ws();
+			if(peek() == ',') {
+				++p_;
+				continue;
+			}
+			expect(']');
+			return;
+		}
+	}
+
+	void literal(const char *word) {
+		auto len = std::char_traits<char>::length(word);
+		if(static_cast<size_t>(end_ - p_) < len || std::char_traits<char>::compare(p_, word, len) != 0) {
+			fail("unexpected token");
+		}
+		p_ += len;
+	}
+
+	boost::string_view number() {
+		auto start = p_;
+		if(p_ != end_ && *p_ == '-') ++p_;
+		if(p_ == end_ || !digit(*p_)) fail("expected a value");
+		if(*p_ == '0') {
+			++p_;
+		} else {
+			while(p_ != end_ && digit(*p_)) ++p_;
+		}
+		if(p_ != end_ && *p_ == '.') {
+			++p_;
+			if(p_ == end_ || !digit(*p_)) fail("expected a digit after the decimal point");
+			while(p_ != end_ && digit(*p_)) ++p_;
+		}
+		if(p_ != end_ && (*p_ == 'e' || *p_ == 'E')) {
+			++p_;
+			if(p_ != end_ && (*p_ == '+' || *p_ == '-')) ++p_;
+			if(p_ == end_ || !digit(*p_)) fail("expected a digit in the exponent");
+			while(p_ != end_ && digit(*p_)) ++p_;
+		}
+		return boost::string_view { start, static_cast<size_t>(p_ - start) };
+	}
+
+	static bool digit(char c) { return c >= '0' && c <= '9'; }
+
+	uint32_t hex4() {
+		if(end_ - p_ < 4) fail("truncated \\u escape");
+		uint32_t v = 0;
+		for(int i = 0; i < 4; ++i, ++p_) {
+			auto c = *p_;
+			v <<= 4;
+			if(c >= '0' && c <= '9') v |= static_cast<uint32_t>(c - '0');
+			else if(c >= 'a' && c <= 'f') v |= static_cast<uint32_t>(c - 'a' + 10);
+			else if(c >= 'A' && c <= 'F') v |= static_cast<uint32_t>(c - 'A' + 10);
+			else fail("bad \\u escape");
+		}
+		return v;
+	}
+
+	/**
+	 * Reads a string. When it has no escapes, the result points straight into
+	 * the input; otherwise it is decoded into scratch.
+	 */
+	boost::string_view string(std::string &scratch) {
+		++p_;
+		auto start = p_;
+		while(p_ != end_ && *p_ != '"' && *p_ != '\\') {
+			if(static_cast<unsigned char>(*p_) < 0x20) fail("control character in string");
+			++p_;
+		}
+		if(peek() == '"') {
+			return boost::string_view { start, static_cast<size_t>(p_++ - start) };
+		}
+		scratch.assign(start, p_);
+		for(;;) {
+			auto c = peek();
+			++p_;
+			if(c == '"') {
+				return boost::string_view { scratch };
+			}
+			if(static_cast<unsigned char>(c) < 0x20) {
+				fail("control character in string");
+			}
+			if(c != '\\') {
+				scratch += c;
+				continue;
+			}
+			switch(peek()) {
+			case '"': scratch += '"'; break;
+			case '\\': scratch += '\\'; break;
+			case '/': scratch += '/'; break;
+			case 'b': scratch += '\b'; break;
+			case 'f': scratch += '\f'; break;
+			case 'n': scratch += '\n'; break;
+			case 'r': scratch += '\r'; break;
+			case 't': scratch += '\t'; break;
+			case 'u': {
+				++p_;
+				auto cp = hex4();
+				if(cp >= 0xD800 && cp < 0xDC00) {
+					if(end_ - p_ < 2 || p_[0] != '\\' || p_[1] != 'u') fail("unpaired surrogate");
+					p_ += 2;
+					auto low = hex4();
+					if(low < 0xDC00 || low >= 0xE000) fail("unpaired surrogate");
+					cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+				}
+				append_utf8(scratch, cp);
+				continue;
+			}
+			default: fail("bad escape");
+			}
+			++p_;
+		}
+	}
+
+	const char *begin_;
+	const char *p_;
+	const char *end_;
+	const record_handler &code_;
+	/** Dotted path to the current value */
+	std::string path_;
+	std::string key_;
+	std::string value_;
+};
+
+}
+
+void
+appcon::detail::parse_json(boost::string_view text, const record_handler &code)
+{
+	json_parser { text, code }.parse();
+}
@@ -0,0 +1,137 @@
+#include <appcon/scan.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define APPCON_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+using namespace appcon::detail;
+
+namespace {
+
+line_marks scan_scalar(const char *p, const char *end) {
+	line_marks m { end, nullptr, nullptr };
+	for(; p != end; ++p) {
+		auto c = *p;
+		if(c == '\n') {
+			m.eol = p;
+			break;
+		}
+		if(c == '=' && !m.equals) m.equals = p;
+		if(c == '#' && !m.hash) m.hash = p;
+	}
+	if(!m.equals) m.equals = m.eol;
+	if(!m.hash) m.hash = m.eol;
+	return m;
+}
+
+/**
+ * Folds the match masks for one block of bytes into m.
+ * @returns true once the end of the line has been found
+ */
+template<typename Mask>
+inline bool take_block(const char *base, Mask nl, Mask eq, Mask hash, line_marks &m) {
+	if(nl) {
+		/* Only matches before the newline count */
+		auto below = static_cast<Mask>((nl & (~nl + 1)) - 1);
+		eq &= below;
+		hash &= below;
+	}
+	if(eq && !m.equals) m.equals = base + __builtin_ctz(eq);
+	if(hash && !m.hash) m.hash = base + __builtin_ctz(hash);
+	if(nl) {
+		m.eol = base + __builtin_ctz(nl);
+		return true;
+	}
+	return false;
+}
+
+/** Finishes off a line that the vector loop did not complete */
+line_marks scan_tail(const char *p, const char *end, line_marks m) {
+	auto rest = scan_scalar(p, end);
+	m.eol = rest.eol;
+	if(!m.equals) m.equals = rest.equals;
+	if(!m.hash) m.hash = rest.hash;
+	return m;
+}
+
+#ifdef APPCON_SCAN_X86
+
+__attribute__((target("sse2")))
+line_marks scan_sse2(const char *p, const char *end) {
+	line_marks m { end, nullptr, nullptr };
+	const auto nl = _mm_set1_epi8('\n');
+	const auto eq = _mm_set1_epi8('=');
+	const auto hash = _mm_set1_epi8('#');
+	for(; end - p >= 16; p += 16) {
+		auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+		auto nl_mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, nl)));
+		auto eq_mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, eq)));
+		auto hash_mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, hash)));
+		if(take_block(p, nl_mask, eq_mask, hash_mask, m)) {
+			if(!m.equals) m.equals = m.eol;
+			if(!m.hash) m.hash = m.eol;
+			return m;
+		}
+	}
+	return scan_tail(p, end, m);
+}
+
+__attribute__((target("avx2")))
+line_marks scan_avx2(const char *p, const char *end) {
+	line_marks m { end, nullptr, nullptr };
+	const auto nl = _mm256_set1_epi8('\n');
+	const auto eq = _mm256_set1_epi8('=');
+	const auto hash = _mm256_set1_epi8('#');
+	for(; end - p >= 32; p += 32) {
+		auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+		auto nl_mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, nl)));
+		auto eq_mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, eq)));
+		auto hash_mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, hash)));
+		if(take_block(p, nl_mask, eq_mask, hash_mask, m)) {
+			if(!m.equals) m.equals = m.eol;
+			if(!m.hash) m.hash = m.eol;
+			return m;
+		}
+	}
+	return scan_tail(p, end, m);
+}
+
+#endif
+
+line_scanner choose() {
+#ifdef APPCON_SCAN_X86
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2")) return scan_avx2;
+	if(__builtin_cpu_supports("sse2")) return scan_sse2;
+#endif
+	return scan_scalar;
+}
+
+}
+
+line_scanner
+appcon::detail::line_scanner_for(simd_level level)
+{
+	switch(level) {
+	case simd_level::scalar:
+		return scan_scalar;
+#ifdef APPCON_SCAN_X86
+	case simd_level::sse2:
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("sse2") ? scan_sse2 : nullptr;
+	case simd_level::avx2:
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2") ? scan_avx2 : nullptr;
+#endif
+	default:
+		return nullptr;
+	}
+}
+
+line_scanner
+appcon::detail::best_line_scanner()
+{
+	static const line_scanner best = choose();
+	return best;
+}
@@ -0,0 +1,199 @@
+#include <appcon/signal_reload.h>
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+#include <system_error>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <boost/log/trivial.hpp>
+
+using namespace appcon::detail;
+
+namespace {
+
+/**
+ * Everything the signal handler touches. Slots, and their pipes, live for
+ * the lifetime of the process, so the handler never writes to a descriptor
+ * that has been closed and reused.
+ */
+struct listener_slot {
+	std::atomic<int> signo;
+	std::atomic<uint64_t> received;
+	/** Monotonic time of the first signal not yet handled, or 0 */
+	std::atomic<int64_t> pending_since;
+	int fds[2];
+};
+
+const size_t max_listeners = 16;
+listener_slot slots[max_listeners];
+bool slot_used[max_listeners];
+int listeners_for[NSIG];
+struct sigaction previous[NSIG];
+std::mutex registry_mutex;
+
+int64_t monotonic_ns() {
+	timespec ts;
+	::clock_gettime(CLOCK_MONOTONIC, &ts);
+	return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+void on_signal(int signo, siginfo_t *info, void *context) {
+	auto saved = errno;
+	auto now = monotonic_ns();
+	for(auto &s : slots) {
+		if(s.signo.load(std::memory_order_acquire) != signo) {
+			continue;
+		}
+		s.received.fetch_add(1, std::memory_order_relaxed);
+		int64_t expected = 0;
+		s.pending_since.compare_exchange_strong(expected, now);
+		char one = 1;
+		/* A full pipe already has a wakeup waiting */
+		auto written = ::write(s.fds[1], &one, sizeof(one));
+		(void) written;
+	}
+	/* Chain to whatever handler was there before us, but never to the default action */
+	auto &prev = previous[signo];
+	if(prev.sa_flags & SA_SIGINFO) {
+		if(prev.sa_sigaction) {
+			prev.sa_sigaction(signo, info, context);
+		}
+	} else if(prev.sa_handler != SIG_DFL && prev.sa_handler != SIG_IGN) {
+		prev.sa_handler(signo);
+	}
+	errno = saved;
+}
+
+void drain(int fd) {
+	char buf[64];
+	while(::read(fd, buf, sizeof(buf)) > 0) { }
+}
+
+}
+
+signal_listener::signal_listener(
+	int signo,
+	std::function<void()> code
+):signo_{ signo },
+  slot_{ max_listeners },
+  code_(std::move(code)),
+  stopping_{ false }
+{
+	if(signo <= 0 || signo >= NSIG) {
+		throw std::invalid_argument("invalid signal number");
+	}
+	{
+		std::lock_guard<std::mutex> guard(registry_mutex);
+		for(size_t i = 0; i < max_listeners; ++i) {
+			if(!slot_used[i]) {
+				slot_ = i;
+				break;
+			}
+		}
+		if(slot_ == max_listeners) {
+			throw std::runtime_error("too many signal listeners");
+		}
+		auto &s = slots[slot_];
+		if(s.fds[0] == 0 && s.fds[1] == 0) {
+			if(::pipe(s.fds) != 0) {
+				throw std::system_error(errno, std::system_category(), "pipe");
+			}
+			for(auto f : s.fds) {
+				::fcntl(f, F_SETFL, ::fcntl(f, F_GETFL) | O_NONBLOCK);
+				::fcntl(f, F_SETFD, FD_CLOEXEC);
+			}
+		}
+		drain(s.fds[0]);
+		s.received = 0;
+		s.pending_since = 0;
+		if(listeners_for[signo] == 0) {
+			struct sigaction sa;
+			sa.sa_sigaction = on_signal;
+			sigemptyset(&sa.sa_mask);
+			sa.sa_flags = SA_SIGINFO | SA_RESTART;
+			if(::sigaction(signo, &sa, &previous[signo]) != 0) {
+				throw std::system_error(errno, std::system_category(), "sigaction");
+			}
+		}
+		++listeners_for[signo];
+		slot_used[slot_] = true;
+		s.signo.store(signo, std::memory_order_release);
+	}
+	thread_ = std::thread([this]() { run(); });
+}
+
+signal_listener::~signal_listener()
+{
+	auto &s = slots[slot_];
+	stopping_ = true;
+	char one = 1;
+	auto written = ::write(s.fds[1], &one, sizeof(one));
+	(void) written;
+	thread_.join();
+
+	std::lock_guard<std::mutex> guard(registry_mutex);
+	s.signo.store(0, std::memory_order_release);
+	if(--listeners_for[signo_] == 0) {
+		::sigaction(signo_, &previous[signo_], nullptr);
+	}
+	slot_used[slot_] = false;
+}
+
+appcon::reload_stats
+signal_listener::stats() const
+{
+	std::lock_guard<std::mutex> guard(mutex_);
+	auto r = stats_;
+	r.signals = slots[slot_].received.load(std::memory_order_relaxed);
+	return r;
+}
+
+void
+signal_listener::run()
+{
+	auto &s = slots[slot_];
+	pollfd pfd;
+	pfd.fd = s.fds[0];
+	pfd.events = POLLIN;
+	while(!stopping_) {
+		pfd.revents = 0;
+		if(::poll(&pfd, 1, -1) < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+			BOOST_LOG_TRIVIAL(error) << "Signal listener poll failed: " << std::strerror(errno);
+			return;
+		}
+		/* Everything that arrived up to now is handled by the one call */
+		drain(s.fds[0]);
+		if(stopping_) {
+			break;
+		}
+		auto since = s.pending_since.exchange(0);
+		if(!since) {
+			continue;
+		}
+		bool failed = false;
+		try {
+			code_();
+		} catch(const std::exception &ex) {
+			BOOST_LOG_TRIVIAL(error) << "Reload on signal " << signo_ << " failed: " << ex.what();
+			failed = true;
+		}
+		auto latency = std::chrono::nanoseconds { monotonic_ns() - since };
+		BOOST_LOG_TRIVIAL(info) << "Reloaded config on signal " << signo_ << " in " << latency.count() / 1000 << "us";
+		std::lock_guard<std::mutex> guard(mutex_);
+		++stats_.reloads;
+		if(failed) {
+			++stats_.failures;
+		}
+		stats_.last_latency = latency;
+		if(latency > stats_.max_latency) {
+			stats_.max_latency = latency;
+		}
+	}
+}
@@ -0,0 +1,78 @@
+#include <appcon/stream_reader.h>
+
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <boost/log/trivial.hpp>
+
+using namespace appcon::detail;
+
+stream_reader::stream_reader(
+	int fd,
+	handler code
+):fd_{ fd },
+  code_(std::move(code)),
+  finished_{ false }
+{
+	if(::pipe(stop_) != 0) {
+		throw std::system_error(errno, std::system_category(), "pipe");
+	}
+	for(auto f : stop_) {
+		::fcntl(f, F_SETFD, FD_CLOEXEC);
+	}
+	thread_ = std::thread([this]() { run(); });
+}
+
+stream_reader::~stream_reader()
+{
+	char one = 1;
+	auto written = ::write(stop_[1], &one, sizeof(one));
+	(void) written;
+	thread_.join();
+	::close(stop_[0]);
+	::close(stop_[1]);
+}
+
+void
+stream_reader::run()
+{
+	char buf[4096];
+	pollfd fds[2];
+	fds[0].fd = fd_;
+	fds[0].events = POLLIN;
+	fds[1].fd = stop_[0];
+	fds[1].events = POLLIN;
+	for(;;) {
+		fds[0].revents = fds[1].revents = 0;
+		if(::poll(fds, 2, -1) < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+			BOOST_LOG_TRIVIAL(error) << "Config stream poll failed: " << std::strerror(errno);
+			break;
+		}
+		if(fds[1].revents) {
+			return;
+		}
+		auto n = ::read(fd_, buf, sizeof(buf));
+		if(n < 0) {
+			if(errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) {
+				continue;
+			}
+			BOOST_LOG_TRIVIAL(error) << "Config stream read failed: " << std::strerror(errno);
+			break;
+		}
+		if(n == 0) {
+			tokenizer_.finish(code_);
+			break;
+		}
+		tokenizer_.feed(buf, static_cast<size_t>(n), code_);
+	}
+	if(tokenizer_.skipped()) {
+		BOOST_LOG_TRIVIAL(error) << "Config stream had " << tokenizer_.skipped() << " malformed or overlong lines";
+	}
+	finished_.store(true, std::memory_order_release);
+}
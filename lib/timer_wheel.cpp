@@ -0,0 +1,208 @@
+#include <appcon/timer_wheel.h>
+
+#include <exception>
+#include <boost/log/trivial.hpp>
+
+using namespace appcon::detail;
+
+timer_wheel::timer_wheel(
+):start_(clock::now()),
+  occupied_{ { } },
+  now_{ 0 },
+  next_id_{ 1 },
+  stopping_{ false }
+{
+	thread_ = std::thread([this]() { run(); });
+}
+
+timer_wheel::~timer_wheel()
+{
+	{
+		std::lock_guard<std::mutex> guard(mutex_);
+		stopping_ = true;
+	}
+	cv_.notify_all();
+	thread_.join();
+}
+
+uint64_t
+timer_wheel::tick_at(clock::time_point t, bool round_up) const
+{
+	if(t <= start_) {
+		return 0;
+	}
+	auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t - start_).count();
+	return static_cast<uint64_t>((round_up ? ns + 999999 : ns) / 1000000);
+}
+
+uint64_t
+timer_wheel::schedule(clock::time_point when, std::function<void()> code)
+{
+	uint64_t id;
+	{
+		std::lock_guard<std::mutex> guard(mutex_);
+		if(timers_.empty()) {
+			/* The wheel has been idle, so catch up with the clock */
+			auto current = tick_at(clock::now(), false);
+			if(current > now_) {
+				now_ = current;
+			}
+		}
+		id = next_id_++;
+		/* Rounded up, so that nothing fires early */
+		auto due = tick_at(when, true);
+		slot_type incoming;
+		incoming.push_back(timer { id, due < now_ ? now_ : due, std::move(code), 0, 0 });
+		auto it = incoming.begin();
+		timers_.emplace(id, it);
+		place(incoming, it);
+	}
+	cv_.notify_all();
+	return id;
+}
+
+bool
+timer_wheel::cancel(uint64_t id)
+{
+	std::lock_guard<std::mutex> guard(mutex_);
+	auto found = timers_.find(id);
+	if(found == timers_.end()) {
+		return false;
+	}
+	auto it = found->second;
+	auto &slot = wheel_[it->level][it->index];
+	if(slot.size() == 1) {
+		occupied_[it->level] &= ~(uint64_t { 1 } << it->index);
+	}
+	slot.erase(it);
+	timers_.erase(found);
+	return true;
+}
+
+size_t
+timer_wheel::pending() const
+{
+	std::lock_guard<std::mutex> guard(mutex_);
+	return timers_.size();
+}
+
+void
+timer_wheel::place(slot_type &from, slot_type::iterator t)
+{
+	/* The lowest level whose current span the due tick falls in */
+	unsigned level = 0;
+	uint64_t due = t->due;
+	while(level < levels && (due >> (slot_bits * (level + 1))) != (now_ >> (slot_bits * (level + 1)))) {
+		++level;
+	}
+	unsigned index;
+	if(level == levels) {
+		/* Too far out: wait in the top slot that comes round last, then try again */
+		level = levels - 1;
+		index = static_cast<unsigned>(((now_ >> (slot_bits * level)) + slots - 1) % slots);
+	} else {
+		index = static_cast<unsigned>((due >> (slot_bits * level)) % slots);
+	}
+	t->level = level;
+	t->index = index;
+	auto &slot = wheel_[level][index];
+	slot.splice(slot.end(), from, t);
+	occupied_[level] |= uint64_t { 1 } << index;
+}
+
+void
+timer_wheel::take(unsigned level, unsigned index, slot_type &out)
+{
+	out.splice(out.end(), wheel_[level][index]);
+	occupied_[level] &= ~(uint64_t { 1 } << index);
+}
+
+void
+timer_wheel::process(slot_type &ready)
+{
+	/* Higher levels first, since what they bring down may be due in a lower slot right now */
+	for(unsigned level = levels - 1; level > 0; --level) {
+		auto span = uint64_t { 1 } << (slot_bits * level);
+		if(now_ % span != 0) {
+			continue;
+		}
+		slot_type moving;
+		take(level, static_cast<unsigned>((now_ / span) % slots), moving);
+		while(!moving.empty()) {
+			place(moving, moving.begin());
+		}
+	}
+	auto before = ready.size();
+	take(0, static_cast<unsigned>(now_ % slots), ready);
+	auto it = ready.begin();
+	std::advance(it, before);
+	for(; it != ready.end(); ++it) {
+		timers_.erase(it->id);
+	}
+}
+
+uint64_t
+timer_wheel::next_tick() const
+{
+	uint64_t next = 0;
+	for(unsigned level = 0; level < levels; ++level) {
+		auto bits = occupied_[level];
+		if(!bits) {
+			continue;
+		}
+		auto shift = slot_bits * level;
+		auto current = static_cast<unsigned>((now_ >> shift) % slots);
+		auto base = (now_ >> (shift + slot_bits)) << (shift + slot_bits);
+		/* Slots at or after the current one come round in this turn of the level, the rest in the next */
+		auto later = bits & (~uint64_t { 0 } << current);
+		uint64_t t;
+		if(later) {
+			t = base + (static_cast<uint64_t>(__builtin_ctzll(later)) << shift);
+		} else {
+			t = base + (uint64_t { slots } << shift) + (static_cast<uint64_t>(__builtin_ctzll(bits)) << shift);
+		}
+		if(t < now_) {
+			t = now_;
+		}
+		if(!next || t < next) {
+			next = t;
+		}
+	}
+	return next;
+}
+
+void
+timer_wheel::run()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	while(!stopping_) {
+		auto next = next_tick();
+		if(!next && timers_.empty()) {
+			cv_.wait(lock);
+			continue;
+		}
+		auto current = tick_at(clock::now(), false);
+		if(next > current) {
+			cv_.wait_until(lock, start_ + std::chrono::milliseconds(next));
+			continue;
+		}
+		/* Nothing needs doing between here and the next occupied slot */
+		now_ = next;
+		slot_type ready;
+		process(ready);
+		++now_;
+		if(ready.empty()) {
+			continue;
+		}
+		lock.unlock();
+		for(auto &t : ready) {
+			try {
+				t.code();
+			} catch(const std::exception &ex) {
+				BOOST_LOG_TRIVIAL(error) << "Timer callback failed: " << ex.what();
+			}
+		}
+		ready.clear();
+		lock.lock();
+	}
+}
@@ -0,0 +1,465 @@
+#include <appcon/formats.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <stdexcept>
+#include <unordered_map>
+
+using namespace appcon::detail;
+
+namespace {
+
+/** Deeper documents are rejected rather than risking the stack */
+const size_t max_depth = 64;
+
+class toml_parser {
+public:
+	toml_parser(boost::string_view text, const record_handler &code)
+	 :begin_{ text.data() },
+	  p_{ text.data() },
+	  end_{ text.data() + text.size() },
+	  code_(code)
+	{
+	}
+
+	void parse() {
+		for(;;) {
+			skip_blank_lines();
+			if(p_ == end_) {
+				return;
+			}
+			if(*p_ == '[') {
+				header();
+			} else {
+				path_ = table_;
+				keyval(0);
+			}
+			end_of_line();
+		}
+	}
+
+private:
+	[[noreturn]] void fail(const std::string &msg) const {
+		auto line = 1 + std::count(begin_, p_, '\n');
+		throw std::runtime_error("TOML line " + std::to_string(line) + ": " + msg);
+	}
+
+	char peek() const {
+		if(p_ == end_) {
+			fail("unexpected end of input");
+		}
+		return *p_;
+	}
+
+	bool at(const char *s) const {
+		auto len = std::char_traits<char>::length(s);
+		return static_cast<size_t>(end_ - p_) >= len && std::char_traits<char>::compare(p_, s, len) == 0;
+	}
+
+	void expect(char c) {
+		if(peek() != c) {
+			fail(std::string { "expected '" } + c + "'");
+		}
+		++p_;
+	}
+
+	void skip_ws() {
+		while(p_ != end_ && (*p_ == ' ' || *p_ == '\t')) ++p_;
+	}
+
+	void skip_comment() {
+		if(p_ != end_ && *p_ == '#') {
+			while(p_ != end_ && *p_ != '\n') ++p_;
+		}
+	}
+
+	/** Skips whitespace, comments and newlines, as allowed between lines and inside arrays */
+	void skip_blank_lines() {
+		for(;;) {
+			skip_ws();
+			skip_comment();
+			if(p_ != end_ && (*p_ == '\n' || *p_ == '\r')) {
+				++p_;
+				continue;
+			}
+			return;
+		}
+	}
+
+	void end_of_line() {
+		skip_ws();
+		skip_comment();
+		if(p_ == end_) return;
+		if(*p_ == '\r') ++p_;
+		if(p_ == end_ || *p_ != '\n') fail("expected the end of the line");
+		++p_;
+	}
+
+	void emit(boost::string_view value) {
+		code_(boost::string_view { path_ }, value);
+	}
+
+	void push(boost::string_view part) {
+		if(!path_.empty()) {
+			path_ += '.';
+		}
+		path_.append(part.data(), part.size());
+	}
+
+	/** [table] or [[array of tables]] */
+	void header() {
+		bool array = at("[[");
+		p_ += array ? 2 : 1;
+		skip_ws();
+		path_.clear();
+		key();
+		path_ = resolve(path_);
+		skip_ws();
+		if(array) {
+			if(!at("]]")) fail("expected ']]'");
+			p_ += 2;
+			/* Each [[name]] starts a new element, keyed by its index */
+			auto index = array_tables_[path_]++;
+			push(std::to_string(index));
+		} else {
+			expect(']');
+		}
+		table_ = path_;
+	}
+
+	/**
+	 * Points a table path at the latest element of each array of tables it
+	 * passes through, so [fruit.physical] after [[fruit]] means fruit.N.physical
+	 */
+	std::string resolve(const std::string &path) const {
+		std::string out;
+		size_t pos = 0;
+		for(;;) {
+			auto dot = path.find('.', pos);
+			if(!out.empty()) out += '.';
+			out.append(path, pos, dot == std::string::npos ? std::string::npos : dot - pos);
+			if(dot == std::string::npos) return out;
+			auto it = array_tables_.find(out);
+			if(it != array_tables_.end()) {
+				out += '.';
+				out += std::to_string(it->second - 1);
+			}
+			pos = dot + 1;
+		}
+	}
+
+	/** Appends a dotted key to path_ */
+	void key() {
+		for(;;) {
+			skip_ws();
+			auto c = peek();
+			if(c == '"') {
+				++p_;
+				push(basic_string(key_));
+			} else if(c == '\'') {
+				++p_;
+				push(literal_string());
+			} else {
+				auto start = p_;
+				while(p_ != end_ && (std::isalnum(static_cast<unsigned char>(*p_)) || *p_ == '_' || *p_ == '-')) ++p_;
+				if(p_ == start) fail("expected a key");
+				push(boost::string_view { start, static_cast<size_t>(p_ - start) });
+			}
+			skip_ws();
+			if(p_ != end_ && *p_ == '.') {
+				++p_;
+				continue;
+			}
+			return;
+		}
+	}
+
+	/** key = value, relative to the current path_ */
+	void keyval(size_t depth) {
+		auto mark = path_.size();
+		key();
+		skip_ws();
+		expect('=');
+		skip_ws();
+		value(depth);
+		path_.resize(mark);
+	}
+
+	void value(size_t depth) {
+		if(depth > max_depth) {
+			fail("nested too deeply");
+		}
+		auto c = peek();
+		if(c == '"') {
+			if(at("\"\"\"")) {
+				p_ += 3;
+				emit(multiline_basic_string());
+			} else {
+				++p_;
+				emit(basic_string(value_));
+			}
+		} else if(c == '\'') {
+			if(at("'''")) {
+				p_ += 3;
+				emit(multiline_literal_string());
+			} else {
+				++p_;
+				emit(literal_string());
+			}
+		} else if(c == '[') {
+			array(depth + 1);
+		} else if(c == '{') {
+			inline_table(depth + 1);
+		} else if(at("true")) {
+			p_ += 4;
+			emit("true");
+		} else if(at("false")) {
+			p_ += 5;
+			emit("false");
+		} else {
+			scalar();
+		}
+	}
+
+	void array(size_t depth) {
+		++p_;
+		for(size_t i = 0; ; ++i) {
+			skip_blank_lines();
+			if(peek() == ']') {
+				++p_;
+				if(i == 0) {
+					auto mark = path_.size();
+					path_ += "[]";
+					emit("");
+					path_.resize(mark);
+				}
+				return;
+			}
+			auto mark = path_.size();
+			push(std::to_string(i));
+			value(depth);
+			path_.resize(mark);
+			skip_blank_lines();
+			if(peek() == ',') {
+				++p_;
+				continue;
+			}
+			expect(']');
+			return;
+		}
+	}
+
+	void inline_table(size_t depth) {
+		++p_;
+		skip_ws();
+		if(peek() == '}') {
+			++p_;
+			return;
+		}
+		for(;;) {
+			skip_ws();
+			keyval(depth);
+			skip_ws();
+			if(peek() == ',') {
+				++p_;
+				continue;
+			}
+			expect('}');
+			return;
+		}
+	}
+
+	/** Numbers, dates and times: everything up to the next delimiter */
+	void scalar() {
+		auto start = p_;
+		while(p_ != end_) {
+			auto c = *p_;
+			if(c == ',' || c == ']' || c == '}' || c == '#' || c == '\n' || c == '\r') break;
+			/* A space is only part of the value between a date and a time */
+			if((c == ' ' || c == '\t') && !(p_ - start == 10 && p_ + 1 != end_ && std::isdigit(static_cast<unsigned char>(p_[1])))) break;
+			++p_;
+		}
+		auto raw = boost::string_view { start, static_cast<size_t>(p_ - start) };
+		if(raw.empty()) fail("expected a value");
+		if(raw.size() >= 10 && raw[4] == '-' && raw[7] == '-') {
+			emit(raw);
+			return;
+		}
+		if(raw.size() >= 8 && raw[2] == ':') {
+			emit(raw);
+			return;
+		}
+		number(raw);
+	}
+
+	void number(boost::string_view raw) {
+		if(raw == "inf" || raw == "+inf" || raw == "-inf" || raw == "nan" || raw == "+nan" || raw == "-nan") {
+			emit(raw.front() == '+' ? raw.substr(1) : raw);
+			return;
+		}
+		value_.clear();
+		auto s = raw;
+		if(s.front() == '+') s.remove_prefix(1);
+		int base = 10;
+		if(s.size() > 2 && s[0] == '0' && (s[1] == 'x' || s[1] == 'o' || s[1] == 'b')) {
+			base = s[1] == 'x' ? 16 : s[1] == 'o' ? 8 : 2;
+			s.remove_prefix(2);
+		}
+		char prev = 0;
+		for(auto c : s) {
+			if(c == '_') {
+				if(!std::isalnum(static_cast<unsigned char>(prev))) fail("misplaced underscore in number");
+			} else {
+				value_ += c;
+			}
+			prev = c;
+		}
+		if(value_.empty() || prev == '_') fail("bad number");
+		if(base == 10) {
+			for(auto c : value_) {
+				if(!std::isdigit(static_cast<unsigned char>(c)) && c != '-' && c != '.' && c != 'e' && c != 'E' && c != '+') {
+					fail("bad number");
+				}
+			}
+			emit(value_);
+			return;
+		}
+		errno = 0;
+		char *end = nullptr;
+		auto v = std::strtoull(value_.c_str(), &end, base);
+		if(errno || *end) fail("bad number");
+		value_ = std::to_string(v);
+		emit(value_);
+	}
+
+	uint32_t hex(int digits) {
+		if(end_ - p_ < digits) fail("truncated unicode escape");
+		uint32_t v = 0;
+		for(int i = 0; i < digits; ++i, ++p_) {
+			auto c = *p_;
+			v <<= 4;
+			if(c >= '0' && c <= '9') v |= static_cast<uint32_t>(c - '0');
+			else if(c >= 'a' && c <= 'f') v |= static_cast<uint32_t>(c - 'a' + 10);
+			else if(c >= 'A' && c <= 'F') v |= static_cast<uint32_t>(c - 'A' + 10);
+			else fail("bad unicode escape");
+		}
+		return v;
+	}
+
+	/** Handles the escape after a backslash */
+	void escape(std::string &out) {
+		auto c = peek();
+		++p_;
+		switch(c) {
+		case '"': out += '"'; break;
+		case '\\': out += '\\'; break;
+		case 'b': out += '\b'; break;
+		case 'f': out += '\f'; break;
+		case 'n': out += '\n'; break;
+		case 'r': out += '\r'; break;
+		case 't': out += '\t'; break;
+		case 'e': out += '\x1B'; break;
+		case 'u': append_utf8(out, hex(4)); break;
+		case 'U': append_utf8(out, hex(8)); break;
+		default: fail("bad escape");
+		}
+	}
+
+	/** After the opening quote. Points into the input unless there are escapes. */
+	boost::string_view basic_string(std::string &scratch) {
+		auto start = p_;
+		while(p_ != end_ && *p_ != '"' && *p_ != '\\' && *p_ != '\n') ++p_;
+		if(peek() == '"') {
+			return boost::string_view { start, static_cast<size_t>(p_++ - start) };
+		}
+		scratch.assign(start, p_);
+		for(;;) {
+			auto c = peek();
+			if(c == '\n') fail("newline in string");
+			++p_;
+			if(c == '"') return boost::string_view { scratch };
+			if(c == '\\') {
+				escape(scratch);
+			} else {
+				scratch += c;
+			}
+		}
+	}
+
+	boost::string_view literal_string() {
+		auto start = p_;
+		while(p_ != end_ && *p_ != '\'' && *p_ != '\n') ++p_;
+		if(peek() != '\'') fail("unterminated string");
+		return boost::string_view { start, static_cast<size_t>(p_++ - start) };
+	}
+
+	/** Skips the newline straight after an opening delimiter, as TOML requires */
+	void skip_leading_newline() {
+		if(at("\r\n")) p_ += 2;
+		else if(p_ != end_ && *p_ == '\n') ++p_;
+	}
+
+	boost::string_view multiline_basic_string() {
+		skip_leading_newline();
+		value_.clear();
+		for(;;) {
+			if(at("\"\"\"")) {
+				p_ += 3;
+				/* Up to two more quotes belong to the content */
+				for(int i = 0; i < 2 && p_ != end_ && *p_ == '"'; ++i, ++p_) value_ += '"';
+				return boost::string_view { value_ };
+			}
+			auto c = peek();
+			++p_;
+			if(c != '\\') {
+				value_ += c;
+				continue;
+			}
+			/* A backslash at the end of a line trims the whitespace that follows */
+			auto q = p_;
+			while(q != end_ && (*q == ' ' || *q == '\t')) ++q;
+			if(q != end_ && (*q == '\n' || *q == '\r')) {
+				p_ = q;
+				while(p_ != end_ && (*p_ == ' ' || *p_ == '\t' || *p_ == '\n' || *p_ == '\r')) ++p_;
+				continue;
+			}
+			escape(value_);
+		}
+	}
+
+	boost::string_view multiline_literal_string() {
+		skip_leading_newline();
+		auto start = p_;
+		while(!at("'''")) {
+			peek();
+			++p_;
+		}
+		auto stop = p_;
+		p_ += 3;
+		for(int i = 0; i < 2 && p_ != end_ && *p_ == '\''; ++i) ++p_, ++stop;
+		return boost::string_view { start, static_cast<size_t>(stop - start) };
+	}
+
+	const char *begin_;
+	const char *p_;
+	const char *end_;
+	const record_handler &code_;
+	/** Dotted path to the current value */
+	std::string path_;
+	/** Path of the current [table] */
+	std::string table_;
+	/** Number of elements seen so far in each [[array of tables]] */
+	std::unordered_map<std::string, size_t> array_tables_;
+	std::string key_;
+	std::string value_;
+};
+
+}
+
+void
+appcon::detail::parse_toml(boost::string_view text, const record_handler &code)
+{
+	toml_parser { text, code }.parse();
+}
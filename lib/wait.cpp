@@ -0,0 +1,86 @@
+#include <appcon/wait.h>
+
+#ifdef __linux__
+#include <climits>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#endif
+
+using namespace appcon::detail;
+
+#ifdef __linux__
+
+namespace {
+
+/** std::atomic<uint32_t> is a plain 32-bit word, which is exactly what the futex calls want */
+int *futex_word(const std::atomic<uint32_t> &word) {
+	return reinterpret_cast<int *>(const_cast<std::atomic<uint32_t> *>(&word));
+}
+
+}
+
+void
+appcon::detail::wait_on(const std::atomic<uint32_t> &word, uint32_t expected, std::chrono::steady_clock::time_point deadline)
+{
+	auto remaining = deadline - std::chrono::steady_clock::now();
+	if(remaining <= std::chrono::steady_clock::duration::zero()) {
+		return;
+	}
+	auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(remaining).count();
+	timespec ts;
+	ts.tv_sec = static_cast<time_t>(ns / 1000000000);
+	ts.tv_nsec = static_cast<long>(ns % 1000000000);
+	::syscall(SYS_futex, futex_word(word), FUTEX_WAIT_PRIVATE, static_cast<int>(expected), &ts, nullptr, 0);
+}
+
+void
+appcon::detail::wake_all(const std::atomic<uint32_t> &word)
+{
+	::syscall(SYS_futex, futex_word(word), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+}
+
+#else
+
+namespace {
+
+/** Waiters are spread over a few buckets, so a change only wakes threads that hash alike */
+struct bucket {
+	std::mutex mutex;
+	std::condition_variable cv;
+};
+
+bucket &bucket_for(const void *p) {
+	static bucket buckets[64];
+	return buckets[std::hash<const void *>()(p) % 64];
+}
+
+}
+
+void
+appcon::detail::wait_on(const std::atomic<uint32_t> &word, uint32_t expected, std::chrono::steady_clock::time_point deadline)
+{
+	auto &b = bucket_for(&word);
+	std::unique_lock<std::mutex> lock(b.mutex);
+	if(word.load() != expected) {
+		return;
+	}
+	b.cv.wait_until(lock, deadline);
+}
+
+void
+appcon::detail::wake_all(const std::atomic<uint32_t> &word)
+{
+	auto &b = bucket_for(&word);
+	{
+		std::lock_guard<std::mutex> guard(b.mutex);
+	}
+	b.cv.notify_all();
+}
+
+#endif
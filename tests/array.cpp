@@ -0,0 +1,136 @@
+/**
+ * @file
+ */
+#include "catch.hpp"
+#include <cstdlib>
+#include <fstream>
+#include <vector>
+#include <appcon.h>
+#include "cfgmaker.h"
+
+using namespace appcon;
+
+namespace {
+
+template<typename T>
+std::vector<T> values(const pinned<view> &s, const std::string &k) {
+	auto a = s->array<T>(k);
+	return std::vector<T>(a.begin(), a.end());
+}
+
+}
+
+SCENARIO("array parsing", "[array]") {
+	GIVEN("a uint16_t list type") {
+		detail::array_type<uint16_t> t;
+		auto parse = [&t](const char *text) {
+			auto v = t.parse(text);
+			return static_cast<const parsed<std::vector<uint16_t>> &>(*v).get();
+		};
+		THEN("commas, blanks and brackets are understood") {
+			CHECK(parse("1,2,3") == (std::vector<uint16_t> { 1, 2, 3 }));
+			CHECK(parse(" [ 80, 443 ] ") == (std::vector<uint16_t> { 80, 443 }));
+			CHECK(parse("").empty());
+			CHECK(parse("[]").empty());
+		}
+		THEN("bad elements are rejected") {
+			CHECK_THROWS_AS(parse("1,,2"), const std::invalid_argument &);
+			CHECK_THROWS_AS(parse("1,2,"), const std::invalid_argument &);
+			CHECK_THROWS_AS(parse("[1,2"), const std::invalid_argument &);
+			CHECK_THROWS_AS(parse("1,70000"), const std::out_of_range &);
+		}
+		THEN("values are written back in canonical form") {
+			CHECK(t.format(*t.parse("[ 1, 2 ]")) == "1,2");
+		}
+	}
+}
+
+SCENARIO("array config values", "[array]") {
+	GIVEN("a config object with list keys") {
+		auto cfg = make_config();
+		(*cfg)
+			("cpus", std::vector<uint16_t> { 0, 1 }, "CPU affinity")
+			("weights", std::vector<float> { }, "shard weights")
+			("port", uint16_t { 80 }, "not a list")
+		;
+		THEN("the defaults are available") {
+			CHECK(values<uint16_t>(cfg->snapshot(), "cpus") == (std::vector<uint16_t> { 0, 1 }));
+			CHECK(cfg->snapshot()->array<float>("weights").empty());
+			CHECK(cfg->key("cpus", std::string { "0,1" }) == "0,1");
+		}
+		THEN("asking for the wrong element type gives nothing") {
+			CHECK(cfg->snapshot()->array<uint32_t>("cpus").empty());
+			CHECK(cfg->snapshot()->array<uint32_t>("missing").empty());
+		}
+		WHEN("we set one from text") {
+			auto before = cfg->snapshot();
+			auto old = before->array<uint16_t>("cpus");
+			cfg->set("cpus", std::string { "4,5,6,7" }, "test");
+			THEN("new snapshots see the new list") {
+				CHECK(values<uint16_t>(cfg->snapshot(), "cpus") == (std::vector<uint16_t> { 4, 5, 6, 7 }));
+			}
+			THEN("spans from the old snapshot are untouched") {
+				REQUIRE(old.size() == 2);
+				CHECK(old[0] == 0);
+				CHECK(old[1] == 1);
+			}
+		}
+		WHEN("we pass lists on the commandline") {
+			const char *argv[] { "test", "--cpus=2,3", "--weights=[0.5, 0.25]" };
+			cfg->from_args(3, argv);
+			THEN("they are parsed") {
+				CHECK(values<uint16_t>(cfg->snapshot(), "cpus") == (std::vector<uint16_t> { 2, 3 }));
+				CHECK(values<float>(cfg->snapshot(), "weights") == (std::vector<float> { 0.5f, 0.25f }));
+			}
+		}
+		WHEN("we pass a list in the environment") {
+			setenv("APPCON_ARRAY_CPUS", "8, 9", 1);
+			cfg->from_environment("APPCON_ARRAY");
+			unsetenv("APPCON_ARRAY_CPUS");
+			THEN("it is parsed") {
+				CHECK(values<uint16_t>(cfg->snapshot(), "cpus") == (std::vector<uint16_t> { 8, 9 }));
+			}
+		}
+		WHEN("we load lists from files") {
+			{
+				std::ofstream out { "config-array-test.ini" };
+				out << "cpus = [10, 11]\n";
+			}
+			{
+				std::ofstream out { "config-array-test.json" };
+				out << "{ \"weights\": [1.5, 2] }\n";
+			}
+			{
+				std::ofstream out { "config-array-test.toml" };
+				out << "cpus = [ 12, 13, 14 ]\n";
+			}
+			cfg->from_file("config-array-test.ini");
+			cfg->from_file("config-array-test.json");
+			THEN("INI and JSON lists are parsed") {
+				CHECK(values<uint16_t>(cfg->snapshot(), "cpus") == (std::vector<uint16_t> { 10, 11 }));
+				CHECK(values<float>(cfg->snapshot(), "weights") == (std::vector<float> { 1.5f, 2.0f }));
+			}
+			THEN("TOML arrays are parsed") {
+				cfg->from_file("config-array-test.toml");
+				CHECK(values<uint16_t>(cfg->snapshot(), "cpus") == (std::vector<uint16_t> { 12, 13, 14 }));
+			}
+			AND_WHEN("the files are changed to empty lists") {
+				{
+					std::ofstream out { "config-array-test.json" };
+					out << "{ \"cpus\": [], \"port\": [] }\n";
+				}
+				{
+					std::ofstream out { "config-array-test.toml" };
+					out << "weights = []\n";
+				}
+				cfg->from_file("config-array-test.toml");
+				cfg->reload();
+				THEN("the lists are cleared, and empty arrays for other keys are ignored") {
+					CHECK(cfg->snapshot()->array<uint16_t>("cpus").empty());
+					CHECK(cfg->snapshot()->array<float>("weights").empty());
+					CHECK(cfg->key("port", uint16_t { 0 }) == 80);
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,89 @@
+/**
+ * @file
+ */
+#include "catch.hpp"
+#include <atomic>
+#include <fstream>
+#include <appcon.h>
+#include "cfgmaker.h"
+
+using namespace appcon;
+
+SCENARIO("asynchronous reload", "[async]") {
+	GIVEN("a config object reading from a file") {
+		auto cfg = make_config();
+		(*cfg)
+			("host", std::string { "localhost" }, "server host")
+			("port", uint16_t { 80 }, "server port")
+		;
+		std::string filename { "config-async-test.ini" };
+		{
+			std::ofstream out { filename, std::ios::out | std::ios::binary };
+			out << "host = example.com\nport = 81\n";
+		}
+		cfg->from_file(filename);
+		REQUIRE(cfg->key("port", uint16_t { 0 }) == 81);
+		WHEN("the file changes and we reload in the background") {
+			{
+				std::ofstream out { filename, std::ios::out | std::ios::binary };
+				out << "host = example.org\nport = 8080\n";
+			}
+			auto before = cfg->generation();
+			std::atomic<bool> called { false };
+			std::atomic<bool> failed { false };
+			auto result = cfg->reload_async([&](std::exception_ptr ex) {
+				failed = static_cast<bool>(ex);
+				called = true;
+			});
+			auto generation = result.get();
+			THEN("the new values are published together in one generation") {
+				CHECK(called);
+				CHECK(!failed);
+				CHECK(generation == before + 1);
+				CHECK(cfg->generation() == generation);
+				auto snap = cfg->snapshot();
+				CHECK(snap->key("host", std::string { "" }) == "example.org");
+				CHECK(snap->key("port", uint16_t { 0 }) == 8080);
+			}
+		}
+		WHEN("something else is set before the future is ready") {
+			{
+				std::ofstream out { filename, std::ios::out | std::ios::binary };
+				out << "host = example.net\nport = 82\n";
+			}
+			auto before = cfg->generation();
+			auto result = cfg->reload_async([&cfg](std::exception_ptr) {
+				cfg->set("host", std::string { "elsewhere" }, "test");
+			});
+			auto generation = result.get();
+			THEN("the future still holds the reload's own generation") {
+				CHECK(generation == before + 1);
+				CHECK(cfg->generation() == before + 2);
+			}
+		}
+		WHEN("several reloads are requested at once") {
+			auto first = cfg->reload_async();
+			auto second = cfg->reload_async();
+			THEN("they finish in order") {
+				auto a = first.get();
+				auto b = second.get();
+				CHECK(a <= b);
+			}
+		}
+		WHEN("the file cannot be parsed") {
+			{
+				std::ofstream out { filename, std::ios::out | std::ios::binary };
+				out << "port = not a number\n";
+			}
+			std::atomic<bool> failed { false };
+			auto result = cfg->reload_async([&](std::exception_ptr ex) {
+				failed = static_cast<bool>(ex);
+			});
+			THEN("the future and the callback both see the error, and nothing is published") {
+				CHECK_THROWS(result.get());
+				CHECK(failed);
+				CHECK(cfg->key("port", uint16_t { 0 }) == 81);
+			}
+		}
+	}
+}
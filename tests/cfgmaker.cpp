@@ -11,3 +11,11 @@ make_config()
 }
 
 
+
+std::shared_ptr<appcon::config>
+make_config(boost::container::pmr::memory_resource *memory)
+{
+	return std::static_pointer_cast<appcon::config>(
+		std::make_shared<appcon::detail::config>(memory)
+	);
+}
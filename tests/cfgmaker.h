@@ -1,2 +1,5 @@
+#include <boost/container/pmr/memory_resource.hpp>
+
 std::shared_ptr<appcon::config> make_config();
+std::shared_ptr<appcon::config> make_config(boost::container::pmr::memory_resource *memory);
 
@@ -0,0 +1,77 @@
+/**
+ * @file
+ */
+#include "catch.hpp"
+#include <vector>
+#include <appcon.h>
+#include "cfgmaker.h"
+
+using namespace appcon;
+
+SCENARIO("change log", "[changelog]") {
+	GIVEN("a config object with a change log") {
+		auto cfg = make_config();
+		(*cfg)
+			("limit", uint32_t { 1 }, "a limit")
+			("name", std::string { "first" }, "a name")
+		;
+		cfg->change_log(8);
+		change_cursor cursor { cfg->generation() };
+		WHEN("a few values change") {
+			cfg->set("limit", uint32_t { 2 }, "manual");
+			cfg->set("name", std::string { "second" }, "api");
+			std::vector<change> seen;
+			auto count = cfg->read_changes(cursor, [&seen](const change &c) { seen.push_back(c); });
+			THEN("we get each change in order") {
+				CHECK(!cursor.overflow);
+				REQUIRE(count == 2);
+				CHECK(seen[0].key == "limit");
+				CHECK(seen[0].old_value == "1");
+				CHECK(seen[0].new_value == "2");
+				CHECK(seen[0].source == "manual");
+				CHECK(seen[1].key == "name");
+				CHECK(seen[1].old_value == "first");
+				CHECK(seen[1].new_value == "second");
+				CHECK(seen[1].generation > seen[0].generation);
+				CHECK(seen[0].key_id != seen[1].key_id);
+				CHECK(cursor.generation == cfg->generation());
+			}
+			AND_WHEN("we read again with nothing new") {
+				cfg->read_changes(cursor, [](const change &) { });
+				auto again = cfg->read_changes(cursor, [](const change &) { });
+				THEN("nothing is delivered") {
+					CHECK(again == 0);
+					CHECK(!cursor.overflow);
+				}
+			}
+		}
+		WHEN("more changes happen than the log can hold") {
+			for(uint32_t i = 0; i < 20; ++i) {
+				cfg->set("limit", i, "manual");
+			}
+			size_t count = 0;
+			cfg->read_changes(cursor, [&count](const change &) { ++count; });
+			THEN("we are told the cursor fell behind") {
+				CHECK(cursor.overflow);
+				CHECK(count == 0);
+			}
+			AND_WHEN("we catch up from a fresh cursor") {
+				change_cursor fresh { cfg->generation() - 4 };
+				std::vector<change> seen;
+				cfg->read_changes(fresh, [&seen](const change &c) { seen.push_back(c); });
+				THEN("we see only the retained tail") {
+					CHECK(!fresh.overflow);
+					REQUIRE(seen.size() == 4);
+					CHECK(seen.back().new_value == "19");
+				}
+			}
+		}
+		WHEN("we read from before the log was started") {
+			change_cursor early { 0 };
+			cfg->read_changes(early, [](const change &) { });
+			THEN("that counts as an overflow") {
+				CHECK(early.overflow);
+			}
+		}
+	}
+}
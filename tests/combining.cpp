@@ -0,0 +1,78 @@
+/**
+ * @file
+ */
+#include "catch.hpp"
+#include <future>
+#include <thread>
+#include <vector>
+#include <appcon.h>
+#include "cfgmaker.h"
+
+using namespace appcon;
+
+SCENARIO("write-combining updates", "[combining]") {
+	GIVEN("a config object with write combining enabled") {
+		auto cfg = make_config();
+		(*cfg)
+			("counter", uint32_t { 0 }, "updated by many threads")
+			("name", std::string { "default" }, "updated once")
+		;
+		cfg->write_combining(true);
+		WHEN("we set a value and flush") {
+			auto before = cfg->generation();
+			cfg->set("name", std::string { "updated" }, "manual");
+			cfg->flush();
+			THEN("the value is applied and published") {
+				CHECK(cfg->key("name", std::string { "default" }) == "updated");
+				CHECK(cfg->generation() > before);
+			}
+		}
+		WHEN("several threads write to the same key while the applier is busy") {
+			/* A watcher that holds the applier, so every write below has to queue up behind it */
+			std::promise<void> entered;
+			std::promise<void> release;
+			auto resume = release.get_future().share();
+			cfg->watch("name", std::string { }, [&entered, resume](std::string v, std::string) {
+				if(v == "block") {
+					entered.set_value();
+					resume.wait();
+				}
+			});
+			uint32_t seen = 0;
+			cfg->watch("counter", uint32_t { 0 }, [&seen](uint32_t v, uint32_t) {
+				seen = v;
+			});
+			cfg->set("name", std::string { "block" }, "manual");
+			entered.get_future().wait();
+			auto before = cfg->generation();
+			std::vector<std::thread> threads;
+			for(uint32_t t = 0; t < 4; ++t) {
+				threads.emplace_back([cfg, t]() {
+					for(uint32_t i = 0; i < 1000; ++i) {
+						cfg->set("counter", t * 1000 + i, "thread");
+					}
+				});
+			}
+			for(auto &t : threads) {
+				t.join();
+			}
+			/* Make the last write deterministic */
+			cfg->set("counter", uint32_t { 99999 }, "manual");
+			release.set_value();
+			cfg->flush();
+			THEN("all 4001 writes are combined into a single generation, and the last one wins") {
+				CHECK(cfg->key("counter", uint32_t { 0 }) == 99999);
+				CHECK(seen == 99999);
+				CHECK(cfg->generation() == before + 1);
+			}
+		}
+		WHEN("we switch write combining off again") {
+			cfg->set("name", std::string { "queued" }, "manual");
+			cfg->write_combining(false);
+			cfg->set("name", std::string { "direct" }, "manual");
+			THEN("set() applies immediately") {
+				CHECK(cfg->key("name", std::string { "default" }) == "direct");
+			}
+		}
+	}
+}
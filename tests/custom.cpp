@@ -0,0 +1,102 @@
+/**
+ * @file
+ */
+#include "catch.hpp"
+#include <chrono>
+#include <fstream>
+#include <appcon.h>
+#include <appcon/numeric.h>
+#include "cfgmaker.h"
+
+using namespace appcon;
+
+namespace {
+
+int parse_calls = 0;
+
+/** Durations written as a number followed by ms or s */
+std::chrono::milliseconds parse_duration(boost::string_view text) {
+	++parse_calls;
+	if(text.ends_with("ms")) {
+		return std::chrono::milliseconds { detail::parse_number<int64_t>(text.substr(0, text.size() - 2)) };
+	}
+	if(text.ends_with("s")) {
+		return std::chrono::seconds { detail::parse_number<int64_t>(text.substr(0, text.size() - 1)) };
+	}
+	throw std::invalid_argument("expected a duration such as 250ms, not " + text.to_string());
+}
+
+std::string format_duration(const std::chrono::milliseconds &d) {
+	return std::to_string(d.count()) + "ms";
+}
+
+}
+
+SCENARIO("registered value types", "[custom]") {
+	GIVEN("a config object with a duration key") {
+		auto cfg = make_config();
+		cfg->register_type<std::chrono::milliseconds>("duration", parse_duration, format_duration);
+		cfg->define("timeout", "duration", "2s", "Request timeout");
+		THEN("the default is parsed and shown in canonical form") {
+			CHECK(cfg->typed<std::chrono::milliseconds>("timeout")->get() == std::chrono::milliseconds { 2000 });
+			CHECK(cfg->key("timeout", std::string { }) == "2000ms");
+		}
+		WHEN("we set it from text") {
+			parse_calls = 0;
+			cfg->set("timeout", std::string { "250ms" }, "test");
+			THEN("it is parsed once, however often it is read") {
+				for(int i = 0; i < 10; ++i) {
+					CHECK(cfg->typed<std::chrono::milliseconds>("timeout")->get().count() == 250);
+				}
+				CHECK(parse_calls == 1);
+			}
+			THEN("snapshots keep the parsed value they were taken with") {
+				auto s = cfg->snapshot();
+				cfg->set("timeout", std::string { "1s" }, "test");
+				CHECK(std::chrono::milliseconds { 250 } == static_cast<const parsed<std::chrono::milliseconds> &>(*s->typed("timeout")).get());
+				CHECK(cfg->typed<std::chrono::milliseconds>("timeout")->get().count() == 1000);
+			}
+		}
+		WHEN("we set an invalid value") {
+			THEN("the set is rejected and the old value stays") {
+				CHECK_THROWS_AS(cfg->set("timeout", std::string { "soon" }, "test"), const std::invalid_argument &);
+				CHECK(cfg->typed<std::chrono::milliseconds>("timeout")->get().count() == 2000);
+			}
+		}
+		WHEN("we ask for the wrong type") {
+			THEN("the cast is refused") {
+				CHECK_THROWS_AS(cfg->typed<int>("timeout"), const std::bad_cast &);
+			}
+		}
+		WHEN("we load it from a file") {
+			{
+				std::ofstream out { "config-custom-test.ini" };
+				out << "timeout = 5s\n";
+			}
+			parse_calls = 0;
+			cfg->from_file("config-custom-test.ini");
+			THEN("the loader parses it once") {
+				CHECK(cfg->typed<std::chrono::milliseconds>("timeout")->get().count() == 5000);
+				CHECK(cfg->key("timeout", std::string { }) == "5000ms");
+				CHECK(parse_calls == 1);
+			}
+		}
+		WHEN("a watcher is attached") {
+			std::string seen;
+			auto w = cfg->watch("timeout", std::string { }, [&seen](std::string v, std::string) { seen = v; });
+			cfg->set("timeout", std::string { "3s" }, "test");
+			THEN("it sees the canonical text") {
+				CHECK(seen == "3000ms");
+			}
+		}
+	}
+	GIVEN("a config object with no registered types") {
+		auto cfg = make_config();
+		THEN("defining a key of an unknown type fails") {
+			CHECK_THROWS_AS(cfg->define("timeout", "duration", "2s", "Request timeout"), const std::invalid_argument &);
+		}
+		THEN("keys without a value have no parsed value") {
+			CHECK(!cfg->typed("missing"));
+		}
+	}
+}
@@ -0,0 +1,131 @@
+/**
+ * @file
+ */
+#include "catch.hpp"
+#include <fstream>
+#include <appcon.h>
+#include <appcon/interpolate.h>
+#include "cfgmaker.h"
+
+using namespace appcon;
+
+SCENARIO("interpolating text", "[derived]") {
+	GIVEN("text with references") {
+		auto lookup = [](const std::string &k) { return "<" + k + ">"; };
+		THEN("each reference is replaced") {
+			CHECK(detail::interpolate("${a}/x/${b}", lookup) == "<a>/x/<b>");
+			CHECK(detail::interpolate("plain", lookup) == "plain");
+			CHECK(detail::interpolate("open ${a", lookup) == "open ${a");
+		}
+		THEN("references are listed once each") {
+			CHECK(detail::references("${a}${b}${a}") == (std::vector<std::string> { "a", "b" }));
+		}
+	}
+}
+
+SCENARIO("interpolated values", "[derived]") {
+	GIVEN("a config object with paths") {
+		auto cfg = make_config();
+		(*cfg)
+			("data_dir", std::string { "/var/lib/app" }, "data directory")
+			("cache_dir", std::string { "${data_dir}/cache" }, "cache directory")
+			("index", std::string { "${cache_dir}/index" }, "index file")
+			("port", uint16_t { 80 }, "port")
+		;
+		THEN("defaults are expanded") {
+			CHECK(cfg->key("cache_dir", std::string { "${data_dir}/cache" }) == "/var/lib/app/cache");
+			CHECK(cfg->key("index", std::string { "${cache_dir}/index" }) == "/var/lib/app/cache/index");
+		}
+		WHEN("an input changes") {
+			std::string seen;
+			auto w = cfg->watch("index", std::string { }, [&seen](std::string v, std::string) { seen = v; });
+			auto before = cfg->generation();
+			cfg->set("data_dir", std::string { "/srv" }, "test");
+			THEN("everything derived from it follows in the same generation") {
+				CHECK(cfg->generation() == before + 1);
+				CHECK(cfg->snapshot()->key("cache_dir", std::string { }) == "/srv/cache");
+				CHECK(cfg->snapshot()->key("index", std::string { }) == "/srv/cache/index");
+				CHECK(seen == "/srv/cache/index");
+			}
+		}
+		WHEN("a value refers to a number") {
+			cfg->set("cache_dir", std::string { "/tmp/${port}" }, "test");
+			cfg->set("port", uint16_t { 8080 }, "test");
+			THEN("the number is written as text") {
+				CHECK(cfg->snapshot()->key("cache_dir", std::string { }) == "/tmp/8080");
+			}
+		}
+		WHEN("a derived value is replaced with plain text") {
+			cfg->set("cache_dir", std::string { "/cache" }, "test");
+			cfg->set("data_dir", std::string { "/srv" }, "test");
+			THEN("it no longer follows its old inputs") {
+				CHECK(cfg->snapshot()->key("cache_dir", std::string { }) == "/cache");
+				CHECK(cfg->snapshot()->key("index", std::string { }) == "/cache/index");
+			}
+		}
+		WHEN("a value would refer to itself") {
+			cfg->set("data_dir", std::string { "${index}" }, "test");
+			THEN("it is left unexpanded") {
+				CHECK(cfg->snapshot()->key("data_dir", std::string { }) == "${index}");
+			}
+		}
+		WHEN("references come from a file") {
+			{
+				std::ofstream out { "config-derived-test.ini" };
+				out << "cache_dir = ${data_dir}/c2\n";
+				out << "data_dir = /opt\n";
+			}
+			cfg->from_file("config-derived-test.ini");
+			THEN("they see values from the same file, whatever the order") {
+				CHECK(cfg->snapshot()->key("cache_dir", std::string { }) == "/opt/c2");
+			}
+		}
+	}
+}
+
+SCENARIO("derived keys", "[derived]") {
+	GIVEN("a config object with a computed pool size") {
+		auto cfg = make_config();
+		(*cfg)
+			("threads", uint32_t { 2 }, "worker threads")
+			("pool_size", uint32_t { 0 }, "connection pool size")
+			("label", std::string { }, "unrelated")
+		;
+		int calls = 0;
+		cfg->derive("pool_size", { "threads" }, [&calls](const view &v) {
+			++calls;
+			return std::to_string(v.key("threads", uint32_t { 0 }) * 4);
+		});
+		THEN("it is computed straight away") {
+			CHECK(cfg->key("pool_size", uint32_t { 0 }) == 8);
+			CHECK(calls == 1);
+		}
+		WHEN("its input changes") {
+			cfg->set("threads", uint32_t { 5 }, "test");
+			THEN("it is recomputed once") {
+				CHECK(cfg->snapshot()->key("pool_size", uint32_t { 0 }) == 20);
+				CHECK(calls == 2);
+			}
+		}
+		WHEN("something else changes, or it is read") {
+			cfg->set("label", std::string { "x" }, "test");
+			for(int i = 0; i < 5; ++i) {
+				cfg->snapshot()->key("pool_size", uint32_t { 0 });
+			}
+			THEN("it is not recomputed") {
+				CHECK(calls == 1);
+			}
+		}
+		WHEN("we try to make a cycle") {
+			THEN("it is refused") {
+				CHECK_THROWS_AS(cfg->derive("threads", { "pool_size" }, [](const view &) { return std::string { "1" }; }), const std::invalid_argument &);
+				CHECK_THROWS_AS(cfg->derive("label", { "label" }, [](const view &) { return std::string { }; }), const std::invalid_argument &);
+			}
+		}
+		WHEN("we derive a key that was never declared") {
+			THEN("it is refused") {
+				CHECK_THROWS_AS(cfg->derive("missing", { "threads" }, [](const view &) { return std::string { }; }), const std::invalid_argument &);
+			}
+		}
+	}
+}
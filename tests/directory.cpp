@@ -0,0 +1,69 @@
+/**
+ * @file
+ */
+#include "catch.hpp"
+#include <fstream>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <boost/filesystem.hpp>
+#include <appcon.h>
+#include "cfgmaker.h"
+
+using namespace appcon;
+
+namespace {
+
+void write_file(const std::string &path, const std::string &content) {
+	std::ofstream out { path, std::ios::out | std::ios::binary | std::ios::trunc };
+	out << content;
+}
+
+}
+
+SCENARIO("loading a directory of fragments", "[directory]") {
+	GIVEN("a directory with several fragments") {
+		std::string dir { "config-directory-test.d" };
+		boost::filesystem::remove_all(dir);
+		boost::filesystem::create_directory(dir);
+		write_file(dir + "/10-base.conf", "host = base.example.com\nport = 80\nworkers = 1\n");
+		write_file(dir + "/20-site.conf", "port = 8080\n");
+		write_file(dir + "/30-local.conf", "workers = 3\n");
+		write_file(dir + "/99-ignored.txt", "port = 1\n");
+		auto cfg = make_config();
+		(*cfg)
+			("host", std::string { "localhost" }, "server host")
+			("port", uint16_t { 0 }, "server port")
+			("workers", uint32_t { 0 }, "worker count")
+		;
+		WHEN("we load the directory") {
+			cfg->from_directory(dir, "*.conf");
+			THEN("later fragments override earlier ones, and other files are skipped") {
+				CHECK(cfg->key("host", std::string { "" }) == "base.example.com");
+				CHECK(cfg->key("port", uint16_t { 0 }) == 8080);
+				CHECK(cfg->key("workers", uint32_t { 0 }) == 3);
+			}
+		}
+		WHEN("fragments change between reloads") {
+			cfg->from_directory(dir, "*.conf");
+			/* Same size and timestamps, as rsync -t or cp -p would leave it */
+			struct stat before;
+			REQUIRE(::stat((dir + "/30-local.conf").c_str(), &before) == 0);
+			write_file(dir + "/30-local.conf", "workers = 7\n");
+			struct timespec times[2] = { before.st_atim, before.st_mtim };
+			REQUIRE(::utimensat(AT_FDCWD, (dir + "/30-local.conf").c_str(), times, 0) == 0);
+			write_file(dir + "/20-site.conf", "port = 9090\n");
+			boost::filesystem::remove(dir + "/10-base.conf");
+			cfg->reload();
+			THEN("every changed fragment is parsed again") {
+				CHECK(cfg->key("port", uint16_t { 0 }) == 9090);
+				CHECK(cfg->key("workers", uint32_t { 0 }) == 7);
+			}
+		}
+		WHEN("we load a directory that does not exist") {
+			cfg->from_directory(dir + "/missing", "*.conf");
+			THEN("nothing changes") {
+				CHECK(cfg->key("port", uint16_t { 0 }) == 0);
+			}
+		}
+	}
+}
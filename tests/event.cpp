@@ -0,0 +1,71 @@
+/**
+ * @file
+ */
+#include "catch.hpp"
+#include <map>
+#include <poll.h>
+#include <unistd.h>
+#include <appcon.h>
+#include "cfgmaker.h"
+
+using namespace appcon;
+
+namespace {
+
+bool readable(int fd) {
+	pollfd p { fd, POLLIN, 0 };
+	return ::poll(&p, 1, 0) == 1 && (p.revents & POLLIN);
+}
+
+void reset(int fd) {
+	char buf[64];
+	while(::read(fd, buf, sizeof(buf)) > 0) { }
+}
+
+}
+
+SCENARIO("event loop integration", "[event]") {
+	GIVEN("a config object with a change descriptor") {
+		auto cfg = make_config();
+		(*cfg)
+			("first", std::string { "one" }, "first key")
+			("second", uint32_t { 2 }, "second key")
+			("third", int8_t { 3 }, "third key")
+		;
+		auto fd = cfg->change_fd();
+		REQUIRE(fd >= 0);
+		CHECK(cfg->change_fd() == fd);
+		CHECK(!readable(fd));
+		WHEN("a value changes") {
+			auto since = cfg->generation();
+			cfg->set("second", uint32_t { 20 }, "manual");
+			THEN("the descriptor becomes readable and we can drain the change") {
+				CHECK(readable(fd));
+				reset(fd);
+				CHECK(!readable(fd));
+				std::map<std::string, std::string> changes;
+				auto gen = cfg->changes_since(since, [&changes](std::string k, std::string v) {
+					changes[k] = v;
+				});
+				CHECK(gen == cfg->generation());
+				REQUIRE(changes.size() == 1);
+				CHECK(changes["second"] == "20");
+				AND_THEN("nothing is reported after that generation") {
+					size_t count = 0;
+					cfg->changes_since(gen, [&count](std::string, std::string) { ++count; });
+					CHECK(count == 0);
+				}
+			}
+		}
+		WHEN("we ask for everything since the start") {
+			std::map<std::string, std::string> changes;
+			cfg->changes_since(0, [&changes](std::string k, std::string v) {
+				changes[k] = v;
+			});
+			THEN("we see every key") {
+				CHECK(changes.size() == 3);
+				CHECK(changes["first"] == "one");
+			}
+		}
+	}
+}
@@ -0,0 +1,121 @@
+/**
+ * @file
+ */
+#include "catch.hpp"
+#include <fstream>
+#include <string>
+#include <vector>
+#include <appcon.h>
+#include <appcon/flags.h>
+#include "cfgmaker.h"
+
+using namespace appcon;
+
+namespace {
+
+/** How many of the first n contexts have the flag on */
+size_t count_enabled(const flags &f, flags::flag flag, uint64_t n) {
+	size_t on = 0;
+	for(uint64_t i = 0; i < n; ++i) {
+		if(f.enabled(flag, i)) {
+			++on;
+		}
+	}
+	return on;
+}
+
+}
+
+SCENARIO("feature flags", "[flags]") {
+	GIVEN("some declared flags") {
+		auto cfg = make_config();
+		flags f { cfg };
+		auto off = f.declare("off", 0.0f, "never on");
+		auto on = f.declare("on", 100.0f, "always on");
+		auto quarter = f.declare("quarter", 25.0f, "a quarter of users");
+		auto other = f.declare("other", 25.0f, "another quarter");
+		THEN("percentages are honoured") {
+			CHECK(count_enabled(f, off, 100000) == 0);
+			CHECK(count_enabled(f, on, 100000) == 100000);
+			auto q = count_enabled(f, quarter, 100000);
+			CHECK(q > 24000);
+			CHECK(q < 26000);
+		}
+		THEN("flags split contexts independently") {
+			size_t both = 0;
+			for(uint64_t i = 0; i < 100000; ++i) {
+				if(f.enabled(quarter, i) && f.enabled(other, i)) {
+					++both;
+				}
+			}
+			CHECK(both > 5600);
+			CHECK(both < 6900);
+		}
+		THEN("undeclared flags are off") {
+			CHECK(!f.enabled(flags::flag { }, uint64_t { 1 }));
+		}
+		THEN("string contexts work too") {
+			CHECK(f.enabled(on, "user-1234"));
+			CHECK(f.enabled(quarter, "user-1234") == f.enabled(quarter, flags::hash("user-1234")));
+		}
+		WHEN("a rollout is widened") {
+			std::vector<uint64_t> before;
+			for(uint64_t i = 0; i < 10000; ++i) {
+				if(f.enabled(quarter, i)) {
+					before.push_back(i);
+				}
+			}
+			auto builds = f.builds();
+			cfg->set("flags.quarter", 50.0f, "test");
+			THEN("the table is rebuilt once") {
+				CHECK(f.builds() == builds + 1);
+			}
+			THEN("everyone who had it keeps it") {
+				for(auto i : before) {
+					CHECK(f.enabled(quarter, i));
+				}
+				auto half = count_enabled(f, quarter, 100000);
+				CHECK(half > 49000);
+				CHECK(half < 51000);
+			}
+		}
+		WHEN("many more flags are declared") {
+			std::vector<flags::flag> more;
+			for(int i = 0; i < 100; ++i) {
+				more.push_back(f.declare("more" + std::to_string(i), i % 2 ? 100.0f : 0.0f, "filler"));
+			}
+			THEN("earlier and later flags all keep working") {
+				CHECK(count_enabled(f, on, 1000) == 1000);
+				CHECK(count_enabled(f, off, 1000) == 0);
+				CHECK(count_enabled(f, more[99], 1000) == 1000);
+				CHECK(count_enabled(f, more[98], 1000) == 0);
+			}
+			AND_WHEN("one of them changes") {
+				cfg->set("flags.more98", 100.0f, "test");
+				THEN("the change is seen") {
+					CHECK(count_enabled(f, more[98], 1000) == 1000);
+				}
+			}
+		}
+		WHEN("an unrelated key changes") {
+			(*cfg)("unrelated", std::string { }, "not a flag");
+			auto builds = f.builds();
+			cfg->set("unrelated", std::string { "x" }, "test");
+			THEN("the table is not rebuilt") {
+				CHECK(f.builds() == builds);
+			}
+		}
+		WHEN("several flags change in one reload") {
+			{
+				std::ofstream out { "config-flags-test.ini" };
+				out << "[flags]\noff = 10\non = 90\nquarter = 30\n";
+			}
+			auto builds = f.builds();
+			cfg->from_file("config-flags-test.ini");
+			THEN("the table is rebuilt once") {
+				CHECK(f.builds() == builds + 1);
+				CHECK(count_enabled(f, off, 1000) > 0);
+			}
+		}
+	}
+}
@@ -0,0 +1,140 @@
+/**
+ * @file
+ */
+#include "catch.hpp"
+#include <fstream>
+#include <map>
+#include <appcon.h>
+#include <appcon/formats.h>
+#include "cfgmaker.h"
+
+using namespace appcon;
+
+namespace {
+
+std::map<std::string, std::string> parse_with(void (*parser)(boost::string_view, const detail::record_handler &), const std::string &text) {
+	std::map<std::string, std::string> seen;
+	parser(text, [&seen](boost::string_view k, boost::string_view v) {
+		seen[k.to_string()] = v.to_string();
+	});
+	return seen;
+}
+
+}
+
+SCENARIO("parsing JSON", "[formats]") {
+	GIVEN("a nested document") {
+		auto seen = parse_with(detail::parse_json, R"({
+			"host": "example.com",
+			"db": { "port": 5432, "ratio": -1.5e3, "tls": true, "unset": null },
+			"peers": [ "a", { "name": "b\u00e9\n" } ],
+			"empty": {},
+			"none": [ ]
+		})");
+		THEN("scalars are flattened to dotted keys") {
+			CHECK(seen.size() == 7);
+			CHECK(seen["host"] == "example.com");
+			CHECK(seen["db.port"] == "5432");
+			CHECK(seen["db.ratio"] == "-1.5e3");
+			CHECK(seen["db.tls"] == "true");
+			CHECK(seen.count("db.unset") == 0);
+			CHECK(seen["peers.0"] == "a");
+			CHECK(seen["peers.1.name"] == "b\xC3\xA9\n");
+		}
+		THEN("an empty array still gives a record") {
+			CHECK(seen.count("none[]") == 1);
+			CHECK(seen["none[]"] == "");
+		}
+	}
+	GIVEN("malformed documents") {
+		THEN("they are rejected") {
+			CHECK_THROWS(parse_with(detail::parse_json, "[1, 2]"));
+			CHECK_THROWS(parse_with(detail::parse_json, "{\"a\": 1,}"));
+			CHECK_THROWS(parse_with(detail::parse_json, "{\"a\": 01}"));
+			CHECK_THROWS(parse_with(detail::parse_json, "{\"a\": \"unterminated}"));
+			CHECK_THROWS(parse_with(detail::parse_json, "{\"a\": 1} x"));
+			CHECK_THROWS(parse_with(detail::parse_json, std::string(100, '{')));
+		}
+	}
+}
+
+SCENARIO("parsing TOML", "[formats]") {
+	GIVEN("a document using most of the syntax") {
+		auto seen = parse_with(detail::parse_toml,
+			"# comment\n"
+			"title = \"Example\\t1\"\n"
+			"path = 'C:\\temp'\n"
+			"site.\"dotted key\" = 0xff\n"
+			"[server]\n"
+			"port = 8_080 # trailing comment\n"
+			"ratio = +1.5\n"
+			"enabled = false\n"
+			"started = 1979-05-27T07:32:00Z\n"
+			"ports = [ 80,\n  443, # https\n]\n"
+			"aliases = [\n]\n"
+			"limits = { soft = 10, hard = 0o20 }\n"
+			"motd = \"\"\"\nhello \\\n   world\"\"\"\n"
+			"[[backend]]\n"
+			"name = 'a'\n"
+			"[backend.tls]\n"
+			"verify = true\n"
+			"[[backend]]\n"
+			"name = 'b'\n"
+		);
+		THEN("values are flattened to dotted keys") {
+			CHECK(seen["title"] == "Example\t1");
+			CHECK(seen["path"] == "C:\\temp");
+			CHECK(seen["site.dotted key"] == "255");
+			CHECK(seen["server.port"] == "8080");
+			CHECK(seen["server.ratio"] == "1.5");
+			CHECK(seen["server.enabled"] == "false");
+			CHECK(seen["server.started"] == "1979-05-27T07:32:00Z");
+			CHECK(seen["server.ports.0"] == "80");
+			CHECK(seen["server.ports.1"] == "443");
+			CHECK(seen.count("server.ports[]") == 0);
+			CHECK(seen["server.aliases[]"] == "");
+			CHECK(seen["server.limits.soft"] == "10");
+			CHECK(seen["server.limits.hard"] == "16");
+			CHECK(seen["server.motd"] == "hello world");
+			CHECK(seen["backend.0.name"] == "a");
+			CHECK(seen["backend.0.tls.verify"] == "true");
+			CHECK(seen["backend.1.name"] == "b");
+		}
+	}
+	GIVEN("malformed documents") {
+		THEN("they are rejected") {
+			CHECK_THROWS(parse_with(detail::parse_toml, "a = \n"));
+			CHECK_THROWS(parse_with(detail::parse_toml, "a = 1 b = 2\n"));
+			CHECK_THROWS(parse_with(detail::parse_toml, "a = \"unterminated\n"));
+			CHECK_THROWS(parse_with(detail::parse_toml, "[table\n"));
+			CHECK_THROWS(parse_with(detail::parse_toml, "a = 1__0\n"));
+		}
+	}
+}
+
+SCENARIO("loading JSON and TOML files", "[formats]") {
+	GIVEN("a config object") {
+		auto cfg = make_config();
+		(*cfg)
+			("server.host", std::string { "localhost" }, "server host")
+			("server.port", uint16_t { 0 }, "server port")
+			("workers", uint32_t { 0 }, "worker count")
+		;
+		WHEN("we load a JSON file that includes a TOML file") {
+			{
+				std::ofstream out { "config-formats-test.toml", std::ios::out | std::ios::binary };
+				out << "workers = 3\n[server]\nhost = 'toml.example.com'\nport = 81\n";
+			}
+			{
+				std::ofstream out { "config-formats-test.json", std::ios::out | std::ios::binary };
+				out << "{ \"include\": \"config-formats-test.toml\", \"server\": { \"port\": 8080 }, \"other\": 1 }";
+			}
+			cfg->from_file("config-formats-test.json");
+			THEN("values convert to their declared types, and the including file wins") {
+				CHECK(cfg->key("server.host", std::string { "" }) == "toml.example.com");
+				CHECK(cfg->key("server.port", uint16_t { 0 }) == 8080);
+				CHECK(cfg->key("workers", uint32_t { 0 }) == 3);
+			}
+		}
+	}
+}
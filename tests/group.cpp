@@ -0,0 +1,85 @@
+/**
+ * @file
+ */
+#include "catch.hpp"
+#include <atomic>
+#include <fstream>
+#include <thread>
+#include <appcon.h>
+#include "cfgmaker.h"
+
+using namespace appcon;
+
+SCENARIO("key groups", "[group]") {
+	GIVEN("a config object with a group") {
+		auto cfg = make_config();
+		(*cfg)
+			("host", std::string { "localhost" }, "server host")
+			("port", uint16_t { 80 }, "server port")
+		;
+		cfg->group("endpoint", { "host", "port" });
+		WHEN("we read the group") {
+			auto g = cfg->group("endpoint");
+			THEN("we see the current values") {
+				REQUIRE(g);
+				CHECK(g->key("host", std::string { "" }) == "localhost");
+				CHECK(g->key("port", uint16_t { 0 }) == 80);
+				CHECK(!g->have_key("missing"));
+			}
+		}
+		WHEN("we read a group that does not exist") {
+			THEN("we get nothing back") {
+				CHECK(!cfg->group("missing"));
+			}
+		}
+		WHEN("we change a key after taking a view") {
+			auto g = cfg->group("endpoint");
+			cfg->set("port", uint16_t { 8080 }, "manual");
+			THEN("the old view is unchanged and a new view has the update") {
+				CHECK(g->key("port", uint16_t { 0 }) == 80);
+				auto updated = cfg->group("endpoint");
+				CHECK(updated->key("port", uint16_t { 0 }) == 8080);
+				CHECK(updated->generation() > g->generation());
+			}
+		}
+	}
+	GIVEN("a group that is reloaded from a file while being read") {
+		auto cfg = make_config();
+		(*cfg)
+			("min_threads", uint32_t { 0 }, "lower bound")
+			("max_threads", uint32_t { 0 }, "upper bound")
+		;
+		cfg->group("threads", { "min_threads", "max_threads" });
+		std::string filename { "config-group-test.ini" };
+		{
+			std::ofstream out { filename, std::ios::out | std::ios::binary };
+			out << "min_threads = 1\nmax_threads = 1\n";
+		}
+		cfg->from_file(filename);
+		WHEN("a reader checks the pair on each reload") {
+			std::atomic<bool> done { false };
+			std::atomic<int> torn { 0 };
+			std::thread reader([&]() {
+				while(!done) {
+					auto g = cfg->group("threads");
+					if(g->key("min_threads", uint32_t { 0 }) != g->key("max_threads", uint32_t { 0 })) {
+						++torn;
+					}
+				}
+			});
+			for(uint32_t i = 2; i < 100; ++i) {
+				{
+					std::ofstream out { filename, std::ios::out | std::ios::binary };
+					out << "min_threads = " << i << "\nmax_threads = " << i << "\n";
+				}
+				cfg->reload();
+			}
+			done = true;
+			reader.join();
+			THEN("the reader never saw a mismatched pair") {
+				CHECK(torn == 0);
+				CHECK(cfg->group("threads")->key("max_threads", uint32_t { 0 }) == 99);
+			}
+		}
+	}
+}
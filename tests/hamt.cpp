@@ -0,0 +1,139 @@
+/**
+ * @file
+ */
+#include "catch.hpp"
+#include <map>
+#include <string>
+#include <appcon/hamt.h>
+
+using namespace appcon::detail;
+
+namespace {
+
+/** Sends every key to the same bucket, so we exercise collision handling */
+struct clash_hash {
+	uint64_t operator()(const char *, size_t) const noexcept { return 42; }
+	uint64_t operator()(const std::string &) const noexcept { return 42; }
+};
+
+}
+
+SCENARIO("persistent hash trie", "[hamt]") {
+	GIVEN("an empty trie") {
+		hamt<int> t;
+		CHECK(t.empty());
+		CHECK(t.find("missing") == nullptr);
+		WHEN("we add many keys one version at a time") {
+			std::vector<hamt<int>> versions { t };
+			for(int i = 0; i < 5000; ++i) {
+				versions.push_back(versions.back().set("key" + std::to_string(i), i));
+			}
+			THEN("each version sees exactly the keys added before it") {
+				auto &latest = versions.back();
+				CHECK(latest.size() == 5000);
+				for(int i = 0; i < 5000; ++i) {
+					auto v = latest.find("key" + std::to_string(i));
+					REQUIRE(v);
+					CHECK(*v == i);
+				}
+				CHECK(versions[100].size() == 100);
+				CHECK(versions[100].find("key99"));
+				CHECK(!versions[100].find("key100"));
+				CHECK(versions.front().empty());
+			}
+			AND_WHEN("we overwrite a key") {
+				auto updated = versions.back().set("key10", -1);
+				THEN("only the new version changes") {
+					CHECK(updated.size() == 5000);
+					CHECK(*updated.find("key10") == -1);
+					CHECK(*versions.back().find("key10") == 10);
+				}
+				THEN("diff reports only that key") {
+					std::map<std::string, std::pair<int, int>> changes;
+					hamt<int>::diff(versions.back(), updated, [&changes](const std::string &k, const int *old, const int *curr) {
+						changes[k] = std::make_pair(old ? *old : 0, curr ? *curr : 0);
+					});
+					REQUIRE(changes.size() == 1);
+					CHECK(changes["key10"] == std::make_pair(10, -1));
+				}
+			}
+			THEN("diff between distant versions reports additions") {
+				size_t added = 0;
+				hamt<int>::diff(versions[4000], versions.back(), [&added](const std::string &, const int *old, const int *curr) {
+					if(!old && curr) ++added;
+				});
+				CHECK(added == 1000);
+			}
+			WHEN("we erase keys") {
+				auto t = versions.back();
+				for(int i = 0; i < 5000; i += 2) {
+					t = t.erase("key" + std::to_string(i));
+				}
+				THEN("only the remaining keys are found") {
+					CHECK(t.size() == 2500);
+					CHECK(!t.find("key10"));
+					CHECK(*t.find("key11") == 11);
+					CHECK(*versions.back().find("key10") == 10);
+					CHECK(t.erase("key10").size() == 2500);
+				}
+				THEN("erasing everything leaves an empty trie") {
+					for(int i = 1; i < 5000; i += 2) {
+						t = t.erase("key" + std::to_string(i));
+					}
+					CHECK(t.empty());
+					CHECK(t.set("key1", 1).size() == 1);
+				}
+			}
+			THEN("for_each visits every entry") {
+				long total = 0;
+				versions.back().for_each([&total](const std::string &, int v) { total += v; });
+				CHECK(total == 4999L * 5000L / 2);
+			}
+		}
+	}
+	GIVEN("a trie with stamped entries") {
+		hamt<int> t;
+		for(int i = 0; i < 1000; ++i) {
+			t = t.set("key" + std::to_string(i), i, 1);
+		}
+		t = t.set("key5", 50, 2).set("key500", 5000, 3);
+		WHEN("we ask for entries newer than a stamp") {
+			std::map<std::string, int> newer;
+			t.since(1, [&newer](const std::string &k, int v) { newer[k] = v; });
+			THEN("we only see the later changes") {
+				REQUIRE(newer.size() == 2);
+				CHECK(newer["key5"] == 50);
+				CHECK(newer["key500"] == 5000);
+			}
+		}
+	}
+	GIVEN("a trie where every key has the same hash") {
+		hamt<std::string, clash_hash> t;
+		t = t.set("a", "first").set("b", "second").set("c", "third");
+		THEN("all keys are still distinct") {
+			CHECK(t.size() == 3);
+			CHECK(*t.find("a") == "first");
+			CHECK(*t.find("b") == "second");
+			CHECK(*t.find("c") == "third");
+			CHECK(!t.find("d"));
+		}
+		WHEN("we erase one of them") {
+			auto u = t.erase("b");
+			THEN("the others remain") {
+				CHECK(u.size() == 2);
+				CHECK(!u.find("b"));
+				CHECK(*u.find("a") == "first");
+				CHECK(*u.erase("a").find("c") == "third");
+				CHECK(*t.find("b") == "second");
+			}
+		}
+		WHEN("we overwrite one of them") {
+			auto u = t.set("b", "updated");
+			THEN("the collision node is copied rather than modified") {
+				CHECK(u.size() == 3);
+				CHECK(*u.find("b") == "updated");
+				CHECK(*t.find("b") == "second");
+			}
+		}
+	}
+}
@@ -0,0 +1,87 @@
+/**
+ * @file
+ */
+#include "catch.hpp"
+#include <fstream>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <boost/filesystem.hpp>
+#include <appcon.h>
+#include "cfgmaker.h"
+
+using namespace appcon;
+
+namespace {
+
+void write_file(const std::string &path, const std::string &content) {
+	std::ofstream out { path, std::ios::out | std::ios::binary | std::ios::trunc };
+	out << content;
+}
+
+/** Rewrites a file keeping its size and timestamps, as rsync -t or cp -p would */
+void write_file_keeping_times(const std::string &path, const std::string &content) {
+	struct stat before;
+	REQUIRE(::stat(path.c_str(), &before) == 0);
+	write_file(path, content);
+	struct timespec times[2] = { before.st_atim, before.st_mtim };
+	REQUIRE(::utimensat(AT_FDCWD, path.c_str(), times, 0) == 0);
+}
+
+}
+
+SCENARIO("include directives", "[include]") {
+	GIVEN("a file that includes shared blocks") {
+		std::string dir { "config-include-test.d" };
+		boost::filesystem::remove_all(dir);
+		boost::filesystem::create_directories(dir + "/shared");
+		write_file(dir + "/main.ini", "include = shared/common.ini\ninclude = shared/extra-*.ini\nport = 8080\n");
+		write_file(dir + "/shared/common.ini", "include = base.ini\nport = 80\nworkers = 2\n");
+		write_file(dir + "/shared/base.ini", "host = base.example.com\n");
+		write_file(dir + "/shared/extra-1.ini", "workers = 4\n");
+		auto cfg = make_config();
+		(*cfg)
+			("host", std::string { "localhost" }, "server host")
+			("port", uint16_t { 0 }, "server port")
+			("workers", uint32_t { 0 }, "worker count")
+		;
+		WHEN("we load the top-level file") {
+			cfg->from_file(dir + "/main.ini");
+			THEN("included values apply first, and the including file overrides them") {
+				CHECK(cfg->key("host", std::string { "" }) == "base.example.com");
+				CHECK(cfg->key("port", uint16_t { 0 }) == 8080);
+				CHECK(cfg->key("workers", uint32_t { 0 }) == 4);
+			}
+		}
+		WHEN("a nested include changes") {
+			cfg->from_file(dir + "/main.ini");
+			write_file(dir + "/shared/base.ini", "host = changed.example.com\n");
+			cfg->reload();
+			THEN("it is parsed again") {
+				CHECK(cfg->key("host", std::string { "" }) == "changed.example.com");
+				CHECK(cfg->key("workers", uint32_t { 0 }) == 4);
+			}
+		}
+		WHEN("a nested include is rewritten with its size and timestamps kept") {
+			cfg->from_file(dir + "/main.ini");
+			write_file_keeping_times(dir + "/shared/base.ini", "host = copy.example.com\n");
+			cfg->reload();
+			THEN("the change is still seen") {
+				CHECK(cfg->key("host", std::string { "" }) == "copy.example.com");
+			}
+		}
+		WHEN("a new file matches a glob include") {
+			cfg->from_file(dir + "/main.ini");
+			write_file(dir + "/shared/extra-2.ini", "workers = 6\n");
+			cfg->reload();
+			THEN("it is picked up on reload") {
+				CHECK(cfg->key("workers", uint32_t { 0 }) == 6);
+			}
+		}
+		WHEN("the includes form a cycle") {
+			write_file(dir + "/shared/base.ini", "include = ../main.ini\n");
+			THEN("loading fails") {
+				CHECK_THROWS(cfg->from_file(dir + "/main.ini"));
+			}
+		}
+	}
+}
@@ -1,3 +1,28 @@
-#define CATCH_CONFIG_MAIN
+#define CATCH_CONFIG_RUNNER
 #include "catch.hpp"
+#include <boost/filesystem.hpp>
 
+/**
+ * Runs the tests from a scratch directory, so the config files and indexes
+ * they write never land in the source tree or the build directory.
+ */
+int main(int argc, char *argv[]) {
+	Catch::Session session;
+	auto rc = session.applyCommandLine(argc, argv);
+	if(rc != 0) {
+		return rc;
+	}
+	/* Reports still go where they were asked for, relative to where we started */
+	auto &out = session.configData().outputFilename;
+	if(!out.empty()) {
+		out = boost::filesystem::absolute(out).string();
+	}
+	auto start = boost::filesystem::current_path();
+	auto scratch = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("appcon-tests-%%%%-%%%%-%%%%");
+	boost::filesystem::create_directory(scratch);
+	boost::filesystem::current_path(scratch);
+	auto result = session.run();
+	boost::filesystem::current_path(start);
+	boost::filesystem::remove_all(scratch);
+	return result;
+}
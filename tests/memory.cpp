@@ -0,0 +1,151 @@
+/**
+ * @file
+ */
+#include "catch.hpp"
+#include <atomic>
+#include <memory>
+#include <boost/container/pmr/global_resource.hpp>
+#include <boost/container/pmr/synchronized_pool_resource.hpp>
+#include <appcon.h>
+#include <appcon/hamt.h>
+#include "cfgmaker.h"
+
+using namespace appcon;
+
+namespace {
+
+/** Passes everything on upstream, keeping count */
+class counting_resource : public boost::container::pmr::memory_resource {
+public:
+	explicit counting_resource(
+		boost::container::pmr::memory_resource *upstream = boost::container::pmr::new_delete_resource()
+	):allocations{ 0 }, outstanding{ 0 }, upstream_(upstream) { }
+
+	std::atomic<size_t> allocations;
+	std::atomic<long> outstanding;
+
+protected:
+	virtual void *do_allocate(size_t bytes, size_t align) override {
+		++allocations;
+		outstanding += static_cast<long>(bytes);
+		return upstream_->allocate(bytes, align);
+	}
+
+	virtual void do_deallocate(void *p, size_t bytes, size_t align) override {
+		outstanding -= static_cast<long>(bytes);
+		upstream_->deallocate(p, bytes, align);
+	}
+
+	virtual bool do_is_equal(const boost::container::pmr::memory_resource &other) const noexcept override {
+		return this == &other;
+	}
+
+private:
+	boost::container::pmr::memory_resource *upstream_;
+};
+
+}
+
+SCENARIO("tries on a memory resource", "[memory]") {
+	GIVEN("a trie using a counting resource") {
+		counting_resource mr;
+		{
+			detail::hamt<int> t { &mr };
+			for(int i = 0; i < 1000; ++i) {
+				t = t.set("key" + std::to_string(i), i);
+			}
+			auto older = t;
+			for(int i = 0; i < 1000; i += 3) {
+				t = t.erase("key" + std::to_string(i));
+			}
+			THEN("every version allocates from it") {
+				CHECK(mr.allocations > 1000u);
+				CHECK(t.resource() == &mr);
+				CHECK(older.size() == 1000);
+				CHECK(*t.find("key1") == 1);
+			}
+		}
+		THEN("everything is handed back once the versions go") {
+			CHECK(mr.outstanding == 0);
+		}
+	}
+}
+
+SCENARIO("config on a memory resource", "[memory]") {
+	GIVEN("a config object using a counting resource") {
+		counting_resource mr;
+		{
+			auto cfg = make_config(&mr);
+			(*cfg)
+				("port", uint16_t { 80 }, "port")
+				("name", std::string { "server" }, "name")
+			;
+			auto before = mr.allocations.load();
+			WHEN("values change") {
+				auto s = cfg->snapshot();
+				for(uint16_t i = 0; i < 100; ++i) {
+					cfg->set("port", i, "test");
+				}
+				cfg->set_for("acme", "port", uint16_t { 8080 });
+				cfg->write_combining(true);
+				cfg->set("name", std::string { "queued" }, "test");
+				cfg->flush();
+				cfg->write_combining(false);
+				THEN("the key table, tenants and queue allocate from it") {
+					CHECK(mr.allocations > before + 100);
+					CHECK(cfg->key("port", uint16_t { 80 }) == 99);
+					CHECK(cfg->key("acme", "port", uint16_t { 80 }) == 8080);
+					CHECK(cfg->key("name", std::string { "server" }) == "queued");
+					CHECK(s->key("port", uint16_t { 0 }) == 80);
+				}
+			}
+			WHEN("changes are logged") {
+				cfg->change_log(16);
+				change_cursor cursor { cfg->generation() };
+				cfg->set("name", std::string { "a name well past the small string limit" }, "a source well past the small string limit");
+				bool from_resource = false;
+				auto count = cfg->read_changes(cursor, [&mr, &from_resource](const change &c) {
+					from_resource = c.key.get_allocator().resource() == &mr
+						&& c.new_value.get_allocator().resource() == &mr
+						&& c.source.get_allocator().resource() == &mr;
+				});
+				THEN("their records allocate from it") {
+					CHECK(count == 1);
+					CHECK(from_resource);
+				}
+			}
+			WHEN("the values are listed") {
+				std::vector<std::string> keys;
+				cfg->each_as_string([&keys](std::string k, std::string) { keys.push_back(k); });
+				THEN("they come in key order") {
+					CHECK(keys == (std::vector<std::string> { "name", "port" }));
+				}
+			}
+		}
+		THEN("everything is handed back once the config goes") {
+			CHECK(mr.outstanding == 0);
+		}
+	}
+	GIVEN("a config object with tenant overrides on a counting resource") {
+		counting_resource mr;
+		auto cfg = make_config(&mr);
+		(*cfg)("port", uint16_t { 80 }, "port");
+		cfg->set_for("acme", "port", uint16_t { 8080 });
+		REQUIRE(cfg->key("acme", "port", uint16_t { 0 }) == 8080);
+		WHEN("the config goes") {
+			cfg.reset();
+			THEN("its tenant tables are handed back straight away") {
+				CHECK(mr.outstanding == 0);
+			}
+		}
+	}
+	GIVEN("a config object using a pool") {
+		boost::container::pmr::synchronized_pool_resource pool;
+		auto cfg = make_config(&pool);
+		(*cfg)("threads", uint32_t { 4 }, "worker threads");
+		cfg->set("threads", uint32_t { 8 }, "test");
+		THEN("it behaves as usual") {
+			CHECK(cfg->snapshot()->key("threads", uint32_t { 0 }) == 8);
+		}
+	}
+}
@@ -0,0 +1,137 @@
+/**
+ * @file
+ */
+#include "catch.hpp"
+#include <cmath>
+#include <cstdlib>
+#include <random>
+#include <limits>
+#include <appcon.h>
+#include <appcon/numeric.h>
+#include "cfgmaker.h"
+
+using namespace appcon;
+using appcon::detail::parse_number;
+
+namespace {
+
+/** Checks the limits of T and the values just beyond them */
+template<typename T>
+void check_limits(const char *min, const char *max, const char *below, const char *above) {
+	CHECK(parse_number<T>(min) == std::numeric_limits<T>::min());
+	CHECK(parse_number<T>(max) == std::numeric_limits<T>::max());
+	CHECK_THROWS_AS(parse_number<T>(below), const std::out_of_range &);
+	CHECK_THROWS_AS(parse_number<T>(above), const std::out_of_range &);
+}
+
+}
+
+SCENARIO("parsing integers", "[numeric]") {
+	GIVEN("each integer type") {
+		THEN("the full range is accepted and nothing beyond it") {
+			check_limits<uint8_t>("0", "255", "-1", "256");
+			check_limits<uint16_t>("0", "65535", "-1", "65536");
+			check_limits<uint32_t>("0", "4294967295", "-1", "4294967296");
+			check_limits<uint64_t>("0", "18446744073709551615", "-1", "18446744073709551616");
+			check_limits<int8_t>("-128", "127", "-129", "128");
+			check_limits<int16_t>("-32768", "32767", "-32769", "32768");
+			check_limits<int32_t>("-2147483648", "2147483647", "-2147483649", "2147483648");
+			check_limits<int64_t>("-9223372036854775808", "9223372036854775807", "-9223372036854775809", "9223372036854775808");
+		}
+		THEN("8-bit types are numbers, not characters") {
+			CHECK(parse_number<uint8_t>("7") == 7);
+			CHECK(parse_number<int8_t>("-7") == -7);
+		}
+		THEN("signs, blanks and zero are handled") {
+			CHECK(parse_number<int32_t>(" +42 ") == 42);
+			CHECK(parse_number<uint32_t>("-0") == 0);
+			CHECK(parse_number<uint64_t>("000123") == 123);
+		}
+		THEN("anything else is rejected") {
+			CHECK_THROWS_AS(parse_number<int32_t>(""), const std::invalid_argument &);
+			CHECK_THROWS_AS(parse_number<int32_t>("-"), const std::invalid_argument &);
+			CHECK_THROWS_AS(parse_number<int32_t>("12a"), const std::invalid_argument &);
+			CHECK_THROWS_AS(parse_number<int32_t>("1.5"), const std::invalid_argument &);
+			CHECK_THROWS_AS(parse_number<uint8_t>("x"), const std::invalid_argument &);
+		}
+	}
+}
+
+SCENARIO("parsing floats", "[numeric]") {
+	GIVEN("decimal text") {
+		THEN("values round the same way as the standard library") {
+			CHECK(parse_number<float>("27.845") == 27.845f);
+			CHECK(parse_number<float>("-0.001") == -0.001f);
+			CHECK(parse_number<float>("1e-3") == 1e-3f);
+			CHECK(parse_number<float>("3.4028234e38") == std::numeric_limits<float>::max());
+			CHECK(parse_number<float>("0.1234567890123456789012") == 0.1234567890123456789012f);
+			CHECK(parse_number<float>(".5") == 0.5f);
+			CHECK(parse_number<float>("5.") == 5.0f);
+			CHECK(parse_number<double>("0.1") == 0.1);
+			CHECK(parse_number<double>("123456789012345678901234") == 123456789012345678901234.0);
+		}
+		THEN("special values are understood") {
+			CHECK(std::isinf(parse_number<float>("-inf")));
+			CHECK(std::isnan(parse_number<float>("nan")));
+			CHECK(parse_number<float>("0e99") == 0.0f);
+		}
+		THEN("values that do not fit are rejected") {
+			CHECK_THROWS_AS(parse_number<float>("1e39"), const std::out_of_range &);
+			CHECK_THROWS_AS(parse_number<float>("1e-99"), const std::out_of_range &);
+		}
+		THEN("anything else is rejected") {
+			CHECK_THROWS_AS(parse_number<float>(""), const std::invalid_argument &);
+			CHECK_THROWS_AS(parse_number<float>("."), const std::invalid_argument &);
+			CHECK_THROWS_AS(parse_number<float>("1.5e"), const std::invalid_argument &);
+			CHECK_THROWS_AS(parse_number<float>("1,5"), const std::invalid_argument &);
+		}
+	}
+}
+
+SCENARIO("float rounding", "[numeric]") {
+	GIVEN("many random decimal strings") {
+		std::mt19937_64 rng { 7 };
+		size_t mismatches = 0;
+		for(int i = 0; i < 50000; ++i) {
+			auto text = std::to_string(rng() % 100000000) + "." + std::to_string(rng() % 1000000000)
+				+ "e" + std::to_string(static_cast<int>(rng() % 60) - 30);
+			if(parse_number<float>(text) != std::strtof(text.c_str(), nullptr)) {
+				++mismatches;
+			}
+		}
+		THEN("every one matches strtof") {
+			CHECK(mismatches == 0);
+		}
+	}
+}
+
+SCENARIO("numeric config values", "[numeric]") {
+	GIVEN("a config object with 8-bit keys") {
+		auto cfg = make_config();
+		(*cfg)
+			("small", uint8_t { 0 }, "unsigned byte")
+			("signed", int8_t { 0 }, "signed byte")
+		;
+		WHEN("we pass them on the commandline") {
+			const char *argv[] { "test", "--small=200", "--signed=-5" };
+			cfg->from_args(3, argv);
+			THEN("they are read as numbers") {
+				CHECK(cfg->key("small", uint8_t { 0 }) == 200);
+				CHECK(cfg->key("signed", int8_t { 0 }) == -5);
+			}
+		}
+		WHEN("a value is out of range") {
+			const char *argv[] { "test", "--small=300" };
+			THEN("the error names the key and the range") {
+				try {
+					cfg->from_args(2, argv);
+					FAIL("expected an exception");
+				} catch(const std::out_of_range &ex) {
+					std::string msg { ex.what() };
+					CHECK(msg.find("[small]") != std::string::npos);
+					CHECK(msg.find("0 to 255") != std::string::npos);
+				}
+			}
+		}
+	}
+}
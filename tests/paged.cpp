@@ -0,0 +1,198 @@
+/**
+ * @file
+ */
+#include "catch.hpp"
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <system_error>
+#include <appcon.h>
+#include <appcon/disk_index.h>
+#include "cfgmaker.h"
+
+using namespace appcon;
+
+SCENARIO("on-disk hash index", "[paged]") {
+	GIVEN("an empty index") {
+		std::remove("config-paged-test.idx");
+		std::unique_ptr<detail::disk_index> opened { new detail::disk_index { "config-paged-test.idx", 16 } };
+		auto &idx = *opened;
+		THEN("nothing is found") {
+			std::string v;
+			CHECK(!idx.find("missing", v));
+			CHECK(idx.size() == 0);
+		}
+		WHEN("we store more keys than it was created for") {
+			for(int i = 0; i < 5000; ++i) {
+				idx.put("route." + std::to_string(i), std::to_string(i * 2));
+			}
+			idx.put("route.10", "replaced");
+			THEN("every key is still there") {
+				std::string v;
+				CHECK(idx.size() == 5000);
+				REQUIRE(idx.find("route.4999", v));
+				CHECK(v == "9998");
+				REQUIRE(idx.find("route.10", v));
+				CHECK(v == "replaced");
+				CHECK(!idx.find("route.5000", v));
+			}
+			THEN("repeated lookups come from the cache") {
+				std::string v;
+				idx.find("route.1", v);
+				auto misses = idx.cache_misses();
+				for(int i = 0; i < 10; ++i) {
+					idx.find("route.1", v);
+				}
+				CHECK(idx.cache_misses() == misses);
+				CHECK(idx.cache_hits() >= 10);
+			}
+			THEN("nothing else can open it meanwhile") {
+				CHECK_THROWS_AS(detail::disk_index { "config-paged-test.idx" }, const std::system_error &);
+			}
+			AND_WHEN("the index is opened again") {
+				opened.reset();
+				detail::disk_index again { "config-paged-test.idx" };
+				THEN("it has the same contents") {
+					std::string v;
+					CHECK(again.size() == 5000);
+					REQUIRE(again.find("route.123", v));
+					CHECK(v == "246");
+				}
+			}
+			AND_WHEN("it is opened again to start afresh") {
+				opened.reset();
+				detail::disk_index again { "config-paged-test.idx", 16, true };
+				THEN("it is empty") {
+					std::string v;
+					CHECK(again.size() == 0);
+					CHECK(!again.find("route.123", v));
+				}
+			}
+		}
+	}
+	GIVEN("a file that is not an index") {
+		{
+			std::ofstream out { "config-paged-test.ini" };
+			out << "route.a = 1\n";
+		}
+		THEN("opening it fails") {
+			CHECK_THROWS_AS(detail::disk_index { "config-paged-test.ini" }, const std::runtime_error &);
+		}
+	}
+}
+
+SCENARIO("paged config keys", "[paged]") {
+	GIVEN("a config object paging per-route keys") {
+		std::remove("config-paged-test.idx");
+		auto cfg = make_config();
+		(*cfg)
+			("threads", uint32_t { 4 }, "worker threads")
+		;
+		cfg->paged("route.", "config-paged-test.idx", 64);
+		THEN("missing keys give the default without storing it") {
+			CHECK(cfg->key("route.home.timeout", uint32_t { 30 }) == 30);
+			CHECK(!cfg->have_key("route.home.timeout"));
+		}
+		WHEN("we set paged keys") {
+			auto before = cfg->generation();
+			cfg->set("route.home.timeout", uint32_t { 5 }, "test");
+			cfg->set("route.home.backend", std::string { "pool-a" }, "test");
+			THEN("they read back as any type") {
+				CHECK(cfg->key("route.home.timeout", uint32_t { 30 }) == 5);
+				CHECK(cfg->key("route.home.timeout", std::string { }) == "5");
+				CHECK(cfg->key("route.home.backend", std::string { }) == "pool-a");
+				CHECK(cfg->have_key("route.home.timeout"));
+			}
+			THEN("they stay out of the published table") {
+				CHECK(cfg->generation() == before);
+				CHECK(!cfg->snapshot()->have_key("route.home.timeout"));
+			}
+			THEN("text that does not convert gives the default") {
+				CHECK(cfg->key("route.home.backend", uint32_t { 7 }) == 7);
+			}
+			THEN("other keys are unaffected") {
+				CHECK(cfg->key("threads", uint32_t { 4 }) == 4);
+			}
+		}
+		WHEN("a paged key is declared") {
+			(*cfg)("route.api.port", uint16_t { 80 }, "api port");
+			THEN("its default is paged") {
+				CHECK(cfg->key("route.api.port", uint16_t { 0 }) == 80);
+				CHECK(!cfg->snapshot()->have_key("route.api.port"));
+			}
+			THEN("text that is not of its type is refused") {
+				CHECK_THROWS_AS(cfg->set("route.api.port", std::string { "abc" }, "test"), const std::invalid_argument &);
+				CHECK_THROWS_AS(cfg->set("route.api.port", std::string { "70000" }, "test"), const std::out_of_range &);
+				CHECK(cfg->key("route.api.port", uint16_t { 0 }) == 80);
+			}
+			THEN("text that is of its type is stored") {
+				cfg->set("route.api.port", std::string { "8080" }, "test");
+				CHECK(cfg->key("route.api.port", uint16_t { 0 }) == 8080);
+			}
+		}
+		WHEN("a paged key is watched") {
+			std::vector<std::pair<uint32_t, uint32_t>> seen;
+			auto w = cfg->watch("route.api.limit", uint32_t { }, [&seen](uint32_t v, uint32_t old) { seen.emplace_back(v, old); });
+			cfg->set("route.api.limit", uint32_t { 10 }, "test");
+			cfg->set("route.api.limit", uint32_t { 10 }, "test");
+			cfg->set("route.api.limit", std::string { "20" }, "test");
+			THEN("watchers see each change in their own type") {
+				REQUIRE(seen.size() == 2);
+				CHECK(seen[0] == std::make_pair(10u, 0u));
+				CHECK(seen[1] == std::make_pair(20u, 10u));
+			}
+		}
+		WHEN("paged keys come from a file") {
+			{
+				std::ofstream out { "config-paged-test.ini" };
+				out << "threads = 8\n";
+				out << "[route.search]\n";
+				out << "timeout = 12\n";
+			}
+			cfg->from_file("config-paged-test.ini");
+			THEN("they go to the index") {
+				CHECK(cfg->key("route.search.timeout", uint32_t { 0 }) == 12);
+				CHECK(cfg->key("threads", uint32_t { 4 }) == 8);
+			}
+		}
+		WHEN("a second prefix is paged") {
+			THEN("it is refused, and the first one stays in place") {
+				CHECK_THROWS_AS(cfg->paged("tenant.", "config-paged-other.idx"), const std::logic_error &);
+				cfg->set("route.home.timeout", uint32_t { 5 }, "test");
+				CHECK(!cfg->snapshot()->have_key("route.home.timeout"));
+				CHECK(cfg->key("route.home.timeout", uint32_t { 0 }) == 5);
+			}
+		}
+		WHEN("another config tries to open the same index") {
+			auto next = make_config();
+			THEN("it is refused while the first one has it") {
+				CHECK_THROWS_AS(next->paged("route.", "config-paged-test.idx"), const std::system_error &);
+			}
+		}
+		WHEN("the index is opened again after a restart") {
+			{
+				std::ofstream out { "config-paged-test.ini" };
+				out << "[route.search]\n";
+				out << "timeout = 12\n";
+				out << "retries = 3\n";
+			}
+			cfg->from_file("config-paged-test.ini");
+			cfg->set("route.home.timeout", uint32_t { 9 }, "test");
+			cfg.reset();
+			{
+				std::ofstream out { "config-paged-test.ini" };
+				out << "[route.search]\n";
+				out << "timeout = 15\n";
+			}
+			auto next = make_config();
+			next->from_file("config-paged-test.ini");
+			next->paged("route.", "config-paged-test.idx");
+			THEN("it only holds what the sources say now") {
+				CHECK(next->key("route.search.timeout", uint32_t { 0 }) == 15);
+				CHECK(!next->have_key("route.search.retries"));
+				CHECK(!next->have_key("route.home.timeout"));
+			}
+		}
+	}
+}
@@ -0,0 +1,244 @@
+/**
+ * @file
+ * Checks the real-time read guarantees by interposing the global allocator
+ * and pthread mutex locking, and counting any calls made while a test
+ * thread has armed the counters.
+ */
+#include "catch.hpp"
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <appcon.h>
+#include "cfgmaker.h"
+
+using namespace appcon;
+
+namespace {
+
+thread_local bool armed = false;
+thread_local size_t allocations = 0;
+thread_local size_t locks = 0;
+
+using lock_fn = int (*)(pthread_mutex_t *);
+lock_fn real_lock = nullptr;
+lock_fn real_trylock = nullptr;
+
+/**
+ * Looks up the real function. Other static constructors may lock before ours
+ * runs, so this is done on first use as well as at startup: dlsym is not
+ * something we want to count once a test is armed.
+ */
+lock_fn resolve(lock_fn &fn, const char *name) {
+	if(!fn) fn = reinterpret_cast<lock_fn>(dlsym(RTLD_NEXT, name));
+	return fn;
+}
+
+struct resolver {
+	resolver() {
+		resolve(real_lock, "pthread_mutex_lock");
+		resolve(real_trylock, "pthread_mutex_trylock");
+	}
+} resolve_early;
+
+void *counted_alloc(size_t n) {
+	if(armed) ++allocations;
+	auto p = std::malloc(n ? n : 1);
+	if(!p) throw std::bad_alloc();
+	return p;
+}
+
+void counted_free(void *p) noexcept {
+	if(armed && p) ++allocations;
+	std::free(p);
+}
+
+/** Tracks everything done between construction and check() */
+struct rt_guard {
+	rt_guard() { allocations = 0; locks = 0; armed = true; }
+	~rt_guard() { armed = false; }
+	void check() {
+		armed = false;
+		CHECK(allocations == 0);
+		CHECK(locks == 0);
+	}
+};
+
+}
+
+void *operator new(size_t n) { return counted_alloc(n); }
+void *operator new[](size_t n) { return counted_alloc(n); }
+void *operator new(size_t n, const std::nothrow_t &) noexcept { try { return counted_alloc(n); } catch(...) { return nullptr; } }
+void *operator new[](size_t n, const std::nothrow_t &) noexcept { try { return counted_alloc(n); } catch(...) { return nullptr; } }
+void operator delete(void *p) noexcept { counted_free(p); }
+void operator delete[](void *p) noexcept { counted_free(p); }
+void operator delete(void *p, size_t) noexcept { counted_free(p); }
+void operator delete[](void *p, size_t) noexcept { counted_free(p); }
+
+extern "C" int pthread_mutex_lock(pthread_mutex_t *m) {
+	if(armed) ++locks;
+	return resolve(real_lock, "pthread_mutex_lock")(m);
+}
+
+extern "C" int pthread_mutex_trylock(pthread_mutex_t *m) {
+	if(armed) ++locks;
+	return resolve(real_trylock, "pthread_mutex_trylock")(m);
+}
+
+SCENARIO("real-time safe reads", "[realtime]") {
+	GIVEN("a config object with numeric and string keys") {
+		auto cfg = make_config();
+		(*cfg)
+			("gain", float { 0.5f }, "audio gain")
+			("depth", uint32_t { 8 }, "book depth")
+			("offset", int64_t { -3 }, "signed value")
+			("venue", std::string { "a venue name that is too long for the small string buffer" }, "string key")
+		;
+		auto gain = cfg->realtime("gain");
+		auto depth = cfg->realtime("depth");
+		auto offset = cfg->realtime("offset");
+		auto missing = cfg->realtime("missing");
+		THEN("the interposers are in place") {
+			rt_guard g;
+			auto s = new std::string(100, 'x');
+			std::mutex m;
+			m.lock();
+			m.unlock();
+			delete s;
+			armed = false;
+			/* Two allocations and two frees */
+			CHECK(allocations == 4);
+			CHECK(locks == 1);
+		}
+		WHEN("we read through realtime handles") {
+			rt_guard g;
+			auto gv = gain.get(0.0f);
+			auto dv = depth.get(uint32_t { 0 });
+			auto ov = offset.get(int64_t { 0 });
+			auto wrong = depth.get(uint64_t { 7 });
+			auto absent = missing.get(int32_t { 42 });
+			g.check();
+			THEN("we see the published values with no locks or allocations") {
+				CHECK(gv == 0.5f);
+				CHECK(dv == 8);
+				CHECK(ov == -3);
+				CHECK(wrong == 7);
+				CHECK(absent == 42);
+			}
+		}
+		WHEN("a value changes") {
+			auto before = depth.version();
+			cfg->set("depth", uint32_t { 16 }, "manual");
+			THEN("the handle sees the new value and version") {
+				CHECK(depth.get(uint32_t { 0 }) == 16);
+				CHECK(depth.version() > before);
+			}
+		}
+		WHEN("we read strings through a snapshot") {
+			auto before = cfg->snapshot();
+			cfg->set("venue", std::string { "another venue name well past the small string limit" }, "manual");
+			boost::string_view v, old, absent;
+			{
+				rt_guard g;
+				{
+					auto s = cfg->snapshot();
+					v = s->key_view("venue", "none");
+					absent = s->key_view("missing", "none");
+				}
+				/* We hold the last reference to this one, and dropping it must not free anything */
+				old = before->key_view("venue", "none");
+				before = pinned<view> { };
+				g.check();
+			}
+			THEN("we get views of the values") {
+				CHECK(v == "another venue name well past the small string limit");
+				CHECK(absent == "none");
+				CHECK(old == "a venue name that is too long for the small string buffer");
+			}
+		}
+		WHEN("we read values for a tenant") {
+			cfg->set_for("acme", "depth", uint32_t { 32 });
+			const std::string tenant { "acme" }, overridden { "depth" }, global { "offset" };
+			uint32_t dv;
+			int64_t ov;
+			{
+				rt_guard g;
+				dv = cfg->key(tenant, overridden, uint32_t { 0 });
+				ov = cfg->key(tenant, global, int64_t { 0 });
+				g.check();
+			}
+			THEN("we see the override and the global value with no locks or allocations") {
+				CHECK(dv == 32);
+				CHECK(ov == -3);
+			}
+		}
+		WHEN("keys change type while we read them") {
+			/* Each key can only change type once, so use plenty of them to give the race a chance */
+			const size_t count = 20000;
+			std::vector<rt_key> handles;
+			for(size_t i = 0; i < count; ++i) {
+				auto k = "flip" + std::to_string(i);
+				(*cfg)(k, uint32_t { 1 }, "changes type");
+				handles.push_back(cfg->realtime(k));
+			}
+			/* The reader watches whichever key the writer is about to flip */
+			std::atomic<size_t> current { 0 };
+			std::thread writer([&]() {
+				for(size_t i = 0; i < count; ++i) {
+					current = i;
+					cfg->set("flip" + std::to_string(i), 1.5f, "writer");
+				}
+				current = count;
+			});
+			bool torn = false;
+			{
+				rt_guard g;
+				for(size_t i; (i = current.load()) < count; ) {
+					auto u = handles[i].get(uint32_t { 0 });
+					auto f = handles[i].get(-1.0f);
+					if((u != 1 && u != 0) || f != -1.0f) torn = true;
+				}
+				g.check();
+			}
+			writer.join();
+			THEN("typed reads only ever see the original value or the default") {
+				CHECK(!torn);
+				CHECK(handles.front().get(uint32_t { 0 }) == 0);
+				CHECK(handles.back().get(1.0f) == 1.0f);
+			}
+		}
+		WHEN("a writer thread updates values while we read") {
+			std::atomic<bool> done { false };
+			std::thread writer([&]() {
+				for(uint32_t i = 0; i < 2000; ++i) {
+					cfg->set("depth", i, "writer");
+				}
+				done = true;
+			});
+			size_t reads = 0;
+			uint32_t last = 0;
+			bool ordered = true;
+			{
+				rt_guard g;
+				while(!done) {
+					auto v = depth.get(uint32_t { 0 });
+					if(v < last && v != 8) ordered = false;
+					last = v;
+					auto s = cfg->snapshot();
+					++reads;
+				}
+				g.check();
+			}
+			writer.join();
+			THEN("values only move forward") {
+				CHECK(ordered);
+				CHECK(reads > 0);
+				CHECK(depth.get(uint32_t { 0 }) == 1999);
+			}
+		}
+	}
+}
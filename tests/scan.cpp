@@ -0,0 +1,60 @@
+/**
+ * @file
+ */
+#include "catch.hpp"
+#include <random>
+#include <string>
+#include <appcon/scan.h>
+
+using namespace appcon::detail;
+
+SCENARIO("vectorised line scanning", "[scan]") {
+	GIVEN("random text made mostly of the bytes we look for") {
+		std::mt19937 rng { 42 };
+		const char alphabet[] = "ab =#\n\t";
+		std::string text;
+		for(int i = 0; i < 20000; ++i) {
+			text += alphabet[rng() % (sizeof(alphabet) - 1)];
+		}
+		auto scalar = line_scanner_for(simd_level::scalar);
+		REQUIRE(scalar);
+		for(auto level : { simd_level::sse2, simd_level::avx2 }) {
+			auto scan = line_scanner_for(level);
+			if(!scan) {
+				continue;
+			}
+			WHEN("we scan from every starting point") {
+				size_t mismatches = 0;
+				for(size_t start = 0; start < text.size(); ++start) {
+					/* Vary the end as well, so the short tails get tested */
+					auto end = text.data() + text.size() - (start % 41);
+					auto p = text.data() + start;
+					if(p > end) {
+						continue;
+					}
+					auto expected = scalar(p, end);
+					auto actual = scan(p, end);
+					if(expected.eol != actual.eol || expected.equals != actual.equals || expected.hash != actual.hash) {
+						++mismatches;
+					}
+				}
+				THEN("the results match the scalar scanner") {
+					CHECK(mismatches == 0);
+				}
+			}
+		}
+		THEN("the best scanner is one of them") {
+			auto best = best_line_scanner();
+			CHECK((best == scalar || best == line_scanner_for(simd_level::sse2) || best == line_scanner_for(simd_level::avx2)));
+		}
+	}
+	GIVEN("lines with no marks at all") {
+		std::string text(100, 'x');
+		auto m = best_line_scanner()(text.data(), text.data() + text.size());
+		THEN("everything points at the end") {
+			CHECK(m.eol == text.data() + text.size());
+			CHECK(m.equals == m.eol);
+			CHECK(m.hash == m.eol);
+		}
+	}
+}
@@ -0,0 +1,186 @@
+/**
+ * @file
+ */
+#include "catch.hpp"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+#include <appcon.h>
+#include <appcon/timer_wheel.h>
+#include "cfgmaker.h"
+
+using namespace appcon;
+using std::chrono::milliseconds;
+using clock_type = std::chrono::steady_clock;
+
+namespace {
+
+/** Polls until cond holds, giving up after long enough that only a hang would get there */
+template<typename F>
+bool eventually(F cond) {
+	auto deadline = clock_type::now() + std::chrono::seconds(10);
+	while(!cond()) {
+		if(clock_type::now() > deadline) {
+			return false;
+		}
+		std::this_thread::sleep_for(milliseconds(1));
+	}
+	return true;
+}
+
+}
+
+SCENARIO("timer wheel", "[schedule]") {
+	GIVEN("a timer wheel") {
+		detail::timer_wheel wheel;
+		WHEN("we schedule many timers across several levels") {
+			std::mt19937 rng { 3 };
+			std::mutex m;
+			size_t fired = 0;
+			size_t early = 0;
+			auto start = clock_type::now();
+			for(int i = 0; i < 5000; ++i) {
+				auto when = start + milliseconds(rng() % 300);
+				wheel.schedule(when, [&m, &fired, &early, when]() {
+					std::lock_guard<std::mutex> guard(m);
+					++fired;
+					if(clock_type::now() < when) {
+						++early;
+					}
+				});
+			}
+			THEN("each fires once, and none early") {
+				CHECK(eventually([&]() { std::lock_guard<std::mutex> guard(m); return fired == 5000; }));
+				CHECK(early == 0);
+				CHECK(wheel.pending() == 0);
+			}
+		}
+		WHEN("we cancel a timer") {
+			std::atomic<int> fired { 0 };
+			auto id = wheel.schedule(clock_type::now() + milliseconds(500), [&fired]() { ++fired; });
+			wheel.schedule(clock_type::now() + milliseconds(520), [&fired]() { fired += 10; });
+			THEN("only the other one fires") {
+				CHECK(wheel.cancel(id));
+				CHECK(!wheel.cancel(id));
+				/* The cancelled one was due first, so by the time the other has fired it would have too */
+				CHECK(eventually([&]() { return fired.load() >= 10; }));
+				CHECK(fired.load() == 10);
+			}
+		}
+		WHEN("a timer is due in the past") {
+			std::atomic<int> fired { 0 };
+			wheel.schedule(clock_type::now() - milliseconds(50), [&fired]() { ++fired; });
+			THEN("it fires straight away") {
+				CHECK(eventually([&]() { return fired.load() == 1; }));
+			}
+		}
+	}
+}
+
+SCENARIO("scheduled config changes", "[schedule]") {
+	GIVEN("a config object") {
+		auto cfg = make_config();
+		(*cfg)
+			("limit", uint32_t { 100 }, "rate limit")
+			("mode", std::string { "normal" }, "mode")
+			("gain", 0.0f, "gain")
+		;
+		auto limit = [&cfg]() { return cfg->snapshot()->key("limit", uint32_t { 0 }); };
+		WHEN("we set a value for a while") {
+			std::vector<std::string> seen;
+			std::mutex m;
+			auto w = cfg->watch("mode", std::string { }, [&m, &seen](std::string v, std::string) {
+				std::lock_guard<std::mutex> guard(m);
+				seen.push_back(v);
+			});
+			cfg->set_until("mode", std::string { "incident" }, clock_type::now() + milliseconds(50));
+			THEN("it applies now and reverts at the deadline") {
+				CHECK(eventually([&]() { std::lock_guard<std::mutex> guard(m); return seen.size() == 2; }));
+				std::lock_guard<std::mutex> guard(m);
+				CHECK(seen == (std::vector<std::string> { "incident", "normal" }));
+			}
+		}
+		WHEN("something else changes an overridden value") {
+			auto deadline = clock_type::now() + milliseconds(500);
+			cfg->set_until("limit", 5u, deadline);
+			cfg->set("limit", uint32_t { 7 }, "test");
+			/* Due after the override's deadline, so once this has fired, so has that */
+			cfg->set_at("mode", std::string { "later" }, deadline + milliseconds(10));
+			THEN("the override does not put the old value back") {
+				CHECK(eventually([&]() { return cfg->snapshot()->key("mode", std::string { }) == "later"; }));
+				CHECK(limit() == 7);
+			}
+		}
+		WHEN("we cancel an override") {
+			auto deadline = clock_type::now() + milliseconds(500);
+			auto id = cfg->set_until("limit", 5u, deadline);
+			CHECK(cfg->cancel_scheduled(id));
+			cfg->set_at("mode", std::string { "later" }, deadline + milliseconds(10));
+			THEN("the override stays") {
+				CHECK(eventually([&]() { return cfg->snapshot()->key("mode", std::string { }) == "later"; }));
+				CHECK(limit() == 5);
+				CHECK(!cfg->cancel_scheduled(id));
+			}
+		}
+		WHEN("we schedule a value") {
+			auto when = clock_type::now() + milliseconds(30);
+			std::atomic<bool> early { false };
+			auto w = cfg->watch("limit", uint32_t { 0 }, [&early, when](uint32_t, uint32_t) {
+				if(clock_type::now() < when) early = true;
+			});
+			cfg->set_at("limit", 42u, when);
+			THEN("it is applied later") {
+				CHECK(eventually([&]() { return limit() == 42; }));
+				CHECK(!early);
+			}
+		}
+		WHEN("we schedule a bad value") {
+			THEN("it is rejected up front") {
+				CHECK_THROWS_AS(cfg->set_at("limit", std::string { "lots" }, clock_type::now()), const std::invalid_argument &);
+				CHECK_THROWS_AS(cfg->set_at("missing", std::string { "1" }, clock_type::now()), const std::invalid_argument &);
+			}
+		}
+		WHEN("we ramp a limit") {
+			std::vector<uint32_t> seen;
+			std::mutex m;
+			auto w = cfg->watch("limit", uint32_t { 0 }, [&m, &seen](uint32_t v, uint32_t) {
+				std::lock_guard<std::mutex> guard(m);
+				seen.push_back(v);
+			});
+			cfg->ramp("limit", 200, milliseconds(50), milliseconds(10));
+			THEN("it moves up in steps and ends at the target") {
+				CHECK(eventually([&]() { std::lock_guard<std::mutex> guard(m); return seen.size() == 5; }));
+				CHECK(limit() == 200);
+				std::lock_guard<std::mutex> guard(m);
+				CHECK(seen == (std::vector<uint32_t> { 120, 140, 160, 180, 200 }));
+			}
+		}
+		WHEN("we cancel a ramp") {
+			auto gain = [&cfg]() { return cfg->snapshot()->key("gain", 0.0f); };
+			/* Timers all run on one thread, so once a later one fires, every step due before it has finished */
+			auto settle = [&cfg](const std::string &marker) {
+				cfg->set_at("mode", marker, clock_type::now() + milliseconds(50));
+				return eventually([&]() { return cfg->snapshot()->key("mode", std::string { }) == marker; });
+			};
+			auto id = cfg->ramp("gain", 1.0, milliseconds(10000), milliseconds(10));
+			REQUIRE(eventually([&]() { return gain() > 0.0f; }));
+			CHECK(cfg->cancel_scheduled(id));
+			REQUIRE(settle("first"));
+			auto stopped = gain();
+			REQUIRE(settle("second"));
+			THEN("it stays where it was") {
+				CHECK(stopped > 0.0f);
+				CHECK(stopped < 1.0f);
+				CHECK(gain() == stopped);
+			}
+		}
+		WHEN("we ramp a string") {
+			THEN("it is refused") {
+				CHECK_THROWS_AS(cfg->ramp("mode", 1.0, milliseconds(10)), const std::invalid_argument &);
+			}
+		}
+	}
+}
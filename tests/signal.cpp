@@ -0,0 +1,77 @@
+/**
+ * @file
+ */
+#include "catch.hpp"
+#include <chrono>
+#include <csignal>
+#include <fstream>
+#include <future>
+#include <thread>
+#include <appcon.h>
+#include "cfgmaker.h"
+
+using namespace appcon;
+
+SCENARIO("reloading on a signal", "[signal]") {
+	GIVEN("a config object that reloads on SIGHUP") {
+		auto cfg = make_config();
+		(*cfg)
+			("workers", uint32_t { 0 }, "worker count")
+		;
+		std::string filename { "config-signal-test.ini" };
+		{
+			std::ofstream out { filename, std::ios::out | std::ios::binary };
+			out << "workers = 4\n";
+		}
+		cfg->from_file(filename);
+		cfg->reload_on_signal(SIGHUP);
+		WHEN("a burst of signals arrives while a reload is running") {
+			/* Holds the listener inside its first reload, so the whole burst arrives before it can look again */
+			std::promise<void> entered;
+			std::promise<void> release;
+			auto resume = release.get_future().share();
+			cfg->watch("workers", uint32_t { 0 }, [&entered, resume](uint32_t v, uint32_t) {
+				if(v == 8) {
+					entered.set_value();
+					resume.wait();
+				}
+			});
+			{
+				std::ofstream out { filename, std::ios::out | std::ios::binary };
+				out << "workers = 8\n";
+			}
+			std::raise(SIGHUP);
+			entered.get_future().wait();
+			{
+				std::ofstream out { filename, std::ios::out | std::ios::binary };
+				out << "workers = 12\n";
+			}
+			auto since = cfg->version("workers");
+			for(int i = 0; i < 20; ++i) {
+				std::raise(SIGHUP);
+			}
+			release.set_value();
+			cfg->wait_for_change("workers", since, std::chrono::milliseconds { 5000 });
+			/* Stats are updated once the reload returns, just after the value is published */
+			auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds { 5 };
+			while(cfg->signal_reload_stats().reloads < 2 && std::chrono::steady_clock::now() < deadline) {
+				std::this_thread::sleep_for(std::chrono::milliseconds { 1 });
+			}
+			auto stats = cfg->signal_reload_stats();
+			THEN("the burst is folded into a single reload, which applies the new value") {
+				CHECK(cfg->key("workers", uint32_t { 0 }) == 12);
+				CHECK(stats.signals == 21);
+				CHECK(stats.reloads == 2);
+				CHECK(stats.failures == 0);
+				CHECK(stats.last_latency.count() > 0);
+				CHECK(stats.max_latency >= stats.last_latency);
+			}
+		}
+		WHEN("we stop listening") {
+			cfg->reload_on_signal(0);
+			THEN("there are no stats") {
+				CHECK(cfg->signal_reload_stats().reloads == 0);
+			}
+		}
+	}
+}
@@ -0,0 +1,82 @@
+/**
+ * @file
+ */
+#include "catch.hpp"
+#include <fstream>
+#include <map>
+#include <appcon.h>
+#include "cfgmaker.h"
+
+using namespace appcon;
+
+SCENARIO("config snapshots", "[snapshot]") {
+	GIVEN("a config object with some settings") {
+		auto cfg = make_config();
+		(*cfg)
+			("name", std::string { "default" }, "a string")
+			("limit", uint64_t { 10 }, "a number")
+		;
+		WHEN("we take a snapshot") {
+			auto s = cfg->snapshot();
+			THEN("it has the current values and generation") {
+				REQUIRE(s);
+				CHECK(s->generation() == cfg->generation());
+				CHECK(s->have_key("name"));
+				CHECK(s->key("name", std::string { "" }) == "default");
+				CHECK(s->key("limit", uint64_t { 0 }) == 10);
+			}
+		}
+		WHEN("values change after the snapshot is taken") {
+			auto s = cfg->snapshot();
+			cfg->set("limit", uint64_t { 20 }, "manual");
+			std::string filename { "config-snapshot-test.ini" };
+			{
+				std::ofstream out { filename, std::ios::out | std::ios::binary };
+				out << "name = from file\n";
+			}
+			cfg->from_file(filename);
+			THEN("the snapshot still sees the old generation") {
+				CHECK(s->key("name", std::string { "" }) == "default");
+				CHECK(s->key("limit", uint64_t { 0 }) == 10);
+				auto latest = cfg->snapshot();
+				CHECK(latest->generation() > s->generation());
+				CHECK(latest->key("name", std::string { "" }) == "from file");
+				CHECK(latest->key("limit", uint64_t { 0 }) == 20);
+			}
+		}
+		WHEN("we ask for a key with the wrong type") {
+			auto s = cfg->snapshot();
+			THEN("we get the default back") {
+				CHECK(s->key("limit", std::string { "fallback" }) == "fallback");
+				CHECK(s->key("missing", int32_t { -1 }) == -1);
+			}
+		}
+	}
+}
+
+SCENARIO("diffing snapshots", "[snapshot]") {
+	GIVEN("two snapshots either side of some changes") {
+		auto cfg = make_config();
+		(*cfg)
+			("unchanged", std::string { "same" }, "left alone")
+			("changed", uint32_t { 1 }, "updated")
+		;
+		auto before = cfg->snapshot();
+		cfg->set("changed", uint32_t { 2 }, "manual");
+		cfg->set("unchanged", std::string { "same" }, "manual");
+		cfg->set("added", std::string { "new" }, "manual");
+		auto after = cfg->snapshot();
+		WHEN("we diff them") {
+			std::map<std::string, std::pair<std::string, std::string>> changes;
+			cfg->diff(before, after, [&changes](std::string k, std::string old, std::string v) {
+				changes[k] = std::make_pair(old, v);
+			});
+			THEN("we see only the keys whose values differ") {
+				CHECK(changes.size() == 2);
+				CHECK(changes["changed"] == std::make_pair(std::string { "1" }, std::string { "2" }));
+				CHECK(changes["added"] == std::make_pair(std::string { }, std::string { "new" }));
+				CHECK(changes.count("unchanged") == 0);
+			}
+		}
+	}
+}
@@ -0,0 +1,114 @@
+/**
+ * @file
+ */
+#include "catch.hpp"
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <appcon.h>
+#include <appcon/ini_tokenizer.h>
+#include "cfgmaker.h"
+
+using namespace appcon;
+
+SCENARIO("tokenizing INI records in chunks", "[stream]") {
+	GIVEN("a tokenizer with a small line limit") {
+		detail::ini_tokenizer tok { 32 };
+		std::map<std::string, std::string> seen;
+		auto record = [&seen](boost::string_view k, boost::string_view v) {
+			seen[k.to_string()] = v.to_string();
+		};
+		WHEN("records arrive split across chunks") {
+			std::string text { "# comment\nhost = example.com\n[db]\nport=5432\r\n; more\nuser = app" };
+			for(size_t i = 0; i < text.size(); i += 3) {
+				tok.feed(text.data() + i, std::min<size_t>(3, text.size() - i), record);
+			}
+			THEN("complete lines are applied straight away") {
+				CHECK(seen.size() == 2);
+				CHECK(seen["host"] == "example.com");
+				CHECK(seen["db.port"] == "5432");
+			}
+			AND_WHEN("the input ends") {
+				tok.finish(record);
+				THEN("the last line is applied too") {
+					CHECK(seen["db.user"] == "app");
+				}
+			}
+		}
+		WHEN("a line is longer than the limit") {
+			std::string text { "key = " + std::string(100, 'x') + "\nother = 1\n" };
+			tok.feed(text.data(), text.size(), record);
+			THEN("it is dropped and the next line still parses") {
+				CHECK(seen.count("key") == 0);
+				CHECK(seen["other"] == "1");
+				CHECK(tok.skipped() == 1);
+			}
+		}
+	}
+}
+
+SCENARIO("streaming config from a pipe", "[stream]") {
+	GIVEN("a config object reading from a pipe") {
+		auto cfg = make_config();
+		(*cfg)
+			("host", std::string { "localhost" }, "server host")
+			("port", uint16_t { 80 }, "server port")
+		;
+		int fds[2];
+		REQUIRE(::pipe(fds) == 0);
+		cfg->from_stream(fds[0]);
+		WHEN("records are written") {
+			auto since = cfg->version("port");
+			std::string text { "host = example.com\nunknown = 1\nport = 8080\n" };
+			REQUIRE(::write(fds[1], text.data(), text.size()) == static_cast<ssize_t>(text.size()));
+			cfg->wait_for_change("port", since, std::chrono::milliseconds { 5000 });
+			THEN("they are applied while the stream stays open") {
+				CHECK(cfg->key("host", std::string { "" }) == "example.com");
+				CHECK(cfg->key("port", uint16_t { 0 }) == 8080);
+			}
+			AND_WHEN("a bad value follows") {
+				since = cfg->version("host");
+				std::string more { "port = not a number\nhost = example.org\n" };
+				REQUIRE(::write(fds[1], more.data(), more.size()) == static_cast<ssize_t>(more.size()));
+				cfg->wait_for_change("host", since, std::chrono::milliseconds { 5000 });
+				THEN("it is skipped and later records still apply") {
+					CHECK(cfg->key("port", uint16_t { 0 }) == 8080);
+					CHECK(cfg->key("host", std::string { "" }) == "example.org");
+				}
+			}
+		}
+		WHEN("keys are declared while records stream in") {
+			const uint32_t count = 200;
+			std::atomic<bool> written { true };
+			std::thread writer([&fds, &written]() {
+				for(uint32_t i = 0; i < count; ++i) {
+					auto line = "extra" + std::to_string(i) + " = " + std::to_string(i + 1) + "\n";
+					if(::write(fds[1], line.data(), line.size()) != static_cast<ssize_t>(line.size())) written = false;
+				}
+			});
+			for(uint32_t i = 0; i < count; ++i) {
+				(*cfg)("extra" + std::to_string(i), uint32_t { 0 }, "declared late");
+			}
+			writer.join();
+			REQUIRE(written);
+			auto since = cfg->version("port");
+			std::string text { "port = 9\n" };
+			REQUIRE(::write(fds[1], text.data(), text.size()) == static_cast<ssize_t>(text.size()));
+			cfg->wait_for_change("port", since, std::chrono::milliseconds { 5000 });
+			THEN("each has its default or the streamed value") {
+				bool valid = true;
+				for(uint32_t i = 0; i < count; ++i) {
+					auto v = cfg->key("extra" + std::to_string(i), uint32_t { 0 });
+					if(v != 0 && v != i + 1) valid = false;
+				}
+				CHECK(valid);
+			}
+		}
+		cfg.reset();
+		::close(fds[0]);
+		::close(fds[1]);
+	}
+}
@@ -0,0 +1,93 @@
+/**
+ * @file
+ */
+#include "catch.hpp"
+#include <chrono>
+#include <appcon.h>
+#include "cfgmaker.h"
+
+using namespace appcon;
+
+SCENARIO("tenant overrides", "[tenant]") {
+	GIVEN("a config object with per-customer limits") {
+		auto cfg = make_config();
+		(*cfg)
+			("rate_limit", uint32_t { 100 }, "requests per second")
+			("plan", std::string { "basic" }, "billing plan")
+			("burst", std::vector<uint16_t> { 1, 2 }, "burst sizes")
+		;
+		THEN("tenants without overrides see the global values") {
+			CHECK(cfg->key("acme", "rate_limit", uint32_t { 0 }) == 100);
+			CHECK(cfg->tenant("acme").get() == cfg->snapshot().get());
+			CHECK(cfg->tenant_count() == 0);
+		}
+		WHEN("one tenant overrides a key") {
+			cfg->set_for("acme", "rate_limit", uint32_t { 5000 });
+			THEN("only that tenant sees it") {
+				CHECK(cfg->key("acme", "rate_limit", uint32_t { 0 }) == 5000);
+				CHECK(cfg->key("other", "rate_limit", uint32_t { 0 }) == 100);
+				CHECK(cfg->key("rate_limit", uint32_t { 100 }) == 100);
+				CHECK(cfg->tenant_count() == 1);
+			}
+			THEN("other keys fall through to the global values") {
+				CHECK(cfg->key("acme", "plan", std::string { }) == "basic");
+				cfg->set("plan", std::string { "pro" }, "test");
+				CHECK(cfg->key("acme", "plan", std::string { }) == "pro");
+				CHECK(cfg->tenant("acme")->key_view("plan", "") == "pro");
+			}
+			THEN("global changes do not hide the override") {
+				cfg->set("rate_limit", uint32_t { 200 }, "test");
+				CHECK(cfg->key("acme", "rate_limit", uint32_t { 0 }) == 5000);
+				CHECK(cfg->key("other", "rate_limit", uint32_t { 0 }) == 200);
+			}
+			THEN("views already taken keep their values") {
+				auto v = cfg->tenant("acme");
+				cfg->set_for("acme", "rate_limit", uint32_t { 1 });
+				CHECK(v->key("rate_limit", uint32_t { 0 }) == 5000);
+				CHECK(cfg->key("acme", "rate_limit", uint32_t { 0 }) == 1);
+			}
+			AND_WHEN("the override is cleared") {
+				CHECK(cfg->clear_for("acme", "rate_limit"));
+				THEN("the tenant goes back to the global value") {
+					CHECK(cfg->key("acme", "rate_limit", uint32_t { 0 }) == 100);
+					CHECK(cfg->tenant_count() == 0);
+					CHECK(!cfg->clear_for("acme", "rate_limit"));
+				}
+			}
+			AND_WHEN("the tenant is dropped") {
+				cfg->set_for("acme", "plan", "enterprise");
+				CHECK(cfg->drop_tenant("acme"));
+				THEN("all of its overrides go") {
+					CHECK(cfg->key("acme", "plan", std::string { }) == "basic");
+					CHECK(cfg->key("acme", "rate_limit", uint32_t { 0 }) == 100);
+					CHECK(!cfg->drop_tenant("acme"));
+				}
+			}
+		}
+		WHEN("a tenant overrides a list") {
+			cfg->set_for("acme", "burst", "[4, 5, 6]");
+			THEN("its parsed value is used") {
+				CHECK(cfg->tenant("acme")->array<uint16_t>("burst").size() == 3);
+				CHECK(cfg->snapshot()->array<uint16_t>("burst").size() == 2);
+			}
+		}
+		WHEN("an override is not valid") {
+			THEN("it is refused") {
+				CHECK_THROWS_AS(cfg->set_for("acme", "missing", "1"), const std::invalid_argument &);
+				CHECK_THROWS_AS(cfg->set_for("acme", "rate_limit", "lots"), const std::invalid_argument &);
+				CHECK(cfg->tenant_count() == 0);
+			}
+		}
+		WHEN("many tenants override a key") {
+			for(uint32_t i = 0; i < 10000; ++i) {
+				cfg->set_for("tenant" + std::to_string(i), "rate_limit", i);
+			}
+			THEN("each sees its own value") {
+				CHECK(cfg->tenant_count() == 10000);
+				CHECK(cfg->key("tenant1234", "rate_limit", uint32_t { 0 }) == 1234);
+				CHECK(cfg->key("tenant9999", "rate_limit", uint32_t { 0 }) == 9999);
+				CHECK(cfg->key("tenant10000", "rate_limit", uint32_t { 0 }) == 100);
+			}
+		}
+	}
+}
@@ -0,0 +1,58 @@
+/**
+ * @file
+ */
+#include "catch.hpp"
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <appcon.h>
+#include "cfgmaker.h"
+
+using namespace appcon;
+
+SCENARIO("waiting for changes", "[wait]") {
+	GIVEN("a config object with a tuning key") {
+		auto cfg = make_config();
+		(*cfg)
+			("batch_size", uint32_t { 16 }, "tuning knob")
+			("unrelated", uint32_t { 0 }, "something else")
+		;
+		auto since = cfg->version("batch_size");
+		WHEN("nothing changes") {
+			auto start = std::chrono::steady_clock::now();
+			auto v = cfg->wait_for_change("batch_size", since, std::chrono::milliseconds { 50 });
+			auto elapsed = std::chrono::steady_clock::now() - start;
+			THEN("we time out with the same version") {
+				CHECK(v == since);
+				CHECK(elapsed >= std::chrono::milliseconds { 50 });
+			}
+		}
+		WHEN("the version has already moved on") {
+			cfg->set("batch_size", uint32_t { 32 }, "manual");
+			auto v = cfg->wait_for_change("batch_size", since, std::chrono::milliseconds { 5000 });
+			THEN("we return straight away") {
+				CHECK(v != since);
+			}
+		}
+		WHEN("another thread changes the key while we wait") {
+			std::atomic<bool> woke { false };
+			uint32_t v = 0;
+			std::thread waiter([&]() {
+				v = cfg->wait_for_change("batch_size", since, std::chrono::milliseconds { 5000 });
+				woke = true;
+			});
+			std::this_thread::sleep_for(std::chrono::milliseconds { 20 });
+			cfg->set("unrelated", uint32_t { 1 }, "manual");
+			std::this_thread::sleep_for(std::chrono::milliseconds { 20 });
+			bool woke_early = woke;
+			cfg->set("batch_size", uint32_t { 64 }, "manual");
+			waiter.join();
+			THEN("only the change to our key wakes us") {
+				CHECK(!woke_early);
+				CHECK(woke);
+				CHECK(v != since);
+				CHECK(cfg->key("batch_size", uint32_t { 0 }) == 64);
+			}
+		}
+	}
+}